@@ -15,7 +15,8 @@
 #ifndef CODING_SESSION
 #define CODING_SESSION
 
-#include <map>
+#include <utility>
+#include <vector>
 
 /** \class Coding_session
  *  \brief Abstract class Coding_session
@@ -45,12 +46,13 @@ class Coding_session
 	 * @param received_data Received data (source and parity)
 	 * @param buf_size Size of the received buffer
 	 * @param frame_size Output parameter for storing size of the decoded frame
-	 * @param valid_data Map storing pairs <offset, number of bytes> of received data
+	 * @param valid_data Sorted merged (non-adjacent) intervals <offset, number of bytes>
+	 *                   of received data
 	 * @return Recovered source data
 	 * */
 	virtual char*
 	    decode_frame ( char* received_data, int buf_size, int* frame_size, 
-		    std::map<int,int> valid_data) = 0;
+		    const std::vector<std::pair<int, int> > &valid_data) = 0;
 };
 
 #endif
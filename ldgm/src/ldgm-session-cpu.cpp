@@ -21,8 +21,14 @@
 #if defined __SSE2__ || _M_IX86_FP == 2
 #include <emmintrin.h>
 #endif
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define XOR_SIMD_X86 1
+#include <immintrin.h>
+#endif
 #include <string.h>
 #include <time.h>
+#include <algorithm>
+#include <thread>
 
 #include "ldgm-session-cpu.h"
 #include "timer-util.h"
@@ -134,6 +140,65 @@ xor_using_sse (char* source, char* dest, int packet_size)
     return dest;
 }
 
+#ifdef XOR_SIMD_X86
+__attribute__((target("avx2")))
+static char*
+xor_using_avx2 (char* source, char* dest, int packet_size)
+{
+    int i = 0;
+    for ( ; i + 32 <= packet_size; i += 32)
+    {
+        __m256i s = _mm256_loadu_si256((__m256i *) (source + i));
+        __m256i d = _mm256_loadu_si256((__m256i *) (dest + i));
+        _mm256_storeu_si256((__m256i *) (dest + i), _mm256_xor_si256(s, d));
+    }
+    if ( i < packet_size )
+        xor_using_sse(source + i, dest + i, packet_size - i);
+    return dest;
+}
+
+#if defined __clang__ || __GNUC__ >= 5
+#define XOR_SIMD_AVX512 1
+__attribute__((target("avx512f")))
+static char*
+xor_using_avx512 (char* source, char* dest, int packet_size)
+{
+    int i = 0;
+    for ( ; i + 64 <= packet_size; i += 64)
+    {
+        __m512i s = _mm512_loadu_si512((void *) (source + i));
+        __m512i d = _mm512_loadu_si512((void *) (dest + i));
+        _mm512_storeu_si512((void *) (dest + i), _mm512_xor_si512(s, d));
+    }
+    if ( i < packet_size )
+        xor_using_sse(source + i, dest + i, packet_size - i);
+    return dest;
+}
+#endif
+#endif
+
+typedef char* (*xor_fn_t)(char*, char*, int);
+
+/*
+ * Selects the widest XOR supported by the CPU the code runs on.
+ */
+static xor_fn_t
+select_xor ()
+{
+#ifdef XOR_SIMD_X86
+    __builtin_cpu_init();
+#ifdef XOR_SIMD_AVX512
+    if ( __builtin_cpu_supports("avx512f") )
+        return xor_using_avx512;
+#endif
+    if ( __builtin_cpu_supports("avx2") )
+        return xor_using_avx2;
+#endif
+    return xor_using_sse;
+}
+
+static const xor_fn_t xor_symbols = select_xor();
+
 void *
 LDGM_session_cpu::alloc_buf (int buf_size)
 {
@@ -147,44 +212,111 @@ LDGM_session_cpu::alloc_buf (int buf_size)
 
 }
 
+/*
+ * Computes bytes [offset, offset + len) of all parity symbols. Parity
+ * symbols accumulate (every one is XORed also with the previous one), so
+ * they cannot be computed independently, but byte columns can.
+ */
 void
-LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
+LDGM_session_cpu::encode_stripe ( char* data_ptr, char* parity_ptr, int offset, int len )
 {
-//    start encoding
-   // printf ( "packet_size: %d\n", this->packet_size );
-
-    char *parity_packet;
-
-	parity_packet = (char *) aligned_malloc(packet_size, 16);
-	if (!parity_packet)
-	{
-		printf ( "Error while using posix_memalign\n" );
-		return;
-	}
-	memset(parity_packet, 0, packet_size);
-
     for ( int m = 0; m < param_m; ++m) {
-//	printf ( "m: %d\n", m );
+        char *parity_packet = parity_ptr + m*packet_size + offset;
+        if ( m == 0 )
+            memset(parity_packet, 0, len);
+        else
+            memcpy(parity_packet, parity_packet - packet_size, len);
 
-//	printf ( "max w: %d\n", max_row_weight );
         //Find out which packets to XOR
         for ( int k = 0; k < max_row_weight+2; ++k) {
             int idx = pcm[m*(max_row_weight+2) + k];
-//	    printf ( "adept: %d\n", idx );
             if (idx > -1 && idx < param_k) {
-//		printf ( "xoring idx: %d\n", idx );
-                char *ptr = data_ptr + idx*packet_size;
-                parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
+                char *ptr = data_ptr + idx*packet_size + offset;
+                xor_symbols(ptr, parity_packet, len);
             }
         }
+    }
+}
 
-        //Add the new parity packet to overall parity
-        memcpy ( parity_ptr + m*packet_size, parity_packet, packet_size );
+/*
+ * Bounds of i-th of count stripes of a symbol. Stripes are kept aligned for
+ * the SIMD XOR.
+ */
+static void
+stripe_bounds ( int packet_size, int i, int count, int *start, int *end )
+{
+    *start = i == 0 ? 0 : packet_size * i / count / 64 * 64;
+    *end = i == count - 1 ? packet_size : packet_size * (i + 1) / count / 64 * 64;
+}
+
+void
+LDGM_session_cpu::worker ( int index, unsigned long long last_job )
+{
+    std::unique_lock<std::mutex> lk(job_lock);
+    while (true) {
+        job_cv.wait(lk, [&]{ return workers_exit || job_id != last_job; });
+        if ( workers_exit )
+            return;
+        last_job = job_id;
+        if ( index + 1 >= job_stripes )
+            continue;
+        int start, end;
+        stripe_bounds(packet_size, index + 1, job_stripes, &start, &end);
+        char *data_ptr = job_data;
+        char *parity_ptr = job_parity;
+        lk.unlock();
+        encode_stripe(data_ptr, parity_ptr, start, end - start);
+        lk.lock();
+        if ( --job_pending == 0 )
+            done_cv.notify_one();
+    }
+}
+
+void
+LDGM_session_cpu::stop_workers ()
+{
+    {
+        std::lock_guard<std::mutex> lk(job_lock);
+        workers_exit = true;
     }
+    job_cv.notify_all();
+    for ( auto & w : workers )
+        w.join();
+    workers.clear();
+}
 
-	aligned_free(parity_packet);
+void
+LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
+{
+    // split symbols among threads if there is enough work for each
+    int count = std::max(1, std::min<int>({ threads, packet_size / MIN_THREAD_STRIPE,
+                (int) ((long long) param_m * packet_size / MIN_THREAD_PARITY_BYTES) }));
 
-    return ;
+    if ( count == 1 ) {
+        encode_stripe(data_ptr, parity_ptr, 0, packet_size);
+        return;
+    }
+
+    // only this thread changes job_id
+    while ( (int) workers.size() < count - 1 )
+        workers.emplace_back(&LDGM_session_cpu::worker, this, (int) workers.size(), job_id);
+
+    {
+        std::lock_guard<std::mutex> lk(job_lock);
+        job_data = data_ptr;
+        job_parity = parity_ptr;
+        job_stripes = count;
+        job_pending = count - 1;
+        job_id += 1;
+    }
+    job_cv.notify_all();
+
+    int start, end;
+    stripe_bounds(packet_size, 0, count, &start, &end);
+    encode_stripe(data_ptr, parity_ptr, start, end - start);
+
+    std::unique_lock<std::mutex> lk(job_lock);
+    done_cv.wait(lk, [&]{ return job_pending == 0; });
 }		/* -----  end of method LDGM_session_cpu::encode  ----- */
 
 void
@@ -240,177 +372,122 @@ LDGM_session_cpu::encode_naive ( char* data_ptr, char* parity_ptr )
     return ;
 }		/* -----  end of method LDGM_session_cpu::encode  ----- */
 
-void iterate ( Tanner_graph *g);
+void
+LDGM_session_cpu::build_graph ()
+{
+    int vars = param_k + param_m;
+    int row_size = max_row_weight + 2;
+
+    cn_offsets.assign(param_m + 1, 0);
+    vn_offsets.assign(vars + 1, 0);
+    cn_vars.clear();
+    for ( int m = 0; m < param_m; ++m) {
+        for ( int k = 0; k < row_size; ++k ) {
+            int idx = pcm[m*row_size + k];
+            if ( idx > -1 ) {
+                cn_vars.push_back(idx);
+                vn_offsets[idx + 1]++;
+            }
+        }
+        cn_offsets[m + 1] = cn_vars.size();
+    }
+
+    for ( int v = 0; v < vars; ++v)
+        vn_offsets[v + 1] += vn_offsets[v];
+    vn_cons.resize(cn_vars.size());
+    vector<int> pos(vn_offsets.begin(), vn_offsets.end() - 1);
+    for ( int m = 0; m < param_m; ++m)
+        for ( int e = cn_offsets[m]; e < cn_offsets[m + 1]; ++e)
+            vn_cons[pos[cn_vars[e]]++] = m;
+
+    done.resize(vars);
+    missing.resize(param_m);
+    ready.reserve(param_m);
+}
+
+/*
+ * Peeling decoder - a constraint with a single missing variable recovers it
+ * as a XOR of its other variables, which may in turn leave other constraints
+ * with a single missing variable. Only constraints touched by missing symbols
+ * are visited.
+ */
+void
+LDGM_session_cpu::peel ( char *received )
+{
+    int vars = param_k + param_m;
+
+    fill(missing.begin(), missing.end(), 0);
+    ready.clear();
+    for ( int v = 0; v < vars; ++v) {
+        if ( done[v] )
+            continue;
+        for ( int e = vn_offsets[v]; e < vn_offsets[v + 1]; ++e)
+            if ( ++missing[vn_cons[e]] == 1 )
+                ready.push_back(vn_cons[e]);
+    }
+
+    while ( !ready.empty() ) {
+        int c = ready.back();
+        ready.pop_back();
+        // constraint was ready when pushed, but its counter may have changed since
+        if ( missing[c] != 1 || cn_offsets[c + 1] - cn_offsets[c] < 2 )
+            continue;
+
+        int r_index = -1;
+        for ( int e = cn_offsets[c]; e < cn_offsets[c + 1]; ++e)
+            if ( !done[cn_vars[e]] )
+                r_index = cn_vars[e];
+
+        char *r_data = received + r_index*packet_size;
+        memset(r_data, 0, packet_size);
+        for ( int e = cn_offsets[c]; e < cn_offsets[c + 1]; ++e)
+            if ( cn_vars[e] != r_index )
+                xor_symbols(received + cn_vars[e]*packet_size, r_data, packet_size);
+        done[r_index] = 1;
+
+        for ( int e = vn_offsets[r_index]; e < vn_offsets[r_index + 1]; ++e)
+            if ( --missing[vn_cons[e]] == 1 )
+                ready.push_back(vn_cons[e]);
+    }
+}
 
 char*
 LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
-                                 std::map<int, int> valid_data )
+                                 const std::vector<std::pair<int, int> > &valid_data )
 {
-//    printf ( "buf_size: %d\n", buf_size );
-
     Timer_util interval;
     interval.start();
 
-
-    Tanner_graph graph;
+    if ( cn_offsets.empty() )
+        build_graph();
 
     int p_size = buf_size/(param_m+param_k);
     this->packet_size = p_size;
-//    printf ( "p_size %d\n", p_size );
-    graph.set_data_size(p_size);
-
-    //Timer_util timer;
-
-    int i;
-    int index = 0;
-
-
-//    while ( i < (param_k + param_m)*p_size)
-//    {
-//	printf ( "%2d|", (unsigned char)received[i++] );
-//    }
-
-    //one variable node per each data packet in block K
-    for ( i = 0; i < param_k; ++i )
-        graph.add_node(Node::variable_node, index++, received + i*p_size);
 
-    //one variable node per each parity packet in block M
-    for ( i = 0; i < param_m; ++i)
-        graph.add_node(Node::variable_node, index++, received + (i + param_k)*p_size);
+    //Valid data intervals are sorted and merged, symbols have increasing offsets,
+    //so both can be walked at once
+    size_t interval_idx = 0;
+    for ( int i = 0; i < param_k + param_m; ++i) {
+        int node_offset = i*p_size;
 
-    //one constraint node per each row of generation matrix
-    for ( i = 0; i < param_m; ++i)
-        graph.add_node(Node::constraint_node, index++, NULL);
-
-    create_edges(&graph);
-
-//    printf("Graph created in: %.3f s\n", t);
-
-    /*      printf ( "graf\n" );
-     *     for(map<int, Node>::iterator it = graph.nodes.begin(); it != graph.nodes.end(); ++it) {
-     *      Node n = it->second;
-     *      for ( int i = 0; i < p_size; ++i)
-     *          printf("%2d|", *(unsigned char *)(n.getDataPtr() + i));
-     *      printf ( "---\n" );
-     *      }
-     */
-
-    /*      for(map<int, Node>::iterator it = graph.nodes.begin(); it != graph.nodes.end(); ++it) {
-     *      Node n = it->second;
-     *      printf ( "neigbours of %d (count %lu): ", it->first, (it->second).neighbours.size() );
-     *      for(vector<int>::iterator itr = n.neighbours.begin(); itr != n.neighbours.end(); ++itr)
-     *          printf ( "%d ", *itr );
-     *      printf ( "\n" );
-     *     }
-     */
-
-    //We need to merge intervals in the valid data vector
-    map <int, int> merged_intervals;
-    map<int,int>::iterator map_it;
-
-    if ( valid_data.size() != 0 )
-    {
-        for ( map_it = valid_data.begin(); map_it != valid_data.end(); )
-        {
-            int start = map_it->first;
-            int length = map_it->second;
-            while ( start + length == (++map_it)->first )
-                length += map_it->second;
-            merged_intervals.insert ( pair<int, int> (start, length) );
-        }
-    }
-    /*     printf ( "Valid data: \n" );
-     *     for ( map_it = valid_data.begin(); map_it != valid_data.end(); ++map_it)
-     *     {
-     * 	printf ( "|%d-%d| ", map_it->first, map_it->second );
-     *     }
-     *     printf ( "\n" );
-     *
-     *     printf ( "Merged intervals: \n" );
-     *     for ( map_it = merged_intervals.begin(); map_it != merged_intervals.end(); ++map_it)
-     *     {
-     * 	printf ( "|%d-%d| ", map_it->first, map_it->second );
-     *     }
-     *     printf ( "\n" );
-     *
-     */
-
-
-
-    map<int, Node>::iterator it;
-    if ( merged_intervals.size() != 0)
-    {
-        it = graph.nodes.find(0);
-        while (it != graph.nodes.find(param_k+param_m)) {
-            (*it).second.setDone(false);
-            int node_offset = (*it).second.getDataPtr() - received;
-//	    printf ( "offset: %d\n", node_offset );
-
-            map_it = merged_intervals.begin();
-            //Find the offset in valid data which is equal, or the first offset which is
-            //lower than node offset
-            bool found = false;
-            while ( (map_it->first <= node_offset) && map_it != merged_intervals.end() )
-            {
-                map_it++;
-                found = true;
-            }
-            if ( found )
-                map_it--;
-
-            //Next, find out if some interval covers this symbol
-            if ( found && (map_it->first + map_it->second) >=
-                    (node_offset + p_size) )
-            {
-                (*it).second.setDone(true);
-//		printf ( "setting node %d with offset %d and size %d as done\n", it->first,
-//			node_offset, p_size);
-            }
+        //Skip intervals that end before end of this symbol
+        while ( interval_idx < valid_data.size() &&
+                valid_data[interval_idx].first + valid_data[interval_idx].second < node_offset + p_size )
+            interval_idx++;
 
-            ++it;
-        }
-    }
+        //Next, find out if the interval covers this symbol
+        done[i] = interval_idx < valid_data.size() && valid_data[interval_idx].first <= node_offset;
 
-    int not_done = 0;
-    for ( it = graph.nodes.begin(); it != graph.nodes.find(param_k); it++)
-    {
-        if ( !it->second.isDone())
-        {
-            memset(it->second.getDataPtr(), 0, p_size);
-//	    printf ( "resetting node: %d\n", it->first );
-            not_done++;
-        }
+        if ( !done[i] && i < param_k )
+            memset(received + node_offset, 0, p_size);
     }
-//    printf ( "not done: %d\n", not_done );
-    /*     srand(time(NULL));
-     *     for ( int j = 0; j < 100; j++)
-     *     {
-     * 	it = graph.nodes.find(rand()%(param_k+param_m));
-     * 	(*it).second.setDone(false);
-     *     }
-     */
-    int iter = 0;
-
-    while ( needs_decoding(&graph) && iter < 4) {
-//	printf ( "iteratin\n" );
-        iterate(&graph);
-        iter++;
-    }
-
-//    printf("decoding process: %.3f s\n", t);
 
-    //printf ( "iterations: %d\n", iter );
+    peel(received);
 
     int undecoded = 0;
-    it = graph.nodes.find(0);
-    while ( it != graph.nodes.find(param_k) ) {
-        if (!(*it).second.isDone())
+    for ( int i = 0; i < param_k; ++i)
+        if ( !done[i] )
             undecoded++;
-        ++it;
-    }
-//    printf ( "Number of not recovered data packets: %d\n", undecoded );
-
-    //    printf("rest: %.3f s\n", t);
 
     if ( undecoded == 0 )
     {
@@ -427,93 +504,9 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
 
 
     interval.end();
-    //printf("time: %e\n",elapsed/1000.0 );
     this->elapsed_sum2 += interval.elapsed_time_ms();
     this->no_frames2++;
 
-    if(this->no_frames==150){
-        //printf("TIME: %f ms\n",this->elapsed_sum/(double)this->no_frames );
-    }
-
     return received + LDGM_session::HEADER_SIZE;
 }		/* -----  end ofmethod LDGM_session_cpu::decode  ----- */
 
-
-void
-LDGM_session_cpu::iterate ( Tanner_graph *graph )
-{
-    map<int, Node>::iterator it_c;
-    vector<int> vec;
-
-    static int recovered = 0;
-
-    //select the first constraint node
-    it_c = graph->nodes.find ( param_k + param_m );
-
-    //iterate through constraint nodes
-    while ( it_c != graph->nodes.end() ) {
-        //iterate the node's neighbours to find out how many of them are not decoded
-        map<int, Node>::iterator it_v;
-        for(vector<int>::iterator j = it_c->second.neighbours.begin();
-                j != it_c->second.neighbours.end(); ++j) {
-            it_v = graph->nodes.find(*j);
-            if ( !it_v->second.isDone() )
-                vec.push_back(*j);
-        }
-//	printf ( "node %d has %d undecoded neighbours\n", it_c->first, vec.size() );
-
-        //we can restore the missing packet
-        if ( vec.size() == 1)
-        {
-            int r_index = vec.front();
-
-//	    if ( r_index == 0 )
-//	    {
-//		printf ( "repairing first block\n" );
-//	    }
-            it_v = graph->nodes.find(r_index);
-            memset(it_v->second.getDataPtr(), 0, packet_size);
-            char *r_data = it_v->second.getDataPtr();
-            //find other nodes connected to this constraint node and XOR their values
-            int count = 0;
-            for(vector<int>::iterator j = it_c->second.neighbours.begin();
-                    j != it_c->second.neighbours.end(); ++j)
-            {
-                if ( *j != r_index )
-                {
-//		    printf ( "decode, packet_size: %d\n", packet_size );
-                    char *g_data = (graph->nodes.find(*j))->second.getDataPtr();
-                    //XOR
-                    xor_using_sse(g_data, r_data, packet_size);
-                    count++;
-                }
-            }
-            /*           //validate recovered packet
-             *          for ( int i = 0; i < param_k; ++i) {
-             *              if(!memcmp(r_data, lost_ptr + i*packet_size, packet_size)) {
-             *                  printf ( "packet ok\n" );
-             *                  break;
-             *              }
-             *          }
-             */
-            if ( count > 0 )
-                it_v->second.setDone(true);
-            recovered++;
-            /*           printf ( "restored data: \n" );
-             *          for ( int  i = 0; i < packet_size; ++i)
-             *              printf ( "%2d|", (unsigned char)(*(it_v->second.getDataPtr() + i)) );
-             *          printf ( "---\n" );
-             */
-
-
-        }
-        vec.clear();
-
-        ++it_c;
-    }
-//    printf ( "recovered: %d\n", recovered );
-
-    return;
-
-}
-
@@ -20,6 +20,11 @@
 #ifndef  LDGM_SESSION_CPU_INC
 #define  LDGM_SESSION_CPU_INC
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "ldgm-session.h"
 //#include "timer-util.h"
 
@@ -37,8 +42,16 @@ class LDGM_session_cpu : public LDGM_session
 		printf("CPU LDGM in progress .... \n");
 		elapsed_sum=0.0;
 		no_frames=0;
+		threads=1;
+		job_id=0;
+		job_stripes=0;
+		job_pending=0;
+		job_data=NULL;
+		job_parity=NULL;
+		workers_exit=false;
 	}                            /* constructor */
 	~LDGM_session_cpu () {
+		stop_workers();
 		printf("LDGM TIME CPU: %f ms\n",this->elapsed_sum2/(double)this->no_frames2 );
 	 }                            /* constructor */
 
@@ -50,10 +63,7 @@ class LDGM_session_cpu : public LDGM_session
 
 	char*                                                                             
 	    decode_frame ( char* received_data, int buf_size, int* frame_size,
-		    std::map<int, int> valid_data );
-
-	void
-	    iterate ( Tanner_graph *graph);
+		    const std::vector<std::pair<int, int> > &valid_data );
 
 	void
 	    free_out_buf (char *buf);
@@ -61,14 +71,70 @@ class LDGM_session_cpu : public LDGM_session
 	void *
 		alloc_buf(int size);
 
+	/* number of threads computing parity of a frame */
+	void
+	    set_threads ( int count ) { threads = count > 0 ? count : 1; }
+
     protected:
 	/* ====================  DATA MEMBERS  ======================================= */
 
     private:
+	/* a thread is used only if it computes at least this amount of parity */
+	static const int MIN_THREAD_PARITY_BYTES = 256 * 1024;
+	/* minimal part of a symbol encoded by one thread */
+	static const int MIN_THREAD_STRIPE = 1024;
+
+	void
+	    encode_stripe ( char* data_ptr, char* parity_ptr, int offset, int len );
+
+	void
+	    worker ( int index, unsigned long long last_job );
+
+	void
+	    stop_workers ();
+
+	void
+	    build_graph ();
+
+	void
+	    peel ( char *received );
+
 	/* ====================  DATA MEMBERS  ======================================= */
     double elapsed_sum;
 	long no_frames;
 
+	/*
+	 * Tanner graph in compressed sparse row form, built once from pcm.
+	 * Variable nodes are symbols 0 .. k+m-1, constraint nodes rows of pcm.
+	 */
+	std::vector<int> cn_offsets;    /* param_m + 1 offsets to cn_vars */
+	std::vector<int> cn_vars;       /* variables of each constraint */
+	std::vector<int> vn_offsets;    /* param_k + param_m + 1 offsets to vn_cons */
+	std::vector<int> vn_cons;       /* constraints of each variable */
+
+	int threads;
+
+	/*
+	 * Encoding threads, started when first needed and kept for the whole
+	 * session. Worker i computes stripe i + 1 of the current job, stripe 0
+	 * is computed by the caller of encode().
+	 */
+	std::vector<std::thread> workers;
+	std::mutex job_lock;
+	std::condition_variable job_cv;     /* new job or exit */
+	std::condition_variable done_cv;    /* all workers finished their stripes */
+	unsigned long long job_id;          /* incremented with every job */
+	int job_stripes;                    /* number of stripes of the current job */
+	int job_pending;                    /* stripes not yet finished by workers */
+	char *job_data;
+	char *job_parity;
+	bool workers_exit;
+
+	/* per-frame decoding state, only resized when the graph is built */
+	std::vector<char> done;         /* symbol received or recovered */
+	std::vector<int> missing;       /* number of not done variables of each constraint */
+	std::vector<int> ready;         /* constraints with a single missing variable */
+
 }; /* -----  end of class LDGM_session_cpu  ----- */
 
 #endif   /* ----- #ifndef LDGM_SESSION_CPU_INC  ----- */
@@ -82,7 +82,7 @@ class LDGM_session_gpu : public LDGM_session
 	 void *
 		alloc_buf(int size);
 
-	char * decode_frame ( char* received_data, int buf_size, int* frame_size, std::map<int, int> valid_data );
+	char * decode_frame ( char* received_data, int buf_size, int* frame_size, const std::vector<std::pair<int, int> > &valid_data );
 	void set_data_fname(char fname[32]) { strncpy(data_fname, fname, 32); }
 
     protected:
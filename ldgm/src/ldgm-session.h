@@ -86,7 +86,7 @@ class LDGM_session : public Coding_session
 
 	virtual char*
 	    decode_frame ( char* received_data, int buf_size, int* frame_size, 
-		    std::map<int, int>  valid_data ) = 0;
+		    const std::vector<std::pair<int, int> > &valid_data ) = 0;
 
 	void
 	    set_params ( unsigned short k,
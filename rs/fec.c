@@ -9,6 +9,11 @@
 #include <string.h>
 #include <assert.h>
 
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define GF_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
 /*
  * Primitive polynomials - see Lin & Costello, Appendix A,
  * and  Lee & Messerschmitt, p. 453.
@@ -64,6 +69,15 @@ static gf gf_mul_table[256][256];
 #define GF_MULC0(c) __gf_mulc_ = gf_mul_table[c]
 #define GF_ADDMULC(dst, x) dst ^= __gf_mulc_[x]
 
+/*
+ * Products of every constant c with low and high nibbles (c * x and
+ * c * (x << 4) for x in 0..15) used by the SIMD addmul variants - product of
+ * c with a byte is a xor of products with both of its nibbles, each of them
+ * being a single 16-entry table lookup (PSHUFB).
+ */
+static gf gf_mul_lo[256][16];
+static gf gf_mul_hi[256][16];
+
 /*
  * Generate GF(2**m) from the irreducible polynomial p(X) in p[0]..p[m]
  * Lookup tables:
@@ -83,6 +97,12 @@ _init_mul_table(void) {
 
   for (j = 0; j < 256; j++)
       gf_mul_table[0][j] = gf_mul_table[j][0] = 0;
+
+  for (i = 0; i < 256; i++)
+      for (j = 0; j < 16; j++) {
+          gf_mul_lo[i][j] = gf_mul_table[i][j];
+          gf_mul_hi[i][j] = gf_mul_table[i][j << 4];
+      }
 }
 
 #define NEW_GF_MATRIX(rows, cols) \
@@ -165,7 +185,7 @@ generate_gf (void) {
  * calls are unfrequent in my typical apps so I did not bother.
  */
 #define addmul(dst, src, c, sz)                 \
-    if (c != 0) _addmul1(dst, src, c, sz)
+    if (c != 0) _addmul_fn(dst, src, c, sz)
 
 #define UNROLL 16               /* 1, 4, 8, 16 */
 static void
@@ -204,6 +224,133 @@ _addmul1(gf*restrict dst, const gf*restrict src, gf c, size_t sz) {
         GF_ADDMULC (*dst, *src);
 }
 
+#ifdef GF_SIMD_X86
+__attribute__((target("ssse3")))
+static void
+_addmul_ssse3(gf*restrict dst, const gf*restrict src, gf c, size_t sz) {
+    const __m128i lo = _mm_loadu_si128((const __m128i *) gf_mul_lo[c]);
+    const __m128i hi = _mm_loadu_si128((const __m128i *) gf_mul_hi[c]);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *) (dst + i));
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+                _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_xor_si128(d, p));
+    }
+    if (i < sz)
+        _addmul1(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("avx2")))
+static void
+_addmul_avx2(gf*restrict dst, const gf*restrict src, gf c, size_t sz) {
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) gf_mul_lo[c]));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) gf_mul_hi[c]));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 32 <= sz; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i d = _mm256_loadu_si256((const __m256i *) (dst + i));
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+                _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_xor_si256(d, p));
+    }
+    if (i < sz)
+        _addmul_ssse3(dst + i, src + i, c, sz - i);
+}
+
+#if defined __clang__ || __GNUC__ >= 5
+#define GF_SIMD_AVX512 1
+__attribute__((target("avx512f,avx512bw")))
+static void
+_addmul_avx512(gf*restrict dst, const gf*restrict src, gf c, size_t sz) {
+    const __m512i lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) gf_mul_lo[c]));
+    const __m512i hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) gf_mul_hi[c]));
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 64 <= sz; i += 64) {
+        __m512i s = _mm512_loadu_si512((const void *) (src + i));
+        __m512i d = _mm512_loadu_si512((const void *) (dst + i));
+        __m512i p = _mm512_xor_si512(_mm512_shuffle_epi8(lo, _mm512_and_si512(s, mask)),
+                _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), mask)));
+        _mm512_storeu_si512((void *) (dst + i), _mm512_xor_si512(d, p));
+    }
+    if (i < sz)
+        _addmul_ssse3(dst + i, src + i, c, sz - i);
+}
+#endif /* defined __clang__ || __GNUC__ >= 5 */
+#endif /* GF_SIMD_X86 */
+
+typedef void (*addmul_fn_t)(gf*restrict dst, const gf*restrict src, gf c, size_t sz);
+static addmul_fn_t _addmul_fn = _addmul1;
+static enum fec_simd _simd = FEC_SIMD_NONE;
+static int _simd_selected = 0;
+
+enum fec_simd
+fec_simd_best (void) {
+#ifdef GF_SIMD_X86
+    __builtin_cpu_init ();
+#ifdef GF_SIMD_AVX512
+    if (__builtin_cpu_supports ("avx512bw"))
+        return FEC_SIMD_AVX512;
+#endif
+    if (__builtin_cpu_supports ("avx2"))
+        return FEC_SIMD_AVX2;
+    if (__builtin_cpu_supports ("ssse3"))
+        return FEC_SIMD_SSSE3;
+#endif
+    return FEC_SIMD_NONE;
+}
+
+enum fec_simd
+fec_set_simd (enum fec_simd simd) {
+    if (simd > fec_simd_best ())
+        simd = fec_simd_best ();
+
+    switch (simd) {
+#ifdef GF_SIMD_X86
+#ifdef GF_SIMD_AVX512
+    case FEC_SIMD_AVX512:
+        _addmul_fn = _addmul_avx512;
+        break;
+#endif
+    case FEC_SIMD_AVX2:
+        _addmul_fn = _addmul_avx2;
+        break;
+    case FEC_SIMD_SSSE3:
+        _addmul_fn = _addmul_ssse3;
+        break;
+#endif
+    default:
+        simd = FEC_SIMD_NONE;
+        _addmul_fn = _addmul1;
+    }
+    _simd = simd;
+    _simd_selected = 1;
+    return simd;
+}
+
+enum fec_simd
+fec_get_simd (void) {
+    return _simd;
+}
+
+const char *
+fec_simd_name (enum fec_simd simd) {
+    switch (simd) {
+    case FEC_SIMD_NONE: return "scalar";
+    case FEC_SIMD_SSSE3: return "SSSE3";
+    case FEC_SIMD_AVX2: return "AVX2";
+    case FEC_SIMD_AVX512: return "AVX-512";
+    }
+    return "unknown";
+}
+
 /*
  * computes C = AB where A is n*k, B is k*m, C is n*m
  */
@@ -399,6 +546,8 @@ static void
 init_fec (void) {
     generate_gf();
     _init_mul_table();
+    if (!_simd_selected)
+        fec_set_simd(FEC_SIMD_AVX512);
     fec_initialized = 1;
 }
 
@@ -42,6 +42,29 @@ void fec_encode(const fec_t* code, const gf*restrict const*restrict const src, g
  */
 void fec_decode(const fec_t* code, const gf*restrict const*restrict const inpkts, gf*restrict const*restrict const outpkts, const unsigned*restrict const index, size_t sz);
 
+/**
+ * Implementations of GF(2^8) multiply-accumulate used by fec_encode() and
+ * fec_decode(). All of them produce byte-exact same output. The best one
+ * supported by the CPU is selected by the first fec_new().
+ */
+enum fec_simd {
+  FEC_SIMD_NONE,   /* scalar multiplication table */
+  FEC_SIMD_SSSE3,
+  FEC_SIMD_AVX2,
+  FEC_SIMD_AVX512, /* AVX-512BW */
+};
+
+/** @returns the best implementation supported by the CPU */
+enum fec_simd fec_simd_best(void);
+/**
+ * Selects the implementation, if not supported, the best supported one is used.
+ * Should not be called while coding is in progress.
+ * @returns implementation actually selected
+ */
+enum fec_simd fec_set_simd(enum fec_simd simd);
+enum fec_simd fec_get_simd(void);
+const char *fec_simd_name(enum fec_simd simd);
+
 #if defined(_MSC_VER)
 #define alloca _alloca
 #else
@@ -839,6 +839,8 @@ static struct response *audio_sender_process_message(struct state_audio *s, stru
                                 LOG(LOG_LEVEL_ERROR) << "Not implemented!\n";
                         }
                         return new_response(RESPONSE_NOT_IMPL, NULL);
+                case SENDER_MSG_CHANGE_BITRATE:
+                        return new_response(RESPONSE_NOT_IMPL, NULL);
         }
         return new_response(RESPONSE_OK, NULL);
 }
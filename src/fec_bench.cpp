@@ -0,0 +1,388 @@
+/**
+ * @file   fec_bench.cpp
+ * @brief  Offline FEC benchmark - codes synthetic frames, drops packets
+ *         according to a loss model and reports throughput and residual loss.
+ *
+ * Frames are packetized the same way as in tx_send_base() and the decoder is
+ * created from the FEC description carried by the encoded frame, as on the
+ * receiver. Every decoded frame is compared with the original, so the tool
+ * also serves as a validation of the codes (exits with 1 on a mismatch).
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/fec.h"
+#include "rtp/rtp_callback.h"
+#include "utils/loss_model.h"
+#include "utils/received_ranges.h"
+#include "video.h"
+
+#define DEFAULT_FRAME_LEN (1920 * 1080 * 2)
+#define DEFAULT_FRAMES 100
+#define DEFAULT_MTU 1500
+#define DEFAULT_LOSS "bernoulli:0.01"
+#define IP_UDP_RTP_HDRS_LEN (20 + 8 + 12)
+
+using namespace std;
+using namespace std::chrono;
+
+void exit_uv(int status)
+{
+        exit(status);
+}
+
+static void usage(const char *progname)
+{
+        printf("Usage:\n\t%s [-b <bytes>] [-n <frames>] [-m <mtu>] [-l <loss>] [-s <seed>]\n"
+                        "\t\t[-p <key>=<value>[,...]] <fec> [<fec> ...]\n\n", progname);
+        printf("\t<fec> - none, mult:<nr>, ldgm:<k>:<m>:<c>, ldgm:<max_loss>%% or rs:<k>:<n>\n");
+        printf("\t-b - frame size in bytes (default %d)\n", DEFAULT_FRAME_LEN);
+        printf("\t-n - number of frames (default %d)\n", DEFAULT_FRAMES);
+        printf("\t-m - MTU (default %d)\n", DEFAULT_MTU);
+        printf("\t-l - loss model (default %s):\n", DEFAULT_LOSS);
+        printf("\t\tbernoulli:<p> - every packet is lost with probability p\n");
+        printf("\t\tge:<p>:<r>[:<loss_good>:<loss_bad>] - Gilbert-Elliott model, p and r are\n"
+                        "\t\tprobabilities of transition good->bad and bad->good, packets are lost\n"
+                        "\t\twith loss_good (default 0) and loss_bad (default 1) in the states\n");
+        printf("\t-s - random seed of the loss model, same for all <fec>s (default 1)\n");
+        printf("\t-p - UltraGrid params, eg. ldgm-device=GPU or ldgm-threads=<n>\n");
+}
+
+struct bench_result {
+        long long packets = 0;
+        long long lost_packets = 0;
+        int frames = 0;
+        int lost_frames = 0;        ///< frames that could not be reconstructed
+        int corrupted_frames = 0;   ///< frames reconstructed with wrong content
+        double encode_sec = 0.0;
+        double decode_sec = 0.0;    ///< time of successful decodes (failures may be much faster)
+        int decoded_frames = 0;
+        long long coded_bytes = 0;
+};
+
+/**
+ * Translates FEC specification in -f syntax to fec::create_from_config()
+ * configuration (see set_fec() and tx_update() in transmit.cpp).
+ * @returns empty string for none and mult
+ */
+static string fec_config(string const & spec, int mtu, int frame_len, int *mult)
+{
+        *mult = 1;
+        string name = spec.substr(0, spec.find(':'));
+        string cfg = spec.find(':') == string::npos ? string() : spec.substr(spec.find(':') + 1);
+        if (strcasecmp(name.c_str(), "none") == 0) {
+                return {};
+        } else if (strcasecmp(name.c_str(), "mult") == 0) {
+                *mult = atoi(cfg.c_str());
+                if (*mult < 1) {
+                        throw string("Wrong mult count: ") + cfg;
+                }
+                return {};
+        } else if (strcasecmp(name.c_str(), "ldgm") == 0) {
+                if (cfg.find('%') == string::npos) {
+                        return "LDGM cfg " + cfg;
+                }
+                int data_len = (mtu - (40 + sizeof(fec_video_payload_hdr_t))) / 48 * 48;
+                return "LDGM percents " + to_string(data_len) + " " + to_string(frame_len) + " " +
+                        to_string(atof(cfg.c_str()));
+        } else if (strcasecmp(name.c_str(), "rs") == 0) {
+                return "RS cfg " + cfg;
+        }
+        throw string("Unknown FEC: ") + spec;
+}
+
+/**
+ * Splits coded buffer to packet payloads <offset, length>, FEC symbols are
+ * not split across packets unless they exceed the payload size (as in
+ * get_data_len() in transmit.cpp).
+ */
+static vector<pair<int, int>> packetize(int len, bool with_fec, int symbol_size, int mtu)
+{
+        int payload = mtu - IP_UDP_RTP_HDRS_LEN - (with_fec ? sizeof(fec_video_payload_hdr_t) :
+                        sizeof(video_payload_hdr_t));
+        vector<pair<int, int>> packets;
+        int symbol_offset = 0;
+        for (int pos = 0; pos < len; ) {
+                int data_len = payload;
+                if (with_fec) {
+                        if (symbol_size <= payload) {
+                                data_len = payload / symbol_size * symbol_size;
+                        } else if (symbol_size - symbol_offset <= payload) {
+                                data_len = symbol_size - symbol_offset;
+                                symbol_offset = 0;
+                        } else {
+                                symbol_offset += data_len;
+                        }
+                } else {
+                        data_len = payload / 48 * 48;
+                }
+                data_len = min(data_len, len - pos);
+                packets.push_back({pos, data_len});
+                pos += data_len;
+        }
+        return packets;
+}
+
+/**
+ * @returns order of (packet index) in which are the packets sent with mult
+ * FEC, see tx_send_base()
+ */
+static vector<int> mult_send_order(int packet_count, int mult)
+{
+        vector<int> order;
+        vector<int> pos(mult);
+        int index = 0;
+        int first_sent = 0;
+        while (pos[mult - 1] < packet_count) {
+                if (pos[index] < packet_count) {
+                        order.push_back(pos[index]);
+                }
+                pos[index] += 1;
+                first_sent += 1;
+                if (index != 0 || first_sent >= mult - 1) {
+                        index = (index + 1) % mult;
+                }
+        }
+        return order;
+}
+
+static double seconds_since(steady_clock::time_point t0)
+{
+        return duration_cast<duration<double>>(steady_clock::now() - t0).count();
+}
+
+static bool run(string const & spec, shared_ptr<video_frame> const & frame, int frames, int mtu,
+                const char *loss_cfg, unsigned int seed, bench_result *res)
+{
+        int frame_len = frame->tiles[0].data_len;
+        int mult;
+        unique_ptr<fec> encoder;
+        unique_ptr<fec> decoder;
+        try {
+                string cfg = fec_config(spec, mtu, frame_len, &mult);
+                if (!cfg.empty()) {
+                        encoder.reset(fec::create_from_config(cfg.c_str()));
+                }
+        } catch (string const & err) {
+                log_msg(LOG_LEVEL_ERROR, "%s: %s\n", spec.c_str(), err.c_str());
+                return false;
+        } catch (...) {
+                log_msg(LOG_LEVEL_ERROR, "%s: wrong configuration\n", spec.c_str());
+                return false;
+        }
+        unique_ptr<loss_model> loss(loss_model::create(loss_cfg, seed));
+
+        vector<char> rx_buffer;
+        for (int i = 0; i < frames; ++i) {
+                shared_ptr<video_frame> coded = frame;
+                if (encoder) {
+                        auto t0 = steady_clock::now();
+                        coded = encoder->encode(frame);
+                        res->encode_sec += seconds_since(t0);
+                }
+                int coded_len = coded->tiles[0].data_len;
+                auto packets = packetize(coded_len, encoder != nullptr, coded->fec_params.symbol_size, mtu);
+                auto order = mult_send_order(packets.size(), mult);
+
+                received_ranges received;
+                vector<bool> packet_received(packets.size());
+                for (int idx : order) {
+                        res->packets += 1;
+                        if (loss->lost()) {
+                                res->lost_packets += 1;
+                        } else if (!packet_received[idx]) {
+                                packet_received[idx] = true;
+                                received.add(packets[idx].first, packets[idx].second);
+                        }
+                }
+                res->frames += 1;
+                res->coded_bytes += (long long) coded_len * mult;
+
+                if (!encoder) {
+                        if (received.total() != coded_len) {
+                                res->lost_frames += 1;
+                        }
+                        continue;
+                }
+
+                rx_buffer.assign(coded_len, 0);
+                for (auto const & r : received.intervals()) {
+                        memcpy(rx_buffer.data() + r.first, coded->tiles[0].data + r.first, r.second);
+                }
+                if (!decoder) { // as in video decoder, from parameters received with the frame
+                        decoder.reset(fec::create_from_desc(coded->fec_params));
+                }
+                char *out = nullptr;
+                int out_len = 0;
+                auto t0 = steady_clock::now();
+                decoder->decode(rx_buffer.data(), coded_len, &out, &out_len, received);
+                double decode_sec = seconds_since(t0);
+                if (out_len == 0) {
+                        res->lost_frames += 1;
+                        continue;
+                }
+                res->decode_sec += decode_sec;
+                res->decoded_frames += 1;
+                if (out_len != frame_len + (int) sizeof(video_payload_hdr_t) ||
+                                memcmp(out + sizeof(video_payload_hdr_t), frame->tiles[0].data, frame_len) != 0) {
+                        res->corrupted_frames += 1;
+                }
+        }
+        return true;
+}
+
+int main(int argc, char *argv[])
+{
+        int frame_len = DEFAULT_FRAME_LEN;
+        int frames = DEFAULT_FRAMES;
+        int mtu = DEFAULT_MTU;
+        const char *loss_cfg = DEFAULT_LOSS;
+        unsigned int seed = 1;
+
+        int ch;
+        while ((ch = getopt(argc, argv, "b:n:m:l:s:p:h")) != -1) {
+                switch (ch) {
+                case 'b':
+                        frame_len = atoi(optarg);
+                        break;
+                case 'n':
+                        frames = atoi(optarg);
+                        break;
+                case 'm':
+                        mtu = atoi(optarg);
+                        break;
+                case 'l':
+                        loss_cfg = optarg;
+                        break;
+                case 's':
+                        seed = strtoul(optarg, NULL, 10);
+                        break;
+                case 'p':
+                        {
+                                char *save_ptr = NULL;
+                                char *item;
+                                while ((item = strtok_r(optarg, ",", &save_ptr))) {
+                                        optarg = NULL;
+                                        char *val = strchr(item, '=');
+                                        if (val) {
+                                                *val++ = '\0';
+                                        }
+                                        commandline_params[item] = val ? val : "";
+                                }
+                        }
+                        break;
+                case 'h':
+                        usage(argv[0]);
+                        return 0;
+                default:
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+        if (optind == argc || frame_len <= 0 || frames <= 0 ||
+                        mtu <= IP_UDP_RTP_HDRS_LEN + (int) sizeof(fec_video_payload_hdr_t) ||
+                        mtu > RTP_MAX_MTU) {
+                usage(argv[0]);
+                return 1;
+        }
+        unique_ptr<loss_model> loss(loss_model::create(loss_cfg, seed));
+        if (!loss) {
+                log_msg(LOG_LEVEL_ERROR, "Wrong loss model: %s\n", loss_cfg);
+                return 1;
+        }
+
+        // frame of UYVY lines, last one possibly incomplete
+        struct video_desc desc{};
+        desc.width = 1920;
+        desc.height = (frame_len + desc.width * 2 - 1) / (desc.width * 2);
+        desc.color_spec = UYVY;
+        desc.fps = 30;
+        desc.interlacing = PROGRESSIVE;
+        desc.tile_count = 1;
+        shared_ptr<video_frame> frame(vf_alloc_desc_data(desc), vf_free);
+        frame->tiles[0].data_len = frame_len;
+        srand(seed);
+        for (int i = 0; i < frame_len; ++i) {
+                frame->tiles[0].data[i] = rand();
+        }
+
+        printf("%d frames of %d B, MTU %d, loss model %s (mean loss %.3f %%)\n\n",
+                        frames, frame_len, mtu, loss_cfg, loss->mean_loss() * 100.0);
+        printf("%-20s %9s %9s %11s %11s %12s %9s\n", "FEC", "overhead", "pkt loss",
+                        "enc [MB/s]", "dec [MB/s]", "frames lost", "corrupted");
+
+        bool ok = true;
+        for (int i = optind; i < argc; ++i) {
+                bench_result res;
+                if (!run(argv[i], frame, frames, mtu, loss_cfg, seed, &res)) {
+                        ok = false;
+                        continue;
+                }
+                char enc[32] = "-", dec[32] = "-", lost[32];
+                if (res.encode_sec > 0.0) {
+                        snprintf(enc, sizeof enc, "%.1f", (double) frame_len * res.frames / res.encode_sec / 1000000.0);
+                }
+                if (res.decode_sec > 0.0) {
+                        snprintf(dec, sizeof dec, "%.1f", (double) frame_len * res.decoded_frames / res.decode_sec / 1000000.0);
+                }
+                snprintf(lost, sizeof lost, "%.2f %%", (double) res.lost_frames / res.frames * 100.0);
+                printf("%-20s %7.2f %% %7.3f %% %11s %11s %12s %9d\n", argv[i],
+                                ((double) res.coded_bytes / frame_len / res.frames - 1.0) * 100.0,
+                                (double) res.lost_packets / res.packets * 100.0,
+                                enc, dec, lost, res.corrupted_frames);
+                if (res.corrupted_frames > 0) {
+                        ok = false;
+                }
+        }
+
+        return ok ? 0 : 1;
+}
+
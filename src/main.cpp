@@ -285,7 +285,12 @@ static void usage(const char *exec_path)
         printf("\t-f [A:|V:]<settings>     \tFEC settings (audio or video) - use \"none\"\n"
                "\t                         \t\"mult:<nr>\",\n");
         printf("\t                         \t\"ldgm:<max_expected_loss>%%\" or\n");
-        printf("\t                         \t\"ldgm:<k>:<m>:<c>\"\n");
+        printf("\t                         \t\"ldgm:<k>:<m>:<c>\" or\n");
+        printf("\t                         \t\"rs:<k>:<n>\" (for audio k data and n - k\n");
+        printf("\t                         \tparity packets) or\n");
+        printf("\t                         \t\"interleaved:<cols>:<rows>[:<frames>]\"\n");
+        printf("\t                         \t(video only, parity over packets of\n");
+        printf("\t                         \tup to <frames> frames)\n");
         printf("\n");
         printf("\t-P <port> | <video_rx>:<video_tx>[:<audio_rx>:<audio_tx>]\n");
         printf("\t                         \t<port> is base port number, also 3 subsequent\n");
@@ -49,6 +49,7 @@ enum msg_sender_type {
         SENDER_MSG_CHANGE_FEC,
         SENDER_MSG_QUERY_VIDEO_MODE,
         SENDER_MSG_RESET_SSRC,
+        SENDER_MSG_CHANGE_BITRATE,
 };
 
 struct msg_sender {
@@ -61,6 +62,7 @@ struct msg_sender {
                 };
                 char receiver[128];
                 char fec_cfg[1024];
+                long long bitrate; ///< requested compression bitrate (bps)
         };
 };
 
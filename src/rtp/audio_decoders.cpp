@@ -65,8 +65,17 @@
 
 #include <algorithm>
 #include <ctype.h>
+#include <map>
+#include <memory>
 #include <time.h>
 #include <string.h>
+#include <vector>
+
+extern "C" {
+#include "rs/fec.h"
+}
+
+using namespace std;
 
 #define AUDIO_DECODER_MAGIC 0x12ab332bu
 
@@ -113,6 +122,10 @@ struct state_audio_decoder {
 
         audio_playback_ctl_t audio_playback_ctl_func;
         void *audio_playback_state;
+
+        fec_t *fec = nullptr;           ///< RS code of the last recovered group
+        long long fec_recovered = 0;    ///< packets
+        long long fec_unrecoverable = 0; ///< groups
 };
 
 static int validate_mapping(struct channel_map *map);
@@ -325,6 +338,9 @@ void audio_decoder_destroy(void *state)
         free(s->channel_map.sizes);
         packet_counter_destroy(s->packet_counter);
         audio_codec_done(s->audio_decompress);
+        if (s->fec) {
+                fec_free(s->fec);
+        }
 
         if (s->dec_funcs) {
                 s->dec_funcs->destroy(s->decrypt);
@@ -373,6 +389,164 @@ static void *adec_compute_and_print_stats(void *arg) {
 }
 
 
+namespace {
+struct audio_fec_group {
+        int k, m, count;
+        int pt;
+        bool mbit;
+        int ss;
+        map<int, rtp_packet *> parity; ///< parity index -> packet
+};
+}
+
+/**
+ * Recovers audio packets of the group lost in transmission, see
+ * audio_fec_payload_hdr_t.
+ * @param received packets of the frame indexed by sequence number
+ * @param recovered storage for the recovered packets
+ */
+static void audio_fec_recover_group(struct state_audio_decoder *decoder, uint16_t first_seq,
+                audio_fec_group const & g, map<uint16_t, rtp_packet *> &received,
+                vector<unique_ptr<char[]>> &recovered)
+{
+        int missing = 0;
+        for (int i = 0; i < g.count; ++i) {
+                if (received.find(first_seq + i) == received.end()) {
+                        missing += 1;
+                }
+        }
+        if (missing == 0) {
+                return;
+        }
+        if (missing > (int) g.parity.size()) {
+                decoder->fec_unrecoverable += 1;
+                return;
+        }
+
+        if (!decoder->fec || decoder->fec->k != g.k || decoder->fec->n != g.k + g.m) {
+                if (decoder->fec) {
+                        fec_free(decoder->fec);
+                }
+                decoder->fec = fec_new(g.k, g.k + g.m);
+        }
+
+        vector<unsigned char> symbols((g.k + missing) * g.ss);
+        vector<const gf *> in(g.k);
+        vector<gf *> out(missing);
+        vector<unsigned int> index(g.k);
+        auto parity = g.parity.begin();
+        int missing_idx = 0;
+        for (int i = 0; i < g.k; ++i) {
+                unsigned char *sym = symbols.data() + i * g.ss;
+                auto it = i < g.count ? received.find(first_seq + i) : received.end();
+                if (i >= g.count) { // padding, all zero
+                        in[i] = sym;
+                        index[i] = i;
+                } else if (it != received.end()) {
+                        rtp_packet *pkt = it->second;
+                        if (pkt->data_len + sizeof(uint16_t) > (unsigned) g.ss) {
+                                return;
+                        }
+                        uint16_t len = htons(pkt->data_len);
+                        memcpy(sym, &len, sizeof len);
+                        memcpy(sym + sizeof len, pkt->data, pkt->data_len);
+                        in[i] = sym;
+                        index[i] = i;
+                } else {
+                        in[i] = (const gf *) parity->second->data + sizeof(audio_fec_payload_hdr_t);
+                        index[i] = g.k + parity->first;
+                        ++parity;
+                        out[missing_idx] = symbols.data() + (g.k + missing_idx) * g.ss;
+                        missing_idx += 1;
+                }
+        }
+        fec_decode(decoder->fec, in.data(), out.data(), index.data(), g.ss);
+
+        missing_idx = 0;
+        for (int i = 0; i < g.count; ++i) {
+                uint16_t seq = first_seq + i;
+                if (received.find(seq) != received.end()) {
+                        continue;
+                }
+                unsigned char *sym = out[missing_idx++];
+                uint16_t len;
+                memcpy(&len, sym, sizeof len);
+                len = ntohs(len);
+                if (len < sizeof(audio_payload_hdr_t) || len + sizeof len > (unsigned) g.ss) {
+                        decoder->fec_unrecoverable += 1;
+                        return;
+                }
+                unique_ptr<char[]> buf(new char[sizeof(rtp_packet) + len]());
+                rtp_packet *pkt = (rtp_packet *)(void *) buf.get();
+                pkt->data = buf.get() + sizeof(rtp_packet);
+                pkt->data_len = len;
+                memcpy(pkt->data, sym + sizeof len, len);
+                pkt->pt = g.pt;
+                pkt->m = i == g.count - 1 && g.mbit;
+                pkt->seq = seq;
+                received[seq] = pkt;
+                recovered.push_back(move(buf));
+        }
+        decoder->fec_recovered += missing;
+}
+
+/**
+ * Returns audio packets of the frame in descending sequence number order (as
+ * passed by pbuf, the m-bit packet first) with packets lost in transmission
+ * recovered from RS parity if possible.
+ */
+static vector<rtp_packet *> audio_fec_recover(struct state_audio_decoder *decoder, struct coded_data *cdata,
+                vector<unique_ptr<char[]>> &recovered)
+{
+        map<uint16_t, rtp_packet *> received;
+        map<uint16_t, audio_fec_group> groups; ///< indexed by first protected seq
+        for ( ; cdata != NULL; cdata = cdata->nxt) {
+                rtp_packet *pkt = cdata->data;
+                if (pkt->pt != PT_AUDIO_RS) {
+                        received[pkt->seq] = pkt;
+                        continue;
+                }
+                if (pkt->data_len < (int) sizeof(audio_fec_payload_hdr_t)) {
+                        continue;
+                }
+                uint32_t *hdr = (uint32_t *)(void *) pkt->data;
+                uint32_t w0 = ntohl(hdr[0]);
+                uint32_t w1 = ntohl(hdr[1]);
+                int k = w0 >> 24;
+                int m = (w0 >> 16) & 0xff;
+                int count = (w0 >> 8) & 0xff;
+                int idx = w0 & 0xff;
+                int ss = w1 & 0xffffff;
+                if (k == 0 || m == 0 || count == 0 || count > k || idx >= m ||
+                                pkt->data_len != (int) sizeof(audio_fec_payload_hdr_t) + ss) {
+                        continue;
+                }
+                audio_fec_group &g = groups[(uint16_t) (pkt->seq - idx - count)];
+                g.k = k;
+                g.m = m;
+                g.count = count;
+                g.pt = w1 >> 25;
+                g.mbit = (w1 >> 24) & 1;
+                g.ss = ss;
+                g.parity[idx] = pkt;
+        }
+
+        for (auto const & g : groups) {
+                audio_fec_recover_group(decoder, g.first, g.second, received, recovered);
+        }
+
+        vector<rtp_packet *> packets;
+        packets.reserve(received.size());
+        for (auto const & p : received) {
+                packets.push_back(p.second);
+        }
+        // descending seqno order, respecting wrap-around
+        sort(packets.begin(), packets.end(), [](rtp_packet *a, rtp_packet *b) {
+                        return (int16_t) (a->seq - b->seq) > 0;
+                        });
+        return packets;
+}
+
 int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_stats *)
 {
         struct pbuf_audio_data *s = (struct pbuf_audio_data *) pbuf_data;
@@ -381,13 +555,17 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
         int input_channels = 0;
         int output_channels = 0;
         int bps, sample_rate, channel;
-        bool first = true;
 
         if(!cdata) {
                 return FALSE;
         }
 
-        if (!cdata->data->m) {
+        memcpy(&s->source, ((char *) cdata->data) + RTP_MAX_PACKET_LEN, sizeof(struct sockaddr_storage));
+
+        vector<unique_ptr<char[]>> recovered;
+        vector<rtp_packet *> packets = audio_fec_recover(decoder, cdata, recovered);
+
+        if (packets.empty() || !packets[0]->m) {
                 // skip frame without m-bit, we cannot determine number of channels
                 // (it is maximal substream number + 1 in packet with m-bit)
                 return FALSE;
@@ -399,11 +577,11 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                         decoder->saved_desc.bps,
                         decoder->saved_desc.sample_rate);
 
-        while (cdata != NULL) {
+        for (rtp_packet *pkt : packets) {
                 char *data;
                 // for definition see rtp_callbacks.h
-                uint32_t *audio_hdr = (uint32_t *)(void *) cdata->data->data;
-                const int pt = cdata->data->pt;
+                uint32_t *audio_hdr = (uint32_t *)(void *) pkt->data;
+                const int pt = pkt->pt;
                 enum openssl_mode crypto_mode;
 
                 if(pt == PT_ENCRYPT_AUDIO) {
@@ -424,21 +602,21 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 }
 
                 unsigned int length;
-                char plaintext[cdata->data->data_len]; // plaintext will be actually shorter
+                char plaintext[pkt->data_len]; // plaintext will be actually shorter
                 if(pt == PT_AUDIO) {
-                        length = cdata->data->data_len - sizeof(audio_payload_hdr_t);
-                        data = cdata->data->data + sizeof(audio_payload_hdr_t);
+                        length = pkt->data_len - sizeof(audio_payload_hdr_t);
+                        data = pkt->data + sizeof(audio_payload_hdr_t);
                 } else {
                         assert(pt == PT_ENCRYPT_AUDIO);
-                        uint32_t encryption_hdr = ntohl(*(uint32_t *) (cdata->data->data + sizeof(audio_payload_hdr_t)));
+                        uint32_t encryption_hdr = ntohl(*(uint32_t *) (pkt->data + sizeof(audio_payload_hdr_t)));
                         crypto_mode = (enum openssl_mode) (encryption_hdr >> 24);
                         if (crypto_mode == MODE_AES128_NONE || crypto_mode > MODE_AES128_MAX) {
                                 log_msg(LOG_LEVEL_WARNING, "Unknown cipher mode: %d\n", (int) crypto_mode);
                                 return FALSE;
                         }
-                        char *ciphertext = cdata->data->data + sizeof(crypto_payload_hdr_t) +
+                        char *ciphertext = pkt->data + sizeof(crypto_payload_hdr_t) +
                                 sizeof(audio_payload_hdr_t);
-                        int ciphertext_len = cdata->data->data_len - sizeof(audio_payload_hdr_t) -
+                        int ciphertext_len = pkt->data_len - sizeof(audio_payload_hdr_t) -
                                 sizeof(crypto_payload_hdr_t);
 
                         if((length = decoder->dec_funcs->decrypt(decoder->decrypt,
@@ -453,7 +631,7 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
 
                 /* we receive last channel first (with m bit, last packet) */
                 /* thus can be set only with m-bit packet */
-                if(cdata->data->m) {
+                if(pkt->m) {
                         input_channels = ((ntohl(audio_hdr[0]) >> 22) & 0x3ff) + 1;
                 }
 
@@ -528,11 +706,6 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 unsigned int buffer_len = ntohl(audio_hdr[2]);
                 //fprintf(stderr, "%d-%d-%d ", length, bufnum, channel);
 
-                if (first) {
-                        memcpy(&s->source, ((char *) cdata->data) + RTP_MAX_PACKET_LEN, sizeof(struct sockaddr_storage));
-                        first = false;
-                }
-
                 received_frame.replace(channel, offset, data, length);
 
                 packet_counter_register_packet(decoder->packet_counter, channel, bufnum, offset, length);
@@ -541,8 +714,6 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 /// @todo do we really want to scale to expected buffer length even if some frames are missing
                 /// at the end of the buffer
                 received_frame.resize(channel, buffer_len);
-                
-                cdata = cdata->nxt;
         }
 
         audio_frame2 decompressed = audio_codec_decompress(decoder->audio_decompress, &received_frame);
@@ -617,6 +788,11 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 d->bytes_expected = packet_counter_get_all_bytes(decoder->packet_counter);
 
                 task_run_async_detached(adec_compute_and_print_stats, d);
+                if (decoder->fec_recovered > 0 || decoder->fec_unrecoverable > 0) {
+                        log_msg(LOG_LEVEL_INFO, "[Audio decoder] FEC recovered %lld packets, "
+                                        "%lld groups unrecoverable (cumulative).\n",
+                                        decoder->fec_recovered, decoder->fec_unrecoverable);
+                }
 
                 decoder->t0 = t;
                 packet_counter_clear(decoder->packet_counter);
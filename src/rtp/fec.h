@@ -41,15 +41,16 @@
 #include "types.h"
 
 #ifdef __cplusplus
-#include <map>
 #include <memory>
 
+#include "utils/received_ranges.h"
+
 struct video_frame;
 
 struct fec {
         virtual std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame>) = 0;
         virtual void decode(const char *in, int in_len, char **out, int *len,
-                        const std::map<int, int> &) = 0;
+                        const received_ranges &) = 0;
         virtual ~fec() {}
 
         static fec *create_from_config(const char *str);
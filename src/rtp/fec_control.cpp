@@ -0,0 +1,191 @@
+/**
+ * @file   rtp/fec_control.cpp
+ * @brief  Chooses FEC redundancy according to loss reported by receivers.
+ *
+ * Loss of every feedback interval is computed from the cumulative counters of
+ * consecutive RTCP report blocks of a receiver (more precise than the 8-bit
+ * fraction lost). Receiver reports do not carry burst lengths, so bursts are
+ * accounted for by protecting against the worst interval loss seen during
+ * last few seconds rather than the average. This also keeps the redundancy
+ * up for a while after the loss stops.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include "debug.h"
+#include "rtp/fec_control.h"
+
+#define PEAK_WINDOW_SEC 5            ///< worst loss of this period is protected against
+#define RECEIVER_TIMEOUT_SEC 10      ///< receivers silent for longer are forgotten
+#define MIN_INTERVAL_PACKETS 100     ///< shorter feedback intervals are merged with the following one
+#define RS_LOSS_MARGIN 2.0           ///< parity ratio relative to loss ratio
+#define MULT_RESIDUAL_LOSS 0.0001    ///< target loss of a packet sent multiple times
+#define MOD_NAME "[FEC control] "
+
+using namespace std;
+using clk = chrono::steady_clock;
+
+namespace {
+struct fc_receiver {
+        clk::time_point last_report;
+        uint32_t last_seq = 0;
+        int32_t total_lost = 0;
+        deque<pair<clk::time_point, double>> losses; ///< loss ratio of recent intervals
+};
+}
+
+struct fec_control {
+        mutex lock;
+        map<uint32_t, fc_receiver> receivers;
+};
+
+/// Sign-extends the 24-bit cumulative number of packets lost.
+static int32_t total_lost_value(uint32_t total_lost)
+{
+        return (int32_t) (total_lost << 8) >> 8;
+}
+
+struct fec_control *fec_control_init(void)
+{
+        return new fec_control();
+}
+
+void fec_control_done(struct fec_control *fc)
+{
+        delete fc;
+}
+
+void fec_control_report(struct fec_control *fc, uint32_t reporter_ssrc, const rtcp_rr *rr)
+{
+        lock_guard<mutex> lk(fc->lock);
+        auto now = clk::now();
+        auto it = fc->receivers.find(reporter_ssrc);
+        int32_t total_lost = total_lost_value(rr->total_lost);
+        if (it == fc->receivers.end()) {
+                fc_receiver &r = fc->receivers[reporter_ssrc];
+                r.last_report = now;
+                r.last_seq = rr->last_seq;
+                r.total_lost = total_lost;
+                return;
+        }
+        fc_receiver &r = it->second;
+        r.last_report = now;
+
+        int32_t expected = rr->last_seq - r.last_seq;
+        if (expected < 0) { // sender restarted or reordered report
+                r.last_seq = rr->last_seq;
+                r.total_lost = total_lost;
+                return;
+        }
+        if (expected < MIN_INTERVAL_PACKETS) {
+                return;
+        }
+        int32_t lost = min(max(total_lost - r.total_lost, 0), expected);
+        r.last_seq = rr->last_seq;
+        r.total_lost = total_lost;
+
+        r.losses.emplace_back(now, (double) lost / expected);
+        while (now - r.losses.front().first > chrono::seconds(PEAK_WINDOW_SEC)) {
+                r.losses.pop_front();
+        }
+
+        debug_msg(MOD_NAME "receiver 0x%08x: interval loss %f\n", reporter_ssrc, (double) lost / expected);
+}
+
+double fec_control_get_loss(struct fec_control *fc)
+{
+        lock_guard<mutex> lk(fc->lock);
+        auto now = clk::now();
+        double loss = -1.0;
+        for (auto it = fc->receivers.begin(); it != fc->receivers.end(); ) {
+                fc_receiver &r = it->second;
+                if (now - r.last_report > chrono::seconds(RECEIVER_TIMEOUT_SEC)) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "No feedback from receiver 0x%08x, removing.\n", it->first);
+                        it = fc->receivers.erase(it);
+                        continue;
+                }
+                for (auto const & l : r.losses) {
+                        if (now - l.first <= chrono::seconds(PEAK_WINDOW_SEC)) {
+                                loss = max(loss, l.second);
+                        }
+                }
+                ++it;
+        }
+        return loss;
+}
+
+int fec_control_rs_parity(struct fec_control *fc, int k, int max_m, int symbol_packets)
+{
+        double loss = fec_control_get_loss(fc);
+        if (loss < 0.0) { // no feedback, keep full protection
+                return max_m;
+        }
+        if (loss == 0.0) { // keep single parity symbol for sporadic losses
+                return min(1, max_m);
+        }
+        loss = 1.0 - pow(1.0 - loss, max(symbol_packets, 1));
+        loss = min(loss, 0.5);
+        // m / (k + m) = margin * loss
+        int m = ceil(k * RS_LOSS_MARGIN * loss / max(1.0 - RS_LOSS_MARGIN * loss, 0.01));
+        return min(max(m, 1), max_m);
+}
+
+int fec_control_mult(struct fec_control *fc, int max_mult)
+{
+        double loss = fec_control_get_loss(fc);
+        if (loss < 0.0) {
+                return max_mult;
+        }
+        if (loss == 0.0) {
+                return 1;
+        }
+        if (loss >= 1.0) {
+                return max_mult;
+        }
+        // loss^mult <= MULT_RESIDUAL_LOSS
+        int mult = ceil(log(MULT_RESIDUAL_LOSS) / log(loss));
+        return min(max(mult, 1), max_mult);
+}
@@ -0,0 +1,77 @@
+/**
+ * @file   rtp/fec_control.h
+ * @brief  Chooses FEC redundancy according to loss reported by receivers.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_FEC_CONTROL_H_
+#define RTP_FEC_CONTROL_H_
+
+#include "rtp/rtp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct fec_control;
+
+struct fec_control *fec_control_init(void);
+void fec_control_done(struct fec_control *fc);
+
+/**
+ * Processes a report block from a receiver. May be called from any thread.
+ */
+void fec_control_report(struct fec_control *fc, uint32_t reporter_ssrc, const rtcp_rr *rr);
+/**
+ * @returns packet loss ratio to protect against (worst receiver) or -1.0 if
+ * there has been no feedback yet
+ */
+double fec_control_get_loss(struct fec_control *fc);
+/**
+ * @param symbol_packets number of packets a symbol is split to (a symbol is
+ *                       lost if any of them is lost)
+ * @returns number of RS parity symbols for k data symbols, at least 1 (if
+ * max_m > 0) so that sporadic losses are still repaired
+ */
+int fec_control_rs_parity(struct fec_control *fc, int k, int max_m, int symbol_packets);
+/**
+ * @returns number of copies of every packet, in [1, max_mult]
+ */
+int fec_control_mult(struct fec_control *fc, int max_mult);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_FEC_CONTROL_H_
@@ -0,0 +1,320 @@
+/**
+ * @file   rtp/fec_interleaved.cpp
+ * @brief  Interleaved (cross-frame) XOR parity of video packets.
+ *
+ * Sent packets are arranged row by row into a block of columns x rows
+ * packets and one XOR parity packet is sent for every column, so a burst of
+ * up to columns consecutive packets is recoverable. Since the block is not
+ * bound to a frame, small (compressed) frames are protected together with
+ * their neighbours without increasing per-frame overhead. The block is closed
+ * after at most max_frames frames, which bounds the extra latency - the
+ * receiver must hold frames (playout delay) for that long to benefit.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "debug.h"
+#include "rtp/fec_interleaved.h"
+#include "rtp/net_udp.h"
+#include "rtp/rtp_callback.h"
+
+#define SYMBOL_HDR_LEN 8            ///< payload length, m-bit and PT, reserved byte, RTP timestamp
+#define MAX_SYMBOL_LEN (SYMBOL_HDR_LEN + RTP_MAX_MTU)
+#define MAX_BLOCK_PACKETS 1024      ///< columns * rows, must be covered by receiver history
+#define RX_HISTORY 2048             ///< packets remembered by receiver, power of two
+#define DEFAULT_MAX_FRAMES 4
+#define MOD_NAME "[Interleaved FEC] "
+
+using namespace std;
+
+struct fec_interleaved_tx {
+        int columns;
+        int rows;
+        int max_frames;
+
+        mutex lock;
+        bool open = false;          ///< block has at least one packet
+        uint16_t first_seq = 0;
+        int count = 0;              ///< packets in block
+        int frames = 0;             ///< frames ended since the block was opened
+        vector<vector<unsigned char>> parity; ///< per column
+        vector<int> symbol_len;               ///< per column
+        vector<uint32_t> hdrs;                ///< payload headers of parity packets
+};
+
+struct fec_interleaved_rx {
+        struct packet {
+                bool valid = false;
+                uint16_t seq;
+                vector<unsigned char> symbol;
+        };
+        vector<packet> history = vector<packet>(RX_HISTORY);
+};
+
+static void xor_into(unsigned char *dst, const unsigned char *src, int len)
+{
+        for (int i = 0; i < len; ++i) {
+                dst[i] ^= src[i];
+        }
+}
+
+struct fec_interleaved_tx *fec_interleaved_tx_init(const char *cfg)
+{
+        int columns = 0, rows = 0, max_frames = DEFAULT_MAX_FRAMES;
+        if (!cfg || sscanf(cfg, "%d:%d:%d", &columns, &rows, &max_frames) < 2 ||
+                        columns < 1 || columns > 255 || rows < 1 ||
+                        columns * rows > MAX_BLOCK_PACKETS || max_frames < 1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Usage: -f interleaved:<columns>:<rows>[:<max_frames>]\n"
+                                "\tcolumns - longest recoverable burst (packets), at most 255\n"
+                                "\trows - packets per parity packet, columns * rows <= %d\n"
+                                "\tmax_frames - maximal number of frames a block spans (default %d)\n",
+                                MAX_BLOCK_PACKETS, DEFAULT_MAX_FRAMES);
+                return NULL;
+        }
+
+        auto s = new fec_interleaved_tx();
+        s->columns = columns;
+        s->rows = rows;
+        s->max_frames = max_frames;
+        s->parity.assign(columns, vector<unsigned char>(MAX_SYMBOL_LEN));
+        s->symbol_len.assign(columns, 0);
+        s->hdrs.resize(columns * sizeof(fec_interleaved_payload_hdr_t) / sizeof(uint32_t));
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "%d x %d packets per block (%.1f %% overhead), "
+                        "block spans at most %d frames.\n", columns, rows, 100.0 / rows, max_frames);
+        return s;
+}
+
+void fec_interleaved_tx_done(struct fec_interleaved_tx *s)
+{
+        delete s;
+}
+
+void fec_interleaved_tx_add(struct fec_interleaved_tx *s, uint16_t seq, const char *hdr, int hdr_len,
+                const char *phdr, int phdr_len, const char *data, int data_len)
+{
+        if (hdr_len < 12 || (hdr[1] & 0x7f) == PT_VIDEO_INTERLEAVED) {
+                return;
+        }
+
+        lock_guard<mutex> lk(s->lock);
+        if (s->open && (uint16_t) (s->first_seq + s->count) != seq) {
+                // packet sent by someone else in between, block cannot be described
+                debug_msg(MOD_NAME "Non-consecutive packet, dropping block.\n");
+                for (int i = 0; i < s->columns; ++i) {
+                        memset(s->parity[i].data(), 0, s->symbol_len[i]);
+                        s->symbol_len[i] = 0;
+                }
+                s->open = false;
+        }
+        if (!s->open) {
+                s->open = true;
+                s->first_seq = seq;
+                s->count = 0;
+                s->frames = 0;
+        }
+
+        int len = phdr_len + data_len;
+        unsigned char symbol_hdr[SYMBOL_HDR_LEN] = { (unsigned char) (len >> 8), (unsigned char) len,
+                (unsigned char) hdr[1], 0 };
+        memcpy(symbol_hdr + 4, hdr + 4, 4); // RTP timestamp, already in network order
+
+        int column = s->count % s->columns;
+        unsigned char *p = s->parity[column].data();
+        xor_into(p, symbol_hdr, SYMBOL_HDR_LEN);
+        xor_into(p + SYMBOL_HDR_LEN, (const unsigned char *) phdr, phdr_len);
+        xor_into(p + SYMBOL_HDR_LEN + phdr_len, (const unsigned char *) data, data_len);
+        s->symbol_len[column] = max(s->symbol_len[column], SYMBOL_HDR_LEN + len);
+        s->count += 1;
+}
+
+static void fec_interleaved_tx_send_block(struct fec_interleaved_tx *s, struct rtp *session, uint32_t ts)
+{
+        for (int i = 0; i < s->columns; ++i) {
+                if (s->symbol_len[i] == 0) {
+                        continue;
+                }
+                uint32_t *hdr = &s->hdrs[i * sizeof(fec_interleaved_payload_hdr_t) / sizeof(uint32_t)];
+                hdr[0] = htonl(s->first_seq << 16 | s->count);
+                hdr[1] = htonl(s->columns << 24 | i << 16 | s->symbol_len[i]);
+                rtp_send_data_hdr(session, ts, PT_VIDEO_INTERLEAVED, 0, 0, 0,
+                                (char *) hdr, sizeof(fec_interleaved_payload_hdr_t),
+                                (char *) s->parity[i].data(), s->symbol_len[i], 0, 0, 0);
+        }
+        // packets may be only queued (see rtp_async_start()), buffers are reused
+        rtp_async_flush(session);
+        for (int i = 0; i < s->columns; ++i) {
+                memset(s->parity[i].data(), 0, s->symbol_len[i]);
+                s->symbol_len[i] = 0;
+        }
+        s->open = false;
+}
+
+void fec_interleaved_tx_flush(struct fec_interleaved_tx *s, struct rtp *session, uint32_t ts)
+{
+        lock_guard<mutex> lk(s->lock);
+        if (s->open && s->count == s->columns * s->rows) {
+                fec_interleaved_tx_send_block(s, session, ts);
+        }
+}
+
+void fec_interleaved_tx_frame_done(struct fec_interleaved_tx *s, struct rtp *session, uint32_t ts)
+{
+        lock_guard<mutex> lk(s->lock);
+        if (s->open && ++s->frames >= s->max_frames) {
+                fec_interleaved_tx_send_block(s, session, ts);
+        }
+}
+
+int fec_interleaved_overhead(void)
+{
+        return sizeof(fec_interleaved_payload_hdr_t) + SYMBOL_HDR_LEN;
+}
+
+struct fec_interleaved_rx *fec_interleaved_rx_init(void)
+{
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Receiving interleaved parity, recovery enabled.\n");
+        return new fec_interleaved_rx();
+}
+
+void fec_interleaved_rx_done(struct fec_interleaved_rx *s)
+{
+        delete s;
+}
+
+void fec_interleaved_rx_store(struct fec_interleaved_rx *s, const rtp_packet *pkt)
+{
+        if (pkt->pt == PT_VIDEO_INTERLEAVED) {
+                return;
+        }
+        auto &p = s->history[pkt->seq & (RX_HISTORY - 1)];
+        p.valid = true;
+        p.seq = pkt->seq;
+        p.symbol.resize(SYMBOL_HDR_LEN + pkt->data_len);
+        unsigned char *sym = p.symbol.data();
+        sym[0] = pkt->data_len >> 8;
+        sym[1] = pkt->data_len;
+        sym[2] = pkt->m << 7 | pkt->pt;
+        sym[3] = 0;
+        uint32_t ts = htonl(pkt->ts);
+        memcpy(sym + 4, &ts, sizeof ts);
+        memcpy(sym + SYMBOL_HDR_LEN, pkt->data, pkt->data_len);
+}
+
+rtp_packet *fec_interleaved_rx_recover(struct fec_interleaved_rx *s, const rtp_packet *parity)
+{
+        if (parity->data_len < (int) sizeof(fec_interleaved_payload_hdr_t)) {
+                return NULL;
+        }
+        uint32_t w0 = ntohl(((uint32_t *)(void *) parity->data)[0]);
+        uint32_t w1 = ntohl(((uint32_t *)(void *) parity->data)[1]);
+        uint16_t first_seq = w0 >> 16;
+        int count = w0 & 0xffff;
+        int columns = w1 >> 24;
+        int column = (w1 >> 16) & 0xff;
+        int symbol_len = w1 & 0xffff;
+        if (columns == 0 || column >= columns || count > MAX_BLOCK_PACKETS ||
+                        symbol_len < SYMBOL_HDR_LEN || symbol_len > MAX_SYMBOL_LEN ||
+                        parity->data_len != (int) sizeof(fec_interleaved_payload_hdr_t) + symbol_len) {
+                return NULL;
+        }
+
+        int missing = -1;
+        for (int i = column; i < count; i += columns) {
+                uint16_t seq = first_seq + i;
+                auto const & p = s->history[seq & (RX_HISTORY - 1)];
+                if (!p.valid || p.seq != seq) {
+                        if (missing >= 0) {
+                                return NULL; // more than one packet missing
+                        }
+                        missing = seq;
+                }
+        }
+        if (missing < 0) {
+                return NULL;
+        }
+
+        unsigned char sym[MAX_SYMBOL_LEN];
+        memcpy(sym, parity->data + sizeof(fec_interleaved_payload_hdr_t), symbol_len);
+        for (int i = column; i < count; i += columns) {
+                uint16_t seq = first_seq + i;
+                if (seq == missing) {
+                        continue;
+                }
+                auto const & p = s->history[seq & (RX_HISTORY - 1)];
+                if ((int) p.symbol.size() > symbol_len) {
+                        return NULL;
+                }
+                xor_into(sym, p.symbol.data(), p.symbol.size());
+        }
+
+        int len = sym[0] << 8 | sym[1];
+        if (SYMBOL_HDR_LEN + len > symbol_len) {
+                return NULL;
+        }
+
+        rtp_packet *pkt = (rtp_packet *)(void *) udp_packet_alloc();
+        char *buffer = (char *) pkt + RTP_PACKET_HEADER_SIZE;
+        memset(buffer, 0, 12);
+        pkt->v = 2;
+        pkt->m = sym[2] >> 7;
+        pkt->pt = sym[2] & 0x7f;
+        pkt->seq = missing;
+        uint32_t ts;
+        memcpy(&ts, sym + 4, sizeof ts);
+        pkt->ts = ntohl(ts);
+        pkt->ssrc = parity->ssrc;
+        pkt->csrc = NULL;
+        pkt->extn = NULL;
+        pkt->extn_len = 0;
+        pkt->extn_type = 0;
+        pkt->data = buffer + 12;
+        pkt->data_len = len;
+        memcpy(pkt->data, sym + SYMBOL_HDR_LEN, len);
+        memcpy((char *) pkt + RTP_MAX_PACKET_LEN, (const char *) parity + RTP_MAX_PACKET_LEN,
+                        sizeof(struct sockaddr_storage));
+        return pkt;
+}
+
@@ -0,0 +1,93 @@
+/**
+ * @file   rtp/fec_interleaved.h
+ * @brief  Interleaved (cross-frame) XOR parity of video packets.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef RTP_FEC_INTERLEAVED_H_
+#define RTP_FEC_INTERLEAVED_H_
+
+#include "rtp/rtp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct fec_interleaved_tx;
+struct fec_interleaved_rx;
+
+/**
+ * @param cfg <columns>:<rows>[:<max_frames>]
+ * @returns NULL if cfg is invalid
+ */
+struct fec_interleaved_tx *fec_interleaved_tx_init(const char *cfg);
+void fec_interleaved_tx_done(struct fec_interleaved_tx *s);
+/**
+ * Adds a packet to the current block, to be called from the RTP send hook.
+ */
+void fec_interleaved_tx_add(struct fec_interleaved_tx *s, uint16_t seq, const char *hdr, int hdr_len,
+                const char *phdr, int phdr_len, const char *data, int data_len);
+/**
+ * Sends parity of the block if it is complete. Must be called after every
+ * sent packet so that the next block starts right after the parity packets.
+ */
+void fec_interleaved_tx_flush(struct fec_interleaved_tx *s, struct rtp *session, uint32_t ts);
+/**
+ * Ends a frame - the current block is closed if it spans the maximal number
+ * of frames and its parity is sent.
+ */
+void fec_interleaved_tx_frame_done(struct fec_interleaved_tx *s, struct rtp *session, uint32_t ts);
+/// @returns bytes that parity packet header adds to the largest protected payload
+int fec_interleaved_overhead(void);
+
+struct fec_interleaved_rx *fec_interleaved_rx_init(void);
+void fec_interleaved_rx_done(struct fec_interleaved_rx *s);
+/**
+ * Remembers a received (or recovered) packet for recovery of its neighbours.
+ */
+void fec_interleaved_rx_store(struct fec_interleaved_rx *s, const rtp_packet *pkt);
+/**
+ * Recovers the packet missing in the column protected by parity packet, if
+ * it is the only one missing.
+ * @returns recovered packet (allocated as if received) or NULL
+ */
+rtp_packet *fec_interleaved_rx_recover(struct fec_interleaved_rx *s, const rtp_packet *parity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_FEC_INTERLEAVED_H_
+
@@ -67,6 +67,7 @@
 #include <sys/types.h>
 
 #include <limits>
+#include <thread>
 
 #include "host.h"
 
@@ -214,6 +215,8 @@ void ldgm::set_params(unsigned int k, unsigned int m, unsigned int c, unsigned i
 
 ADD_TO_PARAM(ldgm_device, "ldgm-device", "* ldgm-device={CPU|GPU}\n"
                 "  specify whether use CPU or GPU for LDGM\n");
+ADD_TO_PARAM(ldgm_threads, "ldgm-threads", "* ldgm-threads=<n>\n"
+                "  number of threads used for CPU LDGM encoding (default number of CPU cores)\n");
 
 void ldgm::init(unsigned int k, unsigned int m, unsigned int c, unsigned int seed)
 {
@@ -236,7 +239,13 @@ void ldgm::init(unsigned int k, unsigned int m, unsigned int c, unsigned int see
 
                 }
         } else {
-                m_coding_session = unique_ptr<LDGM_session>(new LDGM_session_cpu());
+                LDGM_session_cpu *session = new LDGM_session_cpu();
+                int threads = thread::hardware_concurrency();
+                if (get_commandline_param("ldgm-threads")) {
+                        threads = atoi(get_commandline_param("ldgm-threads"));
+                }
+                session->set_threads(threads);
+                m_coding_session = unique_ptr<LDGM_session>(session);
         }
 
         set_params(k, m, c, seed);
@@ -247,9 +256,11 @@ ldgm::ldgm(unsigned int k, unsigned int m, unsigned int c, unsigned int seed)
         init(k, m, c, seed);
 }
 
-void ldgm::decode(const char *frame, int size, char **out, int *out_size, const map<int, int> &packets) {
+void ldgm::decode(const char *frame, int size, char **out, int *out_size, const received_ranges &packets) {
         char *decoded;
-        decoded = m_coding_session->decode_frame((char *) frame, size, out_size, packets);
+        auto received = packets.intervals();
+        std::vector<std::pair<int, int>> valid_data(received.begin(), received.end());
+        decoded = m_coding_session->decode_frame((char *) frame, size, out_size, valid_data);
         *out = decoded;
 }
 
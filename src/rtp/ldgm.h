@@ -39,7 +39,6 @@
 
 #define LDGM_MAXIMAL_SIZE_RATIO 1
 
-#include <map>
 #include <memory>
 
 #include "fec.h"
@@ -58,7 +57,7 @@ struct ldgm : public fec{
         void set_params(unsigned int k, unsigned int m, unsigned int c, unsigned int seed);
         std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame>);
         void decode(const char *in, int in_len, char **out, int *len,
-                const std::map<int, int> &);
+                const received_ranges &);
 
 private:
         void init(unsigned int k, unsigned int m, unsigned int c, unsigned int seed = DEFAULT_LDGM_SEED);
@@ -0,0 +1,231 @@
+/**
+ * @file   rtp/line_decoder.cpp
+ * @brief  Pixel format conversion of received uncompressed video packets.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "rtp/line_decoder.h"
+#include "utils/received_ranges.h"
+#include "utils/worker.h"
+#include "video_frame.h"
+
+#define MAX_LINE_DECODE_THREADS 64
+
+using namespace std;
+
+bool line_decode_packet(const struct line_decoder *line_decoder, struct tile *tile,
+                uint32_t data_pos, const unsigned char *source, int len)
+{
+        /* MAGIC, don't touch it, you definitely break it
+         *  *source* is data from network, *destination* is frame buffer
+         */
+
+        /* compute Y pos in source frame and convert it to
+         * byte offset in the destination frame
+         */
+        int y = (data_pos / line_decoder->src_linesize) * line_decoder->dst_pitch;
+
+        /* compute X pos in source frame */
+        int s_x = data_pos % line_decoder->src_linesize;
+
+        /* convert X pos from source frame into the destination frame.
+         * it is byte offset from the beginning of a line.
+         */
+        int d_x = ((int)((s_x) / line_decoder->src_bpp)) *
+                line_decoder->dst_bpp;
+
+        /* copy whole packet that can span several lines.
+         * we need to clip data (v210 case) or center data (RGBA, R10k cases)
+         */
+        while (len > 0) {
+                /* len id payload length in source BPP
+                 * decoder needs len in destination BPP, so convert it
+                 */
+                int l = ((int)(len / line_decoder->src_bpp)) * line_decoder->dst_bpp;
+
+                /* do not copy multiple lines, we need to
+                 * copy (& clip, center) line by line
+                 */
+                if (l + d_x > (int) line_decoder->dst_linesize) {
+                        l = line_decoder->dst_linesize - d_x;
+                }
+
+                /* compute byte offset in destination frame */
+                uint32_t offset = y + d_x;
+
+                /* watch the SEGV */
+                if (l + line_decoder->base_offset + offset <= tile->data_len) {
+                        /*decode frame:
+                         * we have offset for destination
+                         * we update source contiguously
+                         * we pass {r,g,b}shifts */
+                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
+                                        line_decoder->shifts[0], line_decoder->shifts[1],
+                                        line_decoder->shifts[2]);
+                        /* we decoded one line (or a part of one line) to the end of the line
+                         * so decrease *source* len by 1 line (or that part of the line */
+                        len -= line_decoder->src_linesize - s_x;
+                        /* jump in source by the same amount */
+                        source += line_decoder->src_linesize - s_x;
+                } else {
+                        return false;
+                }
+                /* each new line continues from the beginning */
+                d_x = 0;        /* next line from beginning */
+                s_x = 0;
+                y += line_decoder->dst_pitch;  /* next line */
+        }
+
+        return true;
+}
+
+namespace {
+struct line_decode_task {
+        const struct line_decode_pkt *pkts;
+        size_t count;
+        int failed;
+};
+}
+
+static void *line_decode_task_callback(void *arg)
+{
+        struct line_decode_task *task = (struct line_decode_task *) arg;
+        for (size_t i = 0; i < task->count; ++i) {
+                const struct line_decode_pkt *p = &task->pkts[i];
+                if (!line_decode_packet(p->line_decoder, p->tile, p->data_pos, p->data, p->len)) {
+                        task->failed += 1;
+                }
+        }
+        return NULL;
+}
+
+int line_decode_packets(const struct line_decode_pkt *pkts, size_t count, int threads)
+{
+        threads = max(1, min<int>({threads, MAX_LINE_DECODE_THREADS, (int) count}));
+
+        struct line_decode_task tasks[MAX_LINE_DECODE_THREADS];
+        task_result_handle_t handles[MAX_LINE_DECODE_THREADS];
+        size_t start = 0;
+        for (int i = 0; i < threads; ++i) {
+                size_t end = count * (i + 1) / threads;
+                tasks[i] = line_decode_task{pkts + start, end - start, 0};
+                start = end;
+        }
+
+        // the calling thread takes the first part itself
+        for (int i = 1; i < threads; ++i) {
+                handles[i] = task_run_async(line_decode_task_callback, &tasks[i]);
+        }
+        line_decode_task_callback(&tasks[0]);
+        int failed = tasks[0].failed;
+        for (int i = 1; i < threads; ++i) {
+                wait_task(handles[i]);
+                failed += tasks[i].failed;
+        }
+
+        return failed;
+}
+
+
+/**
+ * Copies bytes of the destination lines that correspond to source range
+ * [start, end) from src to dst (both with the layout of the tile).
+ * @returns number of touched lines
+ */
+static int line_copy_range(const struct line_decoder *line_decoder, char *dst, const char *src,
+                size_t data_len, int start, int end)
+{
+        int src_linesize = line_decoder->src_linesize;
+        int lines = 0;
+        while (start < end) {
+                int line = start / src_linesize;
+                int s_x0 = start - line * src_linesize;
+                int s_x1 = min(end - line * src_linesize, src_linesize);
+                // round outwards so that partially received pixel blocks are covered as well
+                int d_x0 = ((int) (s_x0 / line_decoder->src_bpp)) * line_decoder->dst_bpp;
+                int d_x1 = ((int) ceil(s_x1 / line_decoder->src_bpp)) * line_decoder->dst_bpp;
+                d_x1 = min<int>(d_x1, line_decoder->dst_linesize);
+                size_t offset = line_decoder->base_offset + (size_t) line * line_decoder->dst_pitch + d_x0;
+                if (d_x1 > d_x0) {
+                        if (offset + (d_x1 - d_x0) > data_len) {
+                                break;
+                        }
+                        memcpy(dst + offset, src + offset, d_x1 - d_x0);
+                        lines += 1;
+                }
+                start = (line + 1) * src_linesize;
+        }
+        return lines;
+}
+
+int line_conceal_missing(const struct line_decoder *line_decoder, struct tile *tile,
+                const char *prev, const received_ranges &received, int src_len)
+{
+        int lines = 0;
+        int pos = 0;
+        for (auto const & i : received.intervals()) {
+                if (i.first > pos) {
+                        lines += line_copy_range(line_decoder, tile->data, prev, tile->data_len,
+                                        pos, min(i.first, src_len));
+                }
+                pos = max(pos, i.first + i.second);
+        }
+        if (pos < src_len) {
+                lines += line_copy_range(line_decoder, tile->data, prev, tile->data_len,
+                                pos, src_len);
+        }
+        return lines;
+}
+
+void line_store_received(const struct line_decoder *line_decoder, const struct tile *tile,
+                char *prev, const received_ranges &received, int src_len)
+{
+        for (auto const & i : received.intervals()) {
+                if (i.first >= src_len) {
+                        break;
+                }
+                line_copy_range(line_decoder, prev, tile->data, tile->data_len,
+                                i.first, min(i.first + i.second, src_len));
+        }
+}
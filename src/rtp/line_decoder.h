@@ -0,0 +1,107 @@
+/**
+ * @file   rtp/line_decoder.h
+ * @brief  Pixel format conversion of received uncompressed video packets.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_LINE_DECODER_H_
+#define RTP_LINE_DECODER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "video_codec.h"
+
+class received_ranges;
+struct tile;
+
+/**
+ * This structure holds data needed to use a linedecoder.
+ */
+struct line_decoder {
+        int                  base_offset;  ///< from the beginning of buffer. Nonzero if decoding from mutiple tiles.
+        double               src_bpp;      ///< Source pixelformat BPP (bytes)
+        double               dst_bpp;      ///< Destination pixelformat BPP (bytes)
+        int                  shifts[3];    ///< requested red,green and blue shift (in bits)
+        decoder_t            decode_line;  ///< actual decoding function
+        unsigned int         dst_linesize; ///< destination linesize
+        unsigned int         dst_pitch;    ///< framebuffer pitch - it can be larger if SDL resolution is larger than data */
+        unsigned int         src_linesize; ///< source linesize
+};
+
+/**
+ * Payload of a single packet to be decoded with line_decode_packets().
+ */
+struct line_decode_pkt {
+        const struct line_decoder *line_decoder;
+        struct tile         *tile;         ///< destination tile
+        uint32_t             data_pos;     ///< offset of the payload in the source buffer
+        const unsigned char *data;
+        int                  len;
+};
+
+/**
+ * Decodes payload of a packet to the tile.
+ * @retval false frame buffer was too small to hold the data
+ */
+bool line_decode_packet(const struct line_decoder *line_decoder, struct tile *tile,
+                uint32_t data_pos, const unsigned char *source, int len);
+
+/**
+ * Decodes packets by the calling thread and threads - 1 worker threads.
+ * Packets must not overlap in the destination.
+ * @returns number of packets that didn't fit the frame buffer
+ */
+int line_decode_packets(const struct line_decode_pkt *pkts, size_t count, int threads);
+
+/**
+ * Fills parts of the tile corresponding to source data that was not received
+ * with the content of prev (buffer with the same layout as tile, eg. previous
+ * frame).
+ * @param src_len  length of the whole source buffer (substream)
+ * @returns number of (possibly partially) concealed lines
+ */
+int line_conceal_missing(const struct line_decoder *line_decoder, struct tile *tile,
+                const char *prev, const received_ranges &received, int src_len);
+
+/**
+ * Copies parts of the tile corresponding to received source data to prev,
+ * so that prev (containing the previous frame) matches the tile afterwards
+ * if the rest of the tile was concealed by line_conceal_missing().
+ */
+void line_store_received(const struct line_decoder *line_decoder, const struct tile *tile,
+                char *prev, const received_ranges &received, int src_len);
+
+#endif // RTP_LINE_DECODER_H_
+
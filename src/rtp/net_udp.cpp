@@ -59,19 +59,38 @@
 #include "addrinfo.h"
 #endif
 
+#ifdef HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+
+#if defined HAVE_LINUX && defined SO_TXTIME
+#include <linux/net_tstamp.h>
+#define UDP_HAVE_TXTIME 1
+#endif
+
 #include <algorithm>
 #include <condition_variable>
 #include <chrono>
 #include <mutex>
 #include <queue>
+#include <utility>
+#include <vector>
 
 using std::condition_variable;
 using std::max;
+using std::min;
 using std::mutex;
 using std::queue;
+using std::swap;
 using std::unique_lock;
+using std::vector;
 
 #define DEFAULT_MAX_UDP_READER_QUEUE_LEN (1920/3*8*1080/1152) //< 10-bit FullHD frame divided by 1280 MTU packets (minus headers)
+#ifdef HAVE_RECVMMSG
+#define DEFAULT_UDP_READER_BATCH 64 ///< max datagrams received with one recvmmsg() call
+#else
+#define DEFAULT_UDP_READER_BATCH 1
+#endif
 
 static int resolve_address(socket_udp *s, const char *addr, uint16_t tx_port);
 static void *udp_reader(void *arg);
@@ -130,6 +149,85 @@ struct item {
     int size;
 };
 
+#ifdef HAVE_SENDMMSG
+#define UDP_BATCH_MAX_PACKETS 1024 ///< flush queued packets when reached (also Linux UIO_MAXIOV)
+#define UDP_BATCH_MAX_IOV 3        ///< max iovecs per packet as passed by rtp_send_data_hdr()
+#define UDP_GSO_MAX_SEGMENTS 64    ///< Linux UDP_MAX_SEGMENTS
+#define UDP_GSO_MAX_BYTES 64000    ///< must fit into one IP datagram including headers
+#define UDP_BATCH_CMSG_SPACE (CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(uint64_t))) ///< UDP_SEGMENT + SCM_TXTIME
+
+struct udp_batch_packet {
+        int iov_idx;            ///< index of first iovec in udp_batch::iov
+        int iovcnt;
+        size_t len;
+        uint64_t txtime;        ///< launch time (SO_TXTIME), 0 if not set
+        void *dispose;          ///< data to be freed after the packet is sent
+};
+
+/**
+ * Packets queued between udp_async_start() and udp_async_wait() to be sent
+ * with a single sendmmsg() call. If UDP GSO is available, consecutive packets
+ * of the same length are additionally coalesced into one message.
+ */
+struct udp_batch {
+        struct udp_batch_packet *packets;
+        struct iovec *iov;
+        struct mmsghdr *msgs;
+        int *msg_first_packet;  ///< index of first packet of each message
+        char *cmsg;
+        int max;
+        int count;
+        int iov_count;
+        bool active;
+        bool use_gso;
+};
+#endif // defined HAVE_SENDMMSG
+
+#define UDP_PACKET_BUF_LEN (RTP_MAX_PACKET_LEN + sizeof(struct sockaddr_storage)) ///< incl. space for RTP_OPT_RECORD_SOURCE
+#define UDP_PACKET_SLAB_COUNT 256 ///< number of packet buffers allocated at once
+
+/**
+ * Process-wide pool of fixed-size packet buffers
+ *
+ * Buffers are allocated in slabs and recycled instead of being malloc()ed and
+ * freed for every datagram. The pool grows up to the maximal number of packets
+ * held at once (in reader queues and playout buffers) and is released at exit.
+ */
+class udp_packet_pool {
+public:
+        ~udp_packet_pool() {
+                for (auto slab : m_slabs) {
+                        free(slab);
+                }
+        }
+        void alloc(char **bufs, int count) {
+                unique_lock<mutex> lk(m_lock);
+                for (int i = 0; i < count; ++i) {
+                        if (m_free.empty()) {
+                                char *slab = (char *) malloc(UDP_PACKET_SLAB_COUNT * UDP_PACKET_BUF_LEN);
+                                m_slabs.push_back(slab);
+                                for (int j = 0; j < UDP_PACKET_SLAB_COUNT; ++j) {
+                                        m_free.push_back(slab + j * UDP_PACKET_BUF_LEN);
+                                }
+                        }
+                        bufs[i] = m_free.back();
+                        m_free.pop_back();
+                }
+        }
+        void release(char *buf) {
+                unique_lock<mutex> lk(m_lock);
+                m_free.push_back(buf);
+        }
+        static udp_packet_pool & get() {
+                static udp_packet_pool pool;
+                return pool;
+        }
+private:
+        mutex m_lock;
+        vector<char *> m_free;
+        vector<char *> m_slabs;
+};
+
 /*
  * Local part of the socket
  *
@@ -144,6 +242,7 @@ struct socket_udp_local {
         pthread_t thread_id;
         queue<struct item> packets;
         unsigned int max_packets;
+        int reader_batch;
         mutex lock;
         condition_variable boss_cv;
         condition_variable reader_cv;
@@ -169,7 +268,10 @@ struct _socket_udp {
         bool overlapping_active;
         int overlapped_max;
         int overlapped_count;
+#elif defined HAVE_SENDMMSG
+        struct udp_batch *batch;
 #endif
+        uint64_t txtime;        ///< launch time of subsequently sent packets, see udp_set_txtime()
 };
 
 static void udp_clean_async_state(socket_udp *s);
@@ -657,6 +759,9 @@ static bool address_is_ipv6(const char *addr)
 ADD_TO_PARAM(udp_queue_len, "udp-queue-len",
                 "* udp-queue-len=<l>\n"
                 "  Use different queue size than default DEFAULT_MAX_UDP_READER_QUEUE_LEN\n");
+ADD_TO_PARAM(udp_recv_batch, "udp-recv-batch",
+                "* udp-recv-batch=<n>\n"
+                "  Receive at most <n> datagrams at once with recvmmsg (default DEFAULT_UDP_READER_BATCH, 1 disables)\n");
 /**
  * udp_init_if:
  * Creates a session for sending and receiving UDP datagrams over IP
@@ -823,6 +928,12 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 } else {
                         s->local->max_packets = atoi(get_commandline_param("udp-queue-len"));
                 }
+                s->local->reader_batch = DEFAULT_UDP_READER_BATCH;
+#ifdef HAVE_RECVMMSG
+                if (get_commandline_param("udp-recv-batch")) {
+                        s->local->reader_batch = max(1, atoi(get_commandline_param("udp-recv-batch")));
+                }
+#endif
                 platform_pipe_init(s->local->should_exit_fd);
                 pthread_create(&s->local->thread_id, NULL, udp_reader, s);
         }
@@ -857,6 +968,15 @@ socket_udp *udp_init_with_local(struct socket_udp_local *l, struct sockaddr *sa,
         return s;
 }
 
+/**
+ * Creates another socket state sending to the same destination as s through
+ * the same underlying socket. The clone has its own asynchronous send queue, so
+ * that it can be used concurrently with s from a different thread.
+ */
+socket_udp *udp_init_clone(socket_udp *s)
+{
+        return udp_init_with_local(s->local, (struct sockaddr *) &s->sock, s->sock_len);
+}
 
 static fd_set rfd;
 static fd_t max_fd;
@@ -888,18 +1008,18 @@ void udp_fd_zero_r(struct udp_fd_r *fd_struct)
  **/
 void udp_exit(socket_udp * s)
 {
-        switch (s->local->mode) {
-        case IPv4:
-                udp_leave_mcast_grp4(((struct sockaddr_in *)&s->sock)->sin_addr.s_addr, s->local->fd);
-                break;
-        case IPv6:
-                udp_leave_mcast_grp6(((struct sockaddr_in6 *)&s->sock)->sin6_addr, s->local->fd);
-                break;
-        default:
-                abort();
-        }
-
         if (!s->local_is_slave) {
+                switch (s->local->mode) {
+                case IPv4:
+                        udp_leave_mcast_grp4(((struct sockaddr_in *)&s->sock)->sin_addr.s_addr, s->local->fd);
+                        break;
+                case IPv6:
+                        udp_leave_mcast_grp6(((struct sockaddr_in6 *)&s->sock)->sin6_addr, s->local->fd);
+                        break;
+                default:
+                        abort();
+                }
+
                 if (s->local->multithreaded) {
                         char c = 0;
                         int ret = send(s->local->should_exit_fd[1], &c, 1, 0);
@@ -909,7 +1029,7 @@ void udp_exit(socket_udp * s)
                         pthread_join(s->local->thread_id, NULL);
                         while (!s->local->packets.empty()) {
                                 auto it = s->local->packets.front();
-                                free(it.buf);
+                                udp_packet_free((char *) it.buf);
                                 s->local->packets.pop();
                         }
                         platform_pipe_close(s->local->should_exit_fd[1]);
@@ -972,12 +1092,149 @@ int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
         }
 }
 #else
+#ifdef HAVE_SENDMMSG
+static void udp_batch_flush(socket_udp *s);
+
+static int udp_batch_add(socket_udp *s, struct iovec *vector, int count, void *d)
+{
+        struct udp_batch *b = s->batch;
+
+        assert(count <= UDP_BATCH_MAX_IOV);
+
+        if (b->count == b->max) {
+                udp_batch_flush(s);
+        }
+
+        struct udp_batch_packet *p = &b->packets[b->count++];
+        p->iov_idx = b->iov_count;
+        p->iovcnt = count;
+        p->len = 0;
+        p->txtime = s->txtime;
+        p->dispose = d;
+        for (int i = 0; i < count; ++i) {
+                b->iov[b->iov_count++] = vector[i];
+                p->len += vector[i].iov_len;
+        }
+
+        return p->len;
+}
+
+/**
+ * Fills batch messages starting with packet first_packet.
+ * @returns number of messages
+ */
+static int udp_batch_prepare(socket_udp *s, int first_packet)
+{
+        struct udp_batch *b = s->batch;
+        int nr_msgs = 0;
+
+        for (int i = first_packet; i < b->count; ) {
+                struct udp_batch_packet *first = &b->packets[i];
+                int segments = 1;
+                size_t total_len = first->len;
+#ifdef UDP_SEGMENT
+                // all segments but the last one must be of the same length
+                while (b->use_gso && i + segments < b->count && segments < UDP_GSO_MAX_SEGMENTS &&
+                                b->packets[i + segments].txtime == first->txtime &&
+                                b->packets[i + segments - 1].len == first->len &&
+                                b->packets[i + segments].len <= first->len &&
+                                total_len + b->packets[i + segments].len <= UDP_GSO_MAX_BYTES) {
+                        total_len += b->packets[i + segments].len;
+                        segments += 1;
+                }
+#endif
+                struct udp_batch_packet *last = &b->packets[i + segments - 1];
+                struct msghdr *msg = &b->msgs[nr_msgs].msg_hdr;
+                memset(msg, 0, sizeof *msg);
+                msg->msg_name = (void *) &s->sock;
+                msg->msg_namelen = s->sock_len;
+                msg->msg_iov = &b->iov[first->iov_idx];
+                msg->msg_iovlen = last->iov_idx + last->iovcnt - first->iov_idx;
+                msg->msg_control = b->cmsg + nr_msgs * UDP_BATCH_CMSG_SPACE;
+                struct cmsghdr *cm = (struct cmsghdr *) msg->msg_control;
+#ifdef UDP_SEGMENT
+                if (segments > 1) {
+                        msg->msg_controllen += CMSG_SPACE(sizeof(uint16_t));
+                        cm->cmsg_level = SOL_UDP;
+                        cm->cmsg_type = UDP_SEGMENT;
+                        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                        uint16_t gso_size = first->len;
+                        memcpy(CMSG_DATA(cm), &gso_size, sizeof gso_size);
+                        cm = (struct cmsghdr *) ((char *) cm + CMSG_SPACE(sizeof(uint16_t)));
+                }
+#endif
+#ifdef UDP_HAVE_TXTIME
+                if (first->txtime != 0) {
+                        msg->msg_controllen += CMSG_SPACE(sizeof(uint64_t));
+                        cm->cmsg_level = SOL_SOCKET;
+                        cm->cmsg_type = SCM_TXTIME;
+                        cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+                        memcpy(CMSG_DATA(cm), &first->txtime, sizeof(uint64_t));
+                }
+#endif
+                if (msg->msg_controllen == 0) {
+                        msg->msg_control = NULL;
+                }
+                b->msg_first_packet[nr_msgs++] = i;
+                i += segments;
+        }
+
+        return nr_msgs;
+}
+
+static void udp_batch_flush(socket_udp *s)
+{
+        struct udp_batch *b = s->batch;
+        int packet = 0;
+
+        while (packet < b->count) {
+                int nr_msgs = udp_batch_prepare(s, packet);
+                int ret = sendmmsg(s->local->fd, b->msgs, nr_msgs, 0);
+                if (ret > 0) {
+                        packet = ret < nr_msgs ? b->msg_first_packet[ret] : b->count;
+                        continue;
+                }
+                if (ret < 0 && b->use_gso && (errno == EIO || errno == EINVAL)) {
+                        log_msg(LOG_LEVEL_WARNING, "[NET UDP] UDP GSO send failed, disabling.\n");
+                        b->use_gso = false;
+                        continue;
+                }
+                socket_error("sendmmsg");
+                break;
+        }
+
+        for (int i = 0; i < b->count; ++i) {
+                free(b->packets[i].dispose);
+        }
+        b->count = 0;
+        b->iov_count = 0;
+}
+
+static bool udp_gso_supported(socket_udp *s)
+{
+#ifdef UDP_SEGMENT
+        int val = 0;
+        socklen_t len = sizeof val;
+        return getsockopt(s->local->fd, SOL_UDP, UDP_SEGMENT, &val, &len) == 0;
+#else
+        UNUSED(s);
+        return false;
+#endif
+}
+#endif // defined HAVE_SENDMMSG
+
 int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 {
         struct msghdr msg;
 
         assert(s != NULL);
 
+#ifdef HAVE_SENDMMSG
+        if (s->batch && s->batch->active) {
+                return udp_batch_add(s, vector, count, d);
+        }
+#endif
+
         msg.msg_name = (void *) & s->sock;
         msg.msg_namelen = s->sock_len;
         msg.msg_iov = vector;
@@ -986,6 +1243,21 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
         msg.msg_control = 0;
         msg.msg_controllen = 0;
         msg.msg_flags = 0;
+#ifdef UDP_HAVE_TXTIME
+        union {
+                char buf[CMSG_SPACE(sizeof(uint64_t))];
+                struct cmsghdr align;
+        } control;
+        if (s->txtime != 0) {
+                msg.msg_control = control.buf;
+                msg.msg_controllen = sizeof control.buf;
+                struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+                cm->cmsg_level = SOL_SOCKET;
+                cm->cmsg_type = SCM_TXTIME;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+                memcpy(CMSG_DATA(cm), &s->txtime, sizeof(uint64_t));
+        }
+#endif
 
         int ret = sendmsg(s->local->fd, &msg, 0);
         free(d);
@@ -993,13 +1265,91 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 }
 #endif // WIN32
 
+/**
+ * Allocates a buffer for a RTP packet (RTP_MAX_PACKET_LEN bytes plus space for
+ * source address) from a recycled pool. The buffer must be released with
+ * udp_packet_free().
+ */
+char *udp_packet_alloc(void)
+{
+        char *buf;
+        udp_packet_pool::get().alloc(&buf, 1);
+        return buf;
+}
+
+void udp_packet_free(char *buf)
+{
+        if (buf) {
+                udp_packet_pool::get().release(buf);
+        }
+}
+
+/**
+ * recvmmsg() arguments, allocated once per reader thread
+ */
+struct udp_reader_mmsg {
+#ifdef HAVE_RECVMMSG
+        explicit udp_reader_mmsg(int batch) : msgs(batch), iov(batch) {
+                for (int i = 0; i < batch; ++i) {
+                        iov[i].iov_len = RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE;
+                        msgs[i].msg_hdr.msg_iov = &iov[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+        }
+        vector<struct mmsghdr> msgs;
+        vector<struct iovec> iov;
+#else
+        explicit udp_reader_mmsg(int) {}
+#endif
+};
+
+/**
+ * Receives up to count datagrams into buffers bufs (RTP_PACKET_HEADER_SIZE is
+ * reserved at the beginning of each).
+ *
+ * @param mm   preallocated recvmmsg() arguments for at least count datagrams
+ * @returns number of received datagrams or -1 on error
+ */
+static int udp_reader_recv(socket_udp *s, char **bufs, int *sizes, int count, struct udp_reader_mmsg *mm)
+{
+#ifdef HAVE_RECVMMSG
+        if (count > 1) {
+                struct mmsghdr *msgs = mm->msgs.data();
+                for (int i = 0; i < count; ++i) {
+                        mm->iov[i].iov_base = bufs[i] + RTP_PACKET_HEADER_SIZE;
+                }
+                int ret = recvmmsg(s->local->fd, msgs, count, MSG_DONTWAIT, NULL);
+                for (int i = 0; i < ret; ++i) {
+                        sizes[i] = msgs[i].msg_len;
+                }
+                return ret;
+        }
+#else
+        UNUSED(mm);
+#endif
+        sizes[0] = recvfrom(s->local->fd, bufs[0] + RTP_PACKET_HEADER_SIZE,
+                        RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
+                        0, 0, 0);
+        return sizes[0] > 0 ? 1 : -1;
+}
+
 /**
  * When receiving data in separate thread, this function fetches data
  * from socket and puts it in queue.
+ *
+ * Datagrams available at once are received in a batch into buffers from
+ * packet pool and passed to the queue under single lock. The batch is limited
+ * by free space in the queue so that it never exceeds max_packets.
  */
 static void *udp_reader(void *arg)
 {
         socket_udp *s = (socket_udp *) arg;
+        const int batch = s->local->reader_batch;
+        vector<char *> bufs(batch);
+        vector<int> sizes(batch);
+        udp_reader_mmsg mm(batch);
+
+        udp_packet_pool::get().alloc(bufs.data(), batch);
 
         while (1) {
                 fd_set fds;
@@ -1016,14 +1366,22 @@ static void *udp_reader(void *arg)
                 if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
                         break;
                 }
-                uint8_t *packet = (uint8_t *) malloc(RTP_MAX_PACKET_LEN);
-                uint8_t *buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
 
-                int size = recvfrom(s->local->fd, (char *) buffer,
-                                RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
-                                0, 0, 0);
+                // only this thread adds packets to the queue so the free space
+                // can only grow until the received batch is pushed
+                int room;
+                {
+                        unique_lock<mutex> lk(s->local->lock);
+                        s->local->reader_cv.wait(lk, [s]{return s->local->packets.size() < s->local->max_packets || s->local->should_exit;});
+                        if (s->local->should_exit) {
+                                break;
+                        }
+                        room = s->local->max_packets - s->local->packets.size();
+                }
+
+                int count = udp_reader_recv(s, bufs.data(), sizes.data(), min(batch, room), &mm);
 
-                if (size <= 0) {
+                if (count <= 0) {
                         /// @todo
                         /// In MSW, this block is called as often as packet is sent if
                         /// we got WSAECONNRESET error (noone is listening). This can have
@@ -1033,16 +1391,29 @@ static void *udp_reader(void *arg)
                 }
 
                 unique_lock<mutex> lk(s->local->lock);
-                s->local->reader_cv.wait(lk, [s]{return s->local->packets.size() < s->local->max_packets || s->local->should_exit;});
-                if (s->local->should_exit) {
-                        free(packet);
-                        break;
+                int pushed = 0;
+                for (int i = 0; i < count; ++i) {
+                        // empty datagrams (msg_len 0) are valid - their buffers
+                        // are not queued and must stay owned by this thread
+                        if (sizes[i] <= 0) {
+                                continue;
+                        }
+                        s->local->packets.emplace((uint8_t *) bufs[i], sizes[i]);
+                        // queued buffers are moved to the beginning, unused ones to the tail
+                        swap(bufs[pushed++], bufs[i]);
                 }
 
-                s->local->packets.emplace(packet, size);
-
                 lk.unlock();
                 s->local->boss_cv.notify_one();
+
+                // buffers passed to the queue are replaced with new ones
+                if (pushed > 0) {
+                        udp_packet_pool::get().alloc(bufs.data(), pushed);
+                }
+        }
+
+        for (auto buf : bufs) {
+                udp_packet_free(buf);
         }
 
         platform_pipe_close(s->local->should_exit_fd[0]);
@@ -1382,10 +1753,20 @@ void udp_flush_recv_buf(socket_udp *s)
         free(buf);
 }
 
+ADD_TO_PARAM(udp_disable_multi_send, "udp-disable-multi-send",
+                "* udp-disable-multi-send\n"
+                "  Send each packet with a separate syscall instead of batching with sendmmsg (Linux)\n");
+ADD_TO_PARAM(udp_disable_gso, "udp-disable-gso",
+                "* udp-disable-gso\n"
+                "  Do not coalesce batched packets with UDP GSO (Linux)\n");
 /**
  * By calling this function under MSW, caller indicates that following packets
  * can be send in asynchronous manner. Caller should then call udp_async_wait()
  * to ensure that all packets were actually sent.
+ *
+ * Under Linux, subsequent packets are queued and sent in batches with sendmmsg()
+ * (and UDP GSO if supported) when the queue fills, on udp_async_flush() or
+ * udp_async_wait(). The packet data must therefore not be altered before then.
  */
 void udp_async_start(socket_udp *s, int nr_packets)
 {
@@ -1404,12 +1785,78 @@ void udp_async_start(socket_udp *s, int nr_packets)
 
         s->overlapped_count = 0;
         s->overlapping_active = true;
+#elif defined HAVE_SENDMMSG
+        if (get_commandline_param("udp-disable-multi-send")) {
+                return;
+        }
+        if (s->batch == NULL) {
+                s->batch = new udp_batch();
+                s->batch->use_gso = !get_commandline_param("udp-disable-gso") && udp_gso_supported(s);
+        }
+        struct udp_batch *b = s->batch;
+        nr_packets = min(nr_packets, UDP_BATCH_MAX_PACKETS);
+        if (nr_packets > b->max) {
+                b->packets = (struct udp_batch_packet *) realloc(b->packets, nr_packets * sizeof(struct udp_batch_packet));
+                b->iov = (struct iovec *) realloc(b->iov, nr_packets * UDP_BATCH_MAX_IOV * sizeof(struct iovec));
+                b->msgs = (struct mmsghdr *) realloc(b->msgs, nr_packets * sizeof(struct mmsghdr));
+                b->msg_first_packet = (int *) realloc(b->msg_first_packet, nr_packets * sizeof(int));
+                b->cmsg = (char *) realloc(b->cmsg, nr_packets * UDP_BATCH_CMSG_SPACE);
+                b->max = nr_packets;
+        }
+        b->active = true;
 #else
         UNUSED(nr_packets);
         UNUSED(s);
 #endif
 }
 
+/**
+ * Enables per-packet launch times (SO_TXTIME) for socket. The launch times are
+ * then set with udp_set_txtime(). To have the effect, the outgoing interface
+ * must use a qdisc that honors the launch times (fq or etf).
+ *
+ * @retval true  if supported by the system
+ */
+bool udp_enable_txtime(socket_udp *s)
+{
+#ifdef UDP_HAVE_TXTIME
+        struct sock_txtime cfg;
+        memset(&cfg, 0, sizeof cfg);
+        cfg.clockid = CLOCK_MONOTONIC;
+        if (setsockopt(s->local->fd, SOL_SOCKET, SO_TXTIME, &cfg, sizeof cfg) == 0) {
+                return true;
+        }
+        socket_error("setsockopt SO_TXTIME");
+#else
+        UNUSED(s);
+#endif
+        return false;
+}
+
+/**
+ * Sets launch time for packets sent from now on.
+ * @param txtime CLOCK_MONOTONIC time in nanoseconds, 0 to send immediately
+ */
+void udp_set_txtime(socket_udp *s, uint64_t txtime)
+{
+        s->txtime = txtime;
+}
+
+/**
+ * Sends packets queued since udp_async_start() (or last flush) immediately
+ * while keeping the asynchronous mode active. Useful for paced sending.
+ */
+void udp_async_flush(socket_udp *s)
+{
+#ifdef HAVE_SENDMMSG
+        if (s->batch && s->batch->active) {
+                udp_batch_flush(s);
+        }
+#else
+        UNUSED(s);
+#endif
+}
+
 void udp_async_wait(socket_udp *s)
 {
 #ifdef WIN32
@@ -1432,6 +1879,11 @@ void udp_async_wait(socket_udp *s)
                 free(s->dispose_udata[i]);
         }
         s->overlapping_active = false;
+#elif defined HAVE_SENDMMSG
+        if (s->batch && s->batch->active) {
+                udp_batch_flush(s);
+                s->batch->active = false;
+        }
 #else
         UNUSED(s);
 #endif
@@ -1446,6 +1898,15 @@ static void udp_clean_async_state(socket_udp *s)
         free(s->overlapped);
         free(s->overlapped_events);
         free(s->dispose_udata);
+#elif defined HAVE_SENDMMSG
+        if (s->batch) {
+                free(s->batch->packets);
+                free(s->batch->iov);
+                free(s->batch->msgs);
+                free(s->batch->msg_first_packet);
+                free(s->batch->cmsg);
+                delete s->batch;
+        }
 #else
         UNUSED(s);
 #endif
@@ -1555,9 +2016,9 @@ int udp_recv_timeout(socket_udp *s, char *buffer, int buflen, struct timeval *ti
                         char *data = NULL;
                         len = udp_recv_data(s, (char **) &data);
                         if (len > 0) {
-                                memcpy(buffer, data, len);
+                                memcpy(buffer, data + RTP_PACKET_HEADER_SIZE, len);
                         }
-                        free(data);
+                        udp_packet_free(data);
                 }
         } else {
                 udp_fd_zero_r(&fd);
@@ -66,7 +66,10 @@ int         udp_sendto(socket_udp *s, char *buffer, int buflen, struct sockaddr
 
 int         udp_recvv(socket_udp *s, struct msghdr *m);
 void        udp_async_start(socket_udp *s, int nr_packets);
+void        udp_async_flush(socket_udp *s);
 void        udp_async_wait(socket_udp *s);
+bool        udp_enable_txtime(socket_udp *s);
+void        udp_set_txtime(socket_udp *s, uint64_t txtime);
 #ifdef WIN32
 int         udp_sendv(socket_udp *s, LPWSABUF vector, int count, void *d);
 #else
@@ -96,6 +99,8 @@ void        udp_fd_set_r(socket_udp *s, struct udp_fd_r *);
 int         udp_fd_isset_r(socket_udp *s, struct udp_fd_r *);
 
 int         udp_recv_data(socket_udp * s, char **buffer);
+char       *udp_packet_alloc(void);
+void        udp_packet_free(char *buf);
 bool        udp_not_empty(socket_udp *s, struct timeval *timeout);
 bool        udp_port_pair_is_free(const char *addr, bool use_ipv6, int even_port);
 bool        udp_is_ipv6(socket_udp *s);
@@ -108,6 +113,7 @@ int         udp_send_wsa_async(socket_udp *s, char *buffer, int buflen, LPWSAOVE
 
 struct socket_udp_local *udp_get_local(socket_udp *s);
 socket_udp *udp_init_with_local(struct socket_udp_local *l, struct sockaddr *sa, socklen_t len);
+socket_udp *udp_init_clone(socket_udp *s);
 
 /*************************************************************************************************/
 #if defined(__cplusplus)
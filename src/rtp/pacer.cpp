@@ -0,0 +1,298 @@
+/**
+ * @file   rtp/pacer.cpp
+ * @brief  Paces sending of packets of a frame to a given packet interval.
+ *
+ * Packets are released on an absolute schedule (first packet time + n * interval),
+ * so that the error of a single wait does not accumulate. Instead of busy-waiting
+ * for each packet, packets are grouped into bursts spanning approximately
+ * pacer burst time and the sending thread sleeps between the bursts. If SO_TXTIME
+ * is available, the bursts may be also handed over to the kernel together with
+ * their launch times and the sender does not wait at all.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#ifdef HAVE_LINUX
+#include <sys/prctl.h>
+#include <time.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/pacer.h"
+#include "rtp/rtp.h"
+
+#define DEFAULT_PACER_BURST_US 100
+#define PACER_STATS_INTERVAL_SEC 10
+#define MOD_NAME "[Pacer] "
+
+using namespace std;
+
+ADD_TO_PARAM(pacer, "pacer",
+                "* pacer=spin|sleep|txtime[:burst=<us>]\n"
+                "  Traffic shaping method - busy-wait per packet, sleep between bursts of\n"
+                "  packets (default) or kernel launch times (SO_TXTIME, needs fq qdisc).\n"
+                "  Burst is the time span of packets sent at once (default 100 us).\n");
+
+struct pacer {
+        enum pacer_mode mode = PACER_SLEEP;
+        long burst_ns = DEFAULT_PACER_BURST_US * 1000;
+
+        struct rtp *session = nullptr;
+        struct rtp *txtime_session = nullptr; ///< session SO_TXTIME was enabled for
+        thread::id slack_thread;              ///< thread timer slack was reduced for
+
+        long interval_ns = 0;
+        int burst = 1;                        ///< packets per burst
+        long long start = 0;                  ///< time of first packet of current bulk
+        long long sent = 0;                   ///< packets sent in current bulk
+
+        // statistics
+        long long bursts = 0;
+        long long packets = 0;
+        double late_sum = 0.0;
+        double late_sq_sum = 0.0;
+        double late_max = 0.0;
+        double scheduled_ns = 0.0;
+        double elapsed_ns = 0.0;
+        long long last_stats = 0;
+};
+
+static long long pacer_time_ns()
+{
+#ifdef HAVE_LINUX
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static void pacer_sleep_until(long long deadline)
+{
+#ifdef HAVE_LINUX
+        struct timespec ts;
+        ts.tv_sec = deadline / 1000000000ll;
+        ts.tv_nsec = deadline % 1000000000ll;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+#else
+        this_thread::sleep_until(chrono::steady_clock::time_point(chrono::nanoseconds(deadline)));
+#endif
+}
+
+static const char *pacer_mode_name(enum pacer_mode mode)
+{
+        switch (mode) {
+        case PACER_SPIN: return "spin";
+        case PACER_SLEEP: return "sleep";
+        case PACER_TXTIME: return "txtime";
+        }
+        return "unknown";
+}
+
+struct pacer *pacer_init(void)
+{
+        struct pacer *p = new pacer();
+
+        const char *cfg = get_commandline_param("pacer");
+        if (cfg) {
+                string mode = cfg;
+                auto colon = mode.find(':');
+                if (colon != string::npos) {
+                        string opt = mode.substr(colon + 1);
+                        mode = mode.substr(0, colon);
+                        if (opt.compare(0, strlen("burst="), "burst=") == 0) {
+                                p->burst_ns = max(0l, atol(opt.c_str() + strlen("burst="))) * 1000;
+                        } else {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", opt.c_str());
+                        }
+                }
+                if (mode == "spin") {
+                        p->mode = PACER_SPIN;
+                } else if (mode == "sleep") {
+                        p->mode = PACER_SLEEP;
+                } else if (mode == "txtime") {
+                        p->mode = PACER_TXTIME;
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown mode: %s, using sleep.\n", mode.c_str());
+                }
+        }
+
+        p->last_stats = pacer_time_ns();
+
+        return p;
+}
+
+void pacer_done(struct pacer *p)
+{
+        delete p;
+}
+
+void pacer_begin(struct pacer *p, struct rtp *session, long interval_ns)
+{
+        p->session = session;
+        p->interval_ns = interval_ns;
+        p->sent = 0;
+
+        if (interval_ns <= 0) {
+                return;
+        }
+
+        if (p->mode == PACER_TXTIME && p->txtime_session != session) {
+                if (rtp_enable_txtime(session)) {
+                        p->txtime_session = session;
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "SO_TXTIME not available, falling back to sleep.\n");
+                        p->mode = PACER_SLEEP;
+                }
+        }
+
+#ifdef HAVE_LINUX
+        // default 50 us timer slack would make the wake-ups too late
+        if (p->mode == PACER_SLEEP && p->slack_thread != this_thread::get_id()) {
+                prctl(PR_SET_TIMERSLACK, 1);
+                p->slack_thread = this_thread::get_id();
+        }
+#endif
+
+        p->burst = p->mode == PACER_SPIN ? 1 : max<long>(1, p->burst_ns / interval_ns);
+        p->start = pacer_time_ns();
+}
+
+void pacer_packet_sent(struct pacer *p)
+{
+        if (p->interval_ns <= 0) {
+                return;
+        }
+
+        p->sent += 1;
+        if (p->sent % p->burst != 0) {
+                return;
+        }
+
+        long long deadline = p->start + p->sent * p->interval_ns;
+        p->bursts += 1;
+
+        if (p->mode == PACER_TXTIME) {
+                rtp_set_txtime(p->session, deadline);
+                return;
+        }
+
+        // send packets of the burst
+        rtp_async_flush(p->session);
+
+        long long now;
+        if (p->mode == PACER_SPIN) {
+                while ((now = pacer_time_ns()) < deadline) {
+                }
+        } else {
+                if (pacer_time_ns() < deadline) {
+                        pacer_sleep_until(deadline);
+                }
+                now = pacer_time_ns();
+        }
+
+        double late = now - deadline;
+        p->late_sum += late;
+        p->late_sq_sum += late * late;
+        p->late_max = max(p->late_max, late);
+}
+
+void pacer_end(struct pacer *p)
+{
+        if (p->interval_ns <= 0) {
+                return;
+        }
+
+        long long now = pacer_time_ns();
+
+        if (p->mode == PACER_TXTIME) {
+                rtp_set_txtime(p->session, 0);
+        } else if (p->sent > 0) {
+                p->scheduled_ns += (double) p->sent * p->interval_ns;
+                p->elapsed_ns += now - p->start;
+        }
+        p->packets += p->sent;
+        p->interval_ns = 0;
+
+        if (now - p->last_stats > PACER_STATS_INTERVAL_SEC * 1000000000ll) {
+                struct pacer_stats stats;
+                pacer_get_stats(p, &stats);
+                if (stats.mode == PACER_TXTIME) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%s (cumulative): %lld packets in %lld bursts scheduled by kernel\n",
+                                        pacer_mode_name(stats.mode), stats.packets, stats.bursts);
+                } else {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%s (cumulative): %lld packets in %lld bursts, "
+                                        "wake-up lateness avg %.1f us, max %.1f us, jitter %.1f us, "
+                                        "sending duration %.3f of requested\n",
+                                        pacer_mode_name(stats.mode), stats.packets, stats.bursts,
+                                        stats.avg_late_us, stats.max_late_us, stats.jitter_us, stats.rate_ratio);
+                }
+                p->last_stats = now;
+        }
+}
+
+void pacer_get_stats(struct pacer *p, struct pacer_stats *stats)
+{
+        stats->mode = p->mode;
+        stats->bursts = p->bursts;
+        stats->packets = p->packets;
+        stats->avg_late_us = stats->max_late_us = stats->jitter_us = 0.0;
+        stats->rate_ratio = 1.0;
+        if (p->bursts > 0 && p->mode != PACER_TXTIME) {
+                double avg = p->late_sum / p->bursts;
+                stats->avg_late_us = avg / 1000.0;
+                stats->max_late_us = p->late_max / 1000.0;
+                stats->jitter_us = sqrt(max(0.0, p->late_sq_sum / p->bursts - avg * avg)) / 1000.0;
+        }
+        if (p->scheduled_ns > 0.0) {
+                stats->rate_ratio = p->elapsed_ns / p->scheduled_ns;
+        }
+}
+
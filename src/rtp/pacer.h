@@ -0,0 +1,86 @@
+/**
+ * @file   rtp/pacer.h
+ * @brief  Paces sending of packets of a frame to a given packet interval.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_PACER_H_
+#define RTP_PACER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pacer;
+struct rtp;
+
+enum pacer_mode {
+        PACER_SPIN,   ///< busy-wait between packets (legacy behavior)
+        PACER_SLEEP,  ///< sleep between bursts of packets
+        PACER_TXTIME, ///< let the kernel release bursts at given time (SO_TXTIME)
+};
+
+struct pacer_stats {
+        enum pacer_mode mode;
+        long long bursts;         ///< number of waits (bursts released)
+        long long packets;        ///< number of paced packets
+        double avg_late_us;       ///< average wake-up lateness
+        double max_late_us;       ///< maximal wake-up lateness
+        double jitter_us;         ///< standard deviation of wake-up lateness
+        double rate_ratio;        ///< achieved/requested sending duration
+};
+
+struct pacer *pacer_init(void);
+void pacer_done(struct pacer *p);
+
+/**
+ * Starts pacing of a new bulk of packets (eg. tile) sent to session.
+ * @param interval_ns requested interval between packets, <= 0 disables pacing
+ */
+void pacer_begin(struct pacer *p, struct rtp *session, long interval_ns);
+/**
+ * Must be called after every packet but last of the bulk. Waits (or schedules)
+ * until the time the next packet is to be sent.
+ */
+void pacer_packet_sent(struct pacer *p);
+void pacer_end(struct pacer *p);
+
+void pacer_get_stats(struct pacer *p, struct pacer_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_PACER_H_
+
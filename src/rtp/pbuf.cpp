@@ -58,26 +58,54 @@
 #include "config_win32.h"
 #include "debug.h"
 #include "perf.h"
+#include "rtp/fec_interleaved.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/ptime.h"
 #include "rtp/pbuf.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
 #define PBUF_MAGIC	0xcafebabe
 
 #define STATS_INTERVAL 100
 
+#define ARQ_MAX_GAP 8192 ///< larger gaps are considered a stream discontinuity
+#define PBUF_MAX_FRAME_PKTS 65536 ///< whole seqno space, frame cannot span more packets
+#define PBUF_NODE_POOL_SIZE 16
+#define ARQ_MIN_RETRY_US 2000
+#define VIDEO_CLOCK_RATE 90000
+#define ADAPTIVE_WINDOW 256        ///< frames used to compute adaptive playout delay
+#define ADAPTIVE_UPDATE_FRAMES 16  ///< adaptive playout delay is recomputed after this number of frames
+#define ADAPTIVE_DECREASE 0.1      ///< portion of a decrease of the delay applied at once
+#define PBUF_MAX_HOLD_MS 2000      ///< frames are not held for a retry longer after their playout time
+
 struct pbuf_node {
         struct pbuf_node *nxt;
         struct pbuf_node *prv;
         uint32_t rtp_timestamp; /* RTP timestamp for the frame           */
         std::chrono::high_resolution_clock::time_point arrival_time;    /* Arrival time of first packet in frame */
         std::chrono::high_resolution_clock::time_point playout_time;    /* Playout time for the frame            */
-        struct coded_data *cdata;       /*                                       */
+        std::chrono::high_resolution_clock::time_point last_arrival;    /* Arrival time of last packet in frame  */
+        long long int rtp_time_us; /* RTP timestamp (extended) in microseconds */
+        /**
+         * Packets of the frame indexed by seqno - base_seqno, data is NULL for
+         * the packets not (yet) received. Entries are linked (in descending
+         * seqno order) only when the frame is passed to the decoder.
+         */
+        std::vector<struct coded_data> pkts;
+        uint16_t base_seqno;
+        int pkt_count;          /* number of packets received            */
         int decoded;            /* Non-zero if we've decoded this frame  */
         int mbit;               /* determines if mbit of frame had been seen */
         uint32_t magic;         /* For debugging                         */
         bool completed;
+        uint16_t min_seqno;     /* lowest seqno received for this frame  */
+        uint16_t max_seqno;     /* highest seqno received for this frame */
 };
 
 struct pbuf {
@@ -95,10 +123,61 @@ struct pbuf {
         int received_pkts_last, expected_pkts_last; // values for last interval
         long long int received_pkts_cum, expected_pkts_cum; // cumulative values
         uint32_t last_display_ts;
+
+        // retransmission requests (ARQ)
+        struct missing_pkt {
+                std::chrono::high_resolution_clock::time_point detected;
+                std::chrono::high_resolution_clock::time_point last_nack;
+                int nack_count;
+        };
+        long long int arq_budget_us;     ///< 0 if ARQ is disabled
+        long long int arq_max_seq;       ///< highest extended seq seen, -1 if none
+        std::map<long long int, missing_pkt> missing; ///< keyed by extended seq
+        long long int nacked_pkts, recovered_pkts, lost_pkts;
+
+        std::vector<struct pbuf_node *> node_pool; ///< released nodes with allocated packet arrays
+
+        long long int partial_deadline_us; ///< see pbuf_set_partial_decode(), -1 if disabled
+        bool decode_held;                ///< decoder asked to retry (see @ref PBUF_DECODE_RETRY)
+        bool latest_wins;                ///< see pbuf_set_latest_wins()
+        pbuf_skippable_t *skippable;
+        void *skippable_udata;
+
+        decode_frame_t *immediate_func;  ///< see pbuf_set_immediate_decode()
+        void *immediate_data;
+        int immediate_decoded;           ///< frames decoded in pbuf_insert() since last pbuf_decode()
+        long long int last_decoded_seq;  ///< highest seqno of last frame passed to decoder, -1 if none
+        long long int skipped_frames;    ///< frames skipped because of latest_wins (cumulative)
+
+        // adaptive playout delay (see pbuf_set_adaptive_playout())
+        struct transit_sample {
+                long long int first_us;  ///< arrival of first packet minus RTP time
+                long long int last_us;   ///< arrival of last packet minus RTP time
+        };
+        bool adaptive;
+        long long int adaptive_min_us, adaptive_max_us;
+        double adaptive_percentile;
+        long long int adaptive_delay_us; ///< delay after the earliest expected arrival (-1 if not yet computed)
+        long long int adaptive_base_us;  ///< earliest transit in the window
+        std::vector<transit_sample> transit; ///< ring buffer of ADAPTIVE_WINDOW samples
+        std::vector<long long int> lateness; ///< scratch buffer for percentile computation
+        size_t transit_count;            ///< number of samples ever added
+        std::chrono::high_resolution_clock::time_point time_base;
+        bool rtp_ts_valid;
+        uint32_t rtp_ts_max;             ///< highest RTP timestamp seen
+        long long int rtp_ts_ext_max;    ///< rtp_ts_max extended to 64 bits
+
+        struct fec_interleaved_rx *interleaved; ///< created with first parity packet
+        long long int interleaved_recovered;
 };
 
-static void free_cdata(struct coded_data *head);
 static int frame_complete(struct pbuf_node *frame);
+static void release_pnode(struct pbuf *playout_buf, struct pbuf_node *node);
+static void insert_coded_unit(struct pbuf_node *node, rtp_packet * pkt);
+static bool arq_frame_pending(struct pbuf *playout_buf, struct pbuf_node *frame,
+                std::chrono::high_resolution_clock::time_point const & curr_time);
+static bool pbuf_frame_held(struct pbuf *playout_buf, struct pbuf_node *frame,
+                std::chrono::high_resolution_clock::time_point const & curr_time);
 
 /*********************************************************************************/
 
@@ -108,7 +187,6 @@ static void pbuf_validate(struct pbuf *playout_buf)
         /* Only used in debugging mode, since it's a lot of overhead [csp] */
 #ifdef NDEF
         struct pbuf_node *cpb, *ppb;
-        struct coded_data *ccd, *pcd;
 
         cpb = playout_buf->frst;
         ppb = NULL;
@@ -128,25 +206,15 @@ static void pbuf_validate(struct pbuf *playout_buf)
                 } else {
                         assert(cpb = playout_buf->last);
                 }
-                if (cpb->cdata != NULL) {
-                        /* We have coded data... check all the pointers on that list too */
-                        ccd = cpb->cdata;
-                        pcd = NULL;
-                        while (ccd != NULL) {
-                                assert(ccd->prv == pcd);
-                                if (ccd->prv != NULL) {
-                                        assert(ccd->prv->nxt == ccd);
-                                        /* list is descending - cant really check this now */
-                                        //assert(ccd->seqno < pcd->seqno); 
-                                        assert(ccd->data != NULL);
-                                }
-                                if (ccd->nxt != NULL) {
-                                        assert(ccd->nxt->prv == ccd);
-                                }
-                                pcd = ccd;
-                                ccd = ccd->nxt;
+                /* check that packets are stored at their positions */
+                int count = 0;
+                for (size_t i = 0; i < cpb->pkts.size(); ++i) {
+                        if (cpb->pkts[i].data != NULL) {
+                                assert(cpb->pkts[i].seqno == (uint16_t) (cpb->base_seqno + i));
+                                count += 1;
                         }
                 }
+                assert(count == cpb->pkt_count);
                 ppb = cpb;
                 cpb = cpb->nxt;
         }
@@ -159,7 +227,7 @@ struct pbuf *pbuf_init(volatile int *delay_ms)
 {
         struct pbuf *playout_buf = NULL;
 
-        playout_buf = (struct pbuf *) calloc(1, sizeof(struct pbuf));
+        playout_buf = new struct pbuf();
         if (playout_buf != NULL) {
                 playout_buf->frst = NULL;
                 playout_buf->last = NULL;
@@ -169,6 +237,10 @@ struct pbuf *pbuf_init(volatile int *delay_ms)
                 playout_buf->offset_ms = delay_ms;
                 playout_buf->playout_delay_us = 0.032 * 1000 * 1000;
                 playout_buf->last_rtp_seq = -1;
+                playout_buf->arq_max_seq = -1;
+                playout_buf->partial_deadline_us = -1;
+                playout_buf->interleaved = NULL;
+                playout_buf->last_decoded_seq = -1;
         } else {
                 debug_msg("Failed to allocate memory for playout buffer\n");
         }
@@ -196,114 +268,291 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                         if (curr->prv != NULL) {
                                 curr->prv->nxt = curr->nxt;
                         }
-                        free_cdata(curr->cdata);
-                        delete curr;
+                        release_pnode(playout_buf, curr);
                         curr = temp;
                 }
-                free(playout_buf);
+                for (auto node : playout_buf->node_pool) {
+                        delete node;
+                }
+                fec_interleaved_rx_done(playout_buf->interleaved);
+                delete playout_buf;
         }
 }
 
-static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
+static bool add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
 {
-        /* Add "pkt" to the frame represented by "node". The "node" has    */
-        /* previously been created, and has some coded data already...     */
+        /* Add "pkt" to the frame represented by "node". The packet is     */
+        /* stored at the position given by its sequence number, so the     */
+        /* insertion doesn't depend on the number of packets or reordering. */
 
-        /* New arrivals are added at the head of the list, which is stored */
-        /* in descending order of packets as they arrive (NOT necessarily  */
-        /* descending sequence number order, as the network might reorder) */
+        assert(node->rtp_timestamp == pkt->ts);
 
-        struct coded_data *tmp, *curr, *prv;
+        int idx = (uint16_t) (pkt->seq - node->base_seqno);
+        if (idx >= (int) node->pkts.size()) {
+                // packet is either after the last one or (reordered) before the
+                // first one - the array is extended in the direction needing less
+                int forward = idx + 1 - (int) node->pkts.size();
+                int backward = PBUF_MAX_FRAME_PKTS - idx;
+                if (backward < forward) {
+                        if (node->pkts.size() + backward > PBUF_MAX_FRAME_PKTS) {
+                                rtp_packet_free(pkt);
+                                return false;
+                        }
+                        node->pkts.insert(node->pkts.begin(), backward, coded_data());
+                        node->base_seqno = pkt->seq;
+                        idx = 0;
+                } else {
+                        node->pkts.resize(idx + 1);
+                }
+        }
 
-        assert(node->rtp_timestamp == pkt->ts);
-        assert(node->cdata != NULL);
+        struct coded_data *slot = &node->pkts[idx];
+        if (slot->data != NULL) {
+                /* duplicate packet */
+                rtp_packet_free(pkt);
+                return false;
+        }
+        slot->seqno = pkt->seq;
+        slot->data = pkt;
+        node->pkt_count += 1;
+        node->mbit |= pkt->m;
+        // first and last slots are always occupied
+        node->min_seqno = node->base_seqno;
+        node->max_seqno = node->base_seqno + node->pkts.size() - 1;
+        return true;
+}
 
-        tmp = (struct coded_data *) malloc(sizeof(struct coded_data));
-        if (tmp == NULL) {
-                /* this is bad, out of memory, drop the packet... */
-                free(pkt);
+/**
+ * Adds the packet to the frame and records its arrival unless it is
+ * a duplicate.
+ */
+static void insert_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
+{
+        if (!add_coded_unit(node, pkt)) {
                 return;
         }
+        node->last_arrival = std::chrono::high_resolution_clock::now();
+}
 
-        tmp->seqno = pkt->seq;
-        tmp->data = pkt;
-        node->mbit |= pkt->m;
-        if((int16_t)(tmp->seqno - node->cdata->seqno) > 0){
-                tmp->prv = NULL;
-                tmp->nxt = node->cdata;
-                node->cdata->prv = tmp;
-                node->cdata = tmp;
-        } else {
-                curr = node->cdata;
-                if (curr == NULL){
-                        /* this is bad, out of memory, drop the packet... */
-                        free(pkt);
-                        free(tmp);
+/**
+ * Links received packets of the frame into a list in descending seqno order
+ * (as expected by decoders).
+ * @returns head of the list (packet with the highest seqno)
+ */
+static struct coded_data *link_coded_units(struct pbuf_node *node)
+{
+        struct coded_data *head = NULL;
+        struct coded_data *prv = NULL;
+
+        for (int i = (int) node->pkts.size() - 1; i >= 0; --i) {
+                struct coded_data *curr = &node->pkts[i];
+                if (curr->data == NULL) {
+                        continue;
+                }
+                curr->prv = prv;
+                curr->nxt = NULL;
+                if (prv != NULL) {
+                        prv->nxt = curr;
                 } else {
-                        while (curr != NULL &&  ((int16_t)(tmp->seqno - curr->seqno) < 0)){
-                                prv = curr;
-                                curr = curr->nxt;
-                        }
-                        if (curr == NULL) {
-                                tmp->nxt = NULL;
-                                tmp->prv = prv;
-                                prv->nxt = tmp;
-                        }else if ((int16_t)(tmp->seqno - curr->seqno) > 0){
-                                tmp->nxt = curr;
-                                tmp->prv = curr->prv;
-                                tmp->prv->nxt = tmp;
-                                curr->prv = tmp;
-                        } else {
-                                /* this is bad, something went terribly wrong... */
-                                free(pkt);
-                                free(tmp);
-                        }
+                        head = curr;
                 }
+                prv = curr;
+        }
+        return head;
+}
+
+/**
+ * Converts RTP timestamp to microseconds relative to the first timestamp seen,
+ * handling the wrap-around.
+ */
+static long long int rtp_time_us(struct pbuf *playout_buf, uint32_t ts)
+{
+        if (!playout_buf->rtp_ts_valid) {
+                playout_buf->rtp_ts_valid = true;
+                playout_buf->rtp_ts_max = ts;
+                playout_buf->rtp_ts_ext_max = 0;
+                playout_buf->time_base = std::chrono::high_resolution_clock::now();
         }
+        long long int ext = playout_buf->rtp_ts_ext_max + (int32_t) (ts - playout_buf->rtp_ts_max);
+        if (ext > playout_buf->rtp_ts_ext_max) {
+                playout_buf->rtp_ts_max = ts;
+                playout_buf->rtp_ts_ext_max = ext;
+        }
+        return ext * 1000000 / VIDEO_CLOCK_RATE;
 }
 
-static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_delay_us)
+/**
+ * Records arrival of the frame and, once in ADAPTIVE_UPDATE_FRAMES frames,
+ * recomputes the adaptive playout delay as the given percentile of frame
+ * completion lateness - the time between the earliest expected arrival of the
+ * frame (according to its RTP timestamp) and the arrival of its last packet.
+ */
+static void adaptive_playout_update(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+
+        struct pbuf::transit_sample sample = {
+                duration_cast<microseconds>(node->arrival_time - playout_buf->time_base).count() - node->rtp_time_us,
+                duration_cast<microseconds>(node->last_arrival - playout_buf->time_base).count() - node->rtp_time_us,
+        };
+        playout_buf->transit[playout_buf->transit_count++ % ADAPTIVE_WINDOW] = sample;
+
+        if (playout_buf->transit_count % ADAPTIVE_UPDATE_FRAMES != 0) {
+                return;
+        }
+
+        size_t count = std::min<size_t>(playout_buf->transit_count, ADAPTIVE_WINDOW);
+        long long int base = playout_buf->transit[0].first_us;
+        for (size_t i = 0; i < count; ++i) {
+                base = std::min(base, playout_buf->transit[i].first_us);
+        }
+        playout_buf->lateness.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+                playout_buf->lateness[i] = playout_buf->transit[i].last_us - base;
+        }
+        auto nth = playout_buf->lateness.begin() + std::min<size_t>(count - 1,
+                        count * playout_buf->adaptive_percentile / 100.0);
+        std::nth_element(playout_buf->lateness.begin(), nth, playout_buf->lateness.end());
+
+        long long int target = std::max(playout_buf->adaptive_min_us,
+                        std::min(playout_buf->adaptive_max_us, *nth));
+        long long int delay = playout_buf->adaptive_delay_us;
+        // grow at once to avoid stalls, shrink slowly
+        if (delay < 0 || target > delay) {
+                delay = target;
+        } else {
+                delay -= (delay - target) * ADAPTIVE_DECREASE;
+        }
+        if (playout_buf->adaptive_delay_us >= 0 &&
+                        std::abs(playout_buf->adaptive_delay_us - delay) > 1000) {
+                debug_msg("Adaptive playout delay changed to %.1f ms\n", delay / 1000.0);
+        }
+        playout_buf->adaptive_delay_us = delay;
+        playout_buf->adaptive_base_us = base;
+}
+
+static struct pbuf_node *create_new_pnode(struct pbuf *playout_buf, rtp_packet * pkt, long long playout_delay_us)
 {
         struct pbuf_node *tmp;
 
         perf_record(UVP_CREATEPBUF, pkt->ts);
 
-        tmp = new struct pbuf_node();
-        if (tmp != NULL) {
-                tmp->magic = PBUF_MAGIC;
-                tmp->rtp_timestamp = pkt->ts;
-                tmp->mbit = pkt->m;
-                tmp->playout_time =
-                        tmp->arrival_time = std::chrono::high_resolution_clock::now();
+        if (!playout_buf->node_pool.empty()) {
+                tmp = playout_buf->node_pool.back();
+                playout_buf->node_pool.pop_back();
+        } else {
+                tmp = new struct pbuf_node();
+        }
+        tmp->nxt = tmp->prv = NULL;
+        tmp->magic = PBUF_MAGIC;
+        tmp->rtp_timestamp = pkt->ts;
+        tmp->mbit = 0;
+        tmp->decoded = 0;
+        tmp->completed = false;
+        tmp->pkt_count = 0;
+        tmp->base_seqno = tmp->min_seqno = tmp->max_seqno = pkt->seq;
+        tmp->playout_time =
+                tmp->arrival_time = std::chrono::high_resolution_clock::now();
+        tmp->rtp_time_us = rtp_time_us(playout_buf, pkt->ts);
+        if (playout_buf->adaptive && playout_buf->adaptive_delay_us >= 0) {
+                // scheduled by RTP timestamp, offset (if any) is added on top
+                tmp->playout_time = playout_buf->time_base + std::chrono::microseconds(tmp->rtp_time_us +
+                                playout_buf->adaptive_base_us + playout_buf->adaptive_delay_us +
+                                playout_delay_us - playout_buf->playout_delay_us);
+        } else {
                 tmp->playout_time += std::chrono::microseconds(playout_delay_us);
+        }
+
+        insert_coded_unit(tmp, pkt);
+
+        return tmp;
+}
+
+/**
+ * Frees packets of the node and keeps the node (with its packet array) for
+ * later use.
+ */
+static void release_pnode(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        for (auto & c : node->pkts) {
+                if (c.data != NULL) {
+                        rtp_packet_free(c.data);
+                }
+        }
+        node->pkts.clear();
+        if (playout_buf->node_pool.size() < PBUF_NODE_POOL_SIZE) {
+                playout_buf->node_pool.push_back(node);
+        } else {
+                delete node;
+        }
+}
+
+/**
+ * Updates the set of missing packets with received sequence number.
+ */
+static void arq_track(struct pbuf *playout_buf, uint16_t seq)
+{
+        if (playout_buf->arq_max_seq == -1) {
+                playout_buf->arq_max_seq = seq;
+                return;
+        }
 
-                tmp->cdata = (struct coded_data *) malloc(sizeof(struct coded_data));
-                if (tmp->cdata != NULL) {
-                        tmp->cdata->nxt = NULL;
-                        tmp->cdata->prv = NULL;
-                        tmp->cdata->seqno = pkt->seq;
-                        tmp->cdata->data = pkt;
+        int diff = (int16_t) (seq - (uint16_t) playout_buf->arq_max_seq);
+        if (diff > 0) {
+                if (diff > ARQ_MAX_GAP) {
+                        playout_buf->missing.clear();
                 } else {
-                        free(pkt);
-                        delete tmp;
-                        return NULL;
+                        auto now = std::chrono::high_resolution_clock::now();
+                        for (long long int i = playout_buf->arq_max_seq + 1;
+                                        i < playout_buf->arq_max_seq + diff; ++i) {
+                                playout_buf->missing[i] = { now, now, 0 };
+                        }
                 }
+                playout_buf->arq_max_seq += diff;
         } else {
-                free(pkt);
+                auto it = playout_buf->missing.find(playout_buf->arq_max_seq + diff);
+                if (it != playout_buf->missing.end()) {
+                        if (it->second.nack_count > 0) {
+                                playout_buf->recovered_pkts += 1;
+                        }
+                        playout_buf->missing.erase(it);
+                }
         }
-        return tmp;
 }
 
+static void pbuf_decode_immediate(struct pbuf *playout_buf);
+static void pbuf_insert_packet(struct pbuf *playout_buf, rtp_packet * pkt);
+
 void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
+{
+        if (playout_buf->immediate_func == NULL) {
+                pbuf_insert_packet(playout_buf, pkt);
+                return;
+        }
+
+        // frame is completed either by its last packet, by a packet of next
+        // frame or by a reordered packet filling a gap after the m-bit
+        pbuf_insert_packet(playout_buf, pkt);
+        pbuf_decode_immediate(playout_buf);
+}
+
+static void pbuf_insert_packet(struct pbuf *playout_buf, rtp_packet * pkt)
 {
         struct pbuf_node *tmp;
 
         pbuf_validate(playout_buf);
 
+        if (playout_buf->arq_budget_us > 0) {
+                arq_track(playout_buf, pkt->seq);
+        }
+
         // collect statistics
         if (playout_buf->last_rtp_seq == -1) {
                 playout_buf->last_rtp_seq = pkt->seq;
                 playout_buf->pkt_count[0] += 1;
+        } else if ((int16_t) (pkt->seq - playout_buf->last_rtp_seq) < 0) {
+                // late packet (eg. retransmission) of already evaluated interval
         } else {
                 if ((((int) pkt->seq - playout_buf->last_rtp_seq + (1<<16)) %
                                         (1<<16)) < STATS_INTERVAL * 2) {
@@ -337,15 +586,54 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                                 playout_buf->expected_pkts,
                                 (double) playout_buf->received_pkts /
                                 playout_buf->expected_pkts * 100.0);
+                if (playout_buf->adaptive && playout_buf->adaptive_delay_us >= 0) {
+                        log_msg(LOG_LEVEL_INFO, "SSRC %08x: adaptive playout delay %.1f ms.\n",
+                                        pkt->ssrc, playout_buf->adaptive_delay_us / 1000.0);
+                }
+                if (playout_buf->skipped_frames > 0) {
+                        log_msg(LOG_LEVEL_INFO, "SSRC %08x: %lld frames skipped to catch up "
+                                        "(cumulative).\n", pkt->ssrc, playout_buf->skipped_frames);
+                }
+                if (playout_buf->arq_budget_us > 0) {
+                        log_msg(LOG_LEVEL_INFO, "SSRC %08x: %lld packets requested, %lld "
+                                        "retransmitted, %lld not recovered in time "
+                                        "(cumulative).\n", pkt->ssrc,
+                                        playout_buf->nacked_pkts,
+                                        playout_buf->recovered_pkts,
+                                        playout_buf->lost_pkts);
+                }
+                if (playout_buf->interleaved) {
+                        log_msg(LOG_LEVEL_INFO, "SSRC %08x: %lld packets recovered by "
+                                        "interleaved parity (cumulative).\n", pkt->ssrc,
+                                        playout_buf->interleaved_recovered);
+                }
                 playout_buf->received_pkts_last = playout_buf->received_pkts;
                 playout_buf->expected_pkts_last = playout_buf->expected_pkts;
                 playout_buf->expected_pkts = playout_buf->received_pkts = 0;
                 playout_buf->last_display_ts = pkt->ts;
         }
 
+        // interleaved parity spans several frames, so the recovery cannot be
+        // done by the frame decoder - recovered packet is inserted as if received
+        if (pkt->pt == PT_VIDEO_INTERLEAVED) {
+                if (playout_buf->interleaved == NULL) {
+                        playout_buf->interleaved = fec_interleaved_rx_init();
+                }
+                rtp_packet *recovered = fec_interleaved_rx_recover(playout_buf->interleaved, pkt);
+                rtp_packet_free(pkt);
+                if (recovered) {
+                        playout_buf->interleaved_recovered += 1;
+                        pbuf_insert_packet(playout_buf, recovered);
+                }
+                return;
+        }
+        if (playout_buf->interleaved) {
+                fec_interleaved_rx_store(playout_buf->interleaved, pkt);
+        }
+
         if (playout_buf->frst == NULL && playout_buf->last == NULL) {
                 /* playout buffer is empty - add new frame */
-                playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                playout_buf->frst = create_new_pnode(playout_buf, pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
                 playout_buf->last = playout_buf->frst;
                 return;
         }
@@ -353,11 +641,11 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
         if (playout_buf->last->rtp_timestamp == pkt->ts) {
                 /* Packet belongs to last frame in playout_buf this is the */
                 /* most likely scenario - although...                      */
-                add_coded_unit(playout_buf->last, pkt);
+                insert_coded_unit(playout_buf->last, pkt);
         } else {
                 if (playout_buf->last->rtp_timestamp < pkt->ts) {
                         /* Packet belongs to a new frame... */
-                        tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                        tmp = create_new_pnode(playout_buf, pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
                         playout_buf->last->nxt = tmp;
                         playout_buf->last->completed = true;
                         tmp->prv = playout_buf->last;
@@ -377,7 +665,7 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                                 }
                                 if (curr->rtp_timestamp == pkt->ts) {
                                         /* Packet belongs to a previous existing frame... */
-                                        add_coded_unit(curr, pkt);
+                                        insert_coded_unit(curr, pkt);
                                 } else {
                                         /* Packet belongs to a frame that is not present */
                                         discard_pkt = true;
@@ -388,25 +676,13 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                                         debug_msg
                                                 ("Oops... dropped packet with M bit set\n");
                                 }
-                                free(pkt);
+                                rtp_packet_free(pkt);
                         }
                 }
         }
         pbuf_validate(playout_buf);
 }
 
-static void free_cdata(struct coded_data *head)
-{
-        struct coded_data *tmp;
-
-        while (head != NULL) {
-                free(head->data);
-                tmp = head;
-                head = head->nxt;
-                free(tmp);
-        }
-}
-
 void pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time)
 {
         /* Remove previously decoded frames that have passed their playout  */
@@ -420,7 +696,9 @@ void pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::t
         curr = playout_buf->frst;
         while (curr != NULL) {
                 temp = curr->nxt;
-                if (curr_time > curr->playout_time && frame_complete(curr)) {
+                if (curr_time > curr->playout_time && frame_complete(curr)
+                                && (curr->decoded || (!pbuf_frame_held(playout_buf, curr, curr_time)
+                                                && !arq_frame_pending(playout_buf, curr, curr_time)))) {
                         if (curr == playout_buf->frst) {
                                 playout_buf->frst = curr->nxt;
                         }
@@ -433,8 +711,10 @@ void pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::t
                         if (curr->prv != NULL) {
                                 curr->prv->nxt = curr->nxt;
                         }
-                        free_cdata(curr->cdata);
-                        delete curr;
+                        if (playout_buf->adaptive) {
+                                adaptive_playout_update(playout_buf, curr);
+                        }
+                        release_pnode(playout_buf, curr);
                 } else {
                         /* The playout buffer is stored in order, so once  */
                         /* we see one packet that has not yet reached it's */
@@ -449,6 +729,17 @@ void pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::t
         return;
 }
 
+/**
+ * Returns true if undecoded frame should be kept in the buffer because the
+ * decoder cannot accept frames at the moment.
+ */
+static bool pbuf_frame_held(struct pbuf *playout_buf, struct pbuf_node *frame,
+                std::chrono::high_resolution_clock::time_point const & curr_time)
+{
+        return playout_buf->decode_held &&
+                curr_time - frame->playout_time < std::chrono::milliseconds(PBUF_MAX_HOLD_MS);
+}
+
 static int frame_complete(struct pbuf_node *frame)
 {
         /* Return non-zero if the list of coded_data represents a    */
@@ -462,6 +753,34 @@ static int frame_complete(struct pbuf_node *frame)
         return (frame->mbit == 1 || frame->completed == true);
 }
 
+/**
+ * Returns true if a packet that may belong to the frame is missing and its
+ * retransmission can still arrive within the ARQ budget. Packets between two
+ * frames are attributed to the latter unless the former lacks the m-bit.
+ */
+static bool arq_frame_pending(struct pbuf *playout_buf, struct pbuf_node *frame,
+                std::chrono::high_resolution_clock::time_point const & curr_time)
+{
+        if (playout_buf->missing.empty()) {
+                return false;
+        }
+
+        uint16_t first = frame->prv ? frame->prv->max_seqno + 1 : frame->min_seqno;
+        uint16_t last = frame->max_seqno;
+        if (!frame->mbit && frame->nxt) {
+                last = frame->nxt->min_seqno - 1;
+        }
+
+        auto budget = std::chrono::microseconds(playout_buf->arq_budget_us);
+        for (auto const & m : playout_buf->missing) {
+                if ((uint16_t) (m.first - first) <= (uint16_t) (last - first) &&
+                                curr_time - m.second.detected < budget) {
+                        return true;
+                }
+        }
+        return false;
+}
+
 int pbuf_is_empty(struct pbuf *playout_buf)
 {
         if (playout_buf->frst == NULL)
@@ -470,6 +789,82 @@ int pbuf_is_empty(struct pbuf *playout_buf)
                 return FALSE;
 }
 
+/**
+ * @returns true if a frame following the given one can be decoded
+ */
+static bool newer_frame_ready(struct pbuf_node *frame,
+                std::chrono::high_resolution_clock::time_point const & curr_time)
+{
+        for (struct pbuf_node *curr = frame->nxt; curr != NULL; curr = curr->nxt) {
+                if (!curr->decoded && curr_time > curr->playout_time && frame_complete(curr)) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * Marks the frame as decoded unless the decoder asked for a retry.
+ */
+static int pbuf_decoded(struct pbuf *playout_buf, struct pbuf_node *frame, int ret)
+{
+        if (ret == PBUF_DECODE_RETRY) {
+                playout_buf->decode_held = true;
+                return 0;
+        }
+        playout_buf->decode_held = false;
+        frame->decoded = 1;
+        playout_buf->last_decoded_seq = frame->max_seqno;
+        return ret;
+}
+
+/**
+ * @returns true if no packet of the frame can be still on its way - seqnos
+ * of received packets are contiguous and follow the previous frame
+ */
+static bool frame_contiguous(struct pbuf *playout_buf, struct pbuf_node *frame)
+{
+        if (frame->pkt_count != (uint16_t) (frame->max_seqno - frame->min_seqno) + 1) {
+                return false;
+        }
+        long long int prev = frame->prv ? frame->prv->max_seqno : playout_buf->last_decoded_seq;
+        return prev < 0 || (uint16_t) (prev + 1) == frame->min_seqno;
+}
+
+/**
+ * Decodes complete frames in order regardless of their playout time, see
+ * pbuf_set_immediate_decode(). Stops at a frame that is incomplete (m-bit not
+ * seen or a packet missing, possibly only reordered) or waits for
+ * retransmission - it is then decoded by pbuf_decode().
+ */
+static void pbuf_decode_immediate(struct pbuf *playout_buf)
+{
+        auto curr_time = std::chrono::high_resolution_clock::now();
+        for (struct pbuf_node *curr = playout_buf->frst; curr != NULL; curr = curr->nxt) {
+                if (curr->decoded) {
+                        continue;
+                }
+                if (!frame_complete(curr) || !frame_contiguous(playout_buf, curr) ||
+                                arq_frame_pending(playout_buf, curr, curr_time)) {
+                        return;
+                }
+                struct pbuf_stats stats = { playout_buf->received_pkts_cum,
+                        playout_buf->expected_pkts_cum, playout_buf->skipped_frames };
+                int ret = playout_buf->immediate_func(link_coded_units(curr), playout_buf->immediate_data, &stats);
+                if (pbuf_decoded(playout_buf, curr, ret)) {
+                        playout_buf->immediate_decoded += 1;
+                }
+                if (!curr->decoded) { // retry
+                        return;
+                }
+        }
+}
+
+/**
+ * @returns number of frames decoded - either the count of frames decoded by
+ * pbuf_insert() since the last call (see pbuf_set_immediate_decode()) or 1 if
+ * a frame was decoded now, 0 otherwise
+ */
 int
 pbuf_decode(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time,
                              decode_frame_t decode_func, void *data)
@@ -481,17 +876,45 @@ pbuf_decode(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_p
 
         pbuf_validate(playout_buf);
 
+        if (playout_buf->immediate_decoded > 0) {
+                int decoded = playout_buf->immediate_decoded;
+                playout_buf->immediate_decoded = 0;
+                return decoded;
+        }
+
         curr = playout_buf->frst;
         while (curr != NULL) {
                 if (!curr->decoded 
                                 && curr_time > curr->playout_time
                    ) {
                         if (frame_complete(curr)) {
+                                if (arq_frame_pending(playout_buf, curr, curr_time)) {
+                                        // wait for retransmission, keep frame order
+                                        return 0;
+                                }
+                                if (playout_buf->latest_wins && newer_frame_ready(curr, curr_time) &&
+                                                (playout_buf->skippable == NULL ||
+                                                 playout_buf->skippable(playout_buf->skippable_udata))) {
+                                        debug_msg("Skipping frame (RTP TS=%u), newer one is ready\n",
+                                                        curr->rtp_timestamp);
+                                        curr->decoded = 1;
+                                        playout_buf->skipped_frames += 1;
+                                        curr = curr->nxt;
+                                        continue;
+                                }
+                                struct pbuf_stats stats = { playout_buf->received_pkts_cum,
+                                        playout_buf->expected_pkts_cum, playout_buf->skipped_frames };
+                                int ret = decode_func(link_coded_units(curr), data, &stats);
+                                return pbuf_decoded(playout_buf, curr, ret) ? 1 : 0;
+                        } else if (playout_buf->partial_deadline_us >= 0 && curr_time - curr->last_arrival >
+                                        std::chrono::microseconds(playout_buf->partial_deadline_us)) {
+                                debug_msg("Decoding incomplete frame (RTP TS=%u)\n", curr->rtp_timestamp);
                                 struct pbuf_stats stats = { playout_buf->received_pkts_cum,
-                                        playout_buf->expected_pkts_cum };
-                                int ret = decode_func(curr->cdata, data, &stats);
-                                curr->decoded = 1;
-                                return ret;
+                                        playout_buf->expected_pkts_cum, playout_buf->skipped_frames };
+                                // the frame stays in the buffer until completed so that
+                                // late packets of it are not taken for a new frame
+                                int ret = decode_func(link_coded_units(curr), data, &stats);
+                                return pbuf_decoded(playout_buf, curr, ret) ? 1 : 0;
                         } else {
                                 debug_msg
                                     ("Unable to decode frame due to missing data (RTP TS=%u)\n",
@@ -503,8 +926,142 @@ pbuf_decode(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_p
         return 0;
 }
 
+/**
+ * Cheap check whether pbuf_decode() would pass a frame to the decoder now.
+ * May return true even if the frame is then held back for retransmission.
+ */
+bool pbuf_decode_ready(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time)
+{
+        for (struct pbuf_node *curr = playout_buf->frst; curr != NULL; curr = curr->nxt) {
+                if (!curr->decoded && curr_time > curr->playout_time && (frame_complete(curr) ||
+                                        playout_buf->partial_deadline_us >= 0)) {
+                        return true;
+                }
+        }
+        return false;
+}
+
 void pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay)
 {
         playout_buf->playout_delay_us = playout_delay * 1000 * 1000;
 }
 
+/**
+ * Enables adaptive playout delay - frames are scheduled according to their RTP
+ * timestamps and the delay is continuously set to the percentile of measured
+ * frame completion lateness, bounded by min_ms and max_ms. Delay set by
+ * pbuf_set_playout_delay() is then not used (offset is still applied).
+ */
+void pbuf_set_adaptive_playout(struct pbuf *playout_buf, int min_ms, int max_ms, double percentile)
+{
+        if (playout_buf->adaptive) {
+                return;
+        }
+        playout_buf->adaptive = true;
+        playout_buf->adaptive_min_us = min_ms * 1000ll;
+        playout_buf->adaptive_max_us = std::max(min_ms, max_ms) * 1000ll;
+        playout_buf->adaptive_percentile = std::max(0.0, std::min(100.0, percentile));
+        playout_buf->adaptive_delay_us = -1;
+        playout_buf->transit.resize(ADAPTIVE_WINDOW);
+        playout_buf->transit_count = 0;
+}
+
+/**
+ * @returns current playout delay in seconds - the adaptive delay if enabled
+ * and already computed, otherwise the fixed one
+ */
+double pbuf_get_playout_delay(struct pbuf *playout_buf)
+{
+        if (playout_buf->adaptive && playout_buf->adaptive_delay_us >= 0) {
+                return playout_buf->adaptive_delay_us / 1000000.0;
+        }
+        return playout_buf->playout_delay_us / 1000000.0;
+}
+
+/**
+ * Enables decoding of frames directly from pbuf_insert() as soon as they are
+ * complete, bypassing playout delay. decode_func is then called from the
+ * thread inserting packets. Frames that cannot be decoded immediately (eg.
+ * waiting for retransmission) are left for pbuf_decode(). Passing NULL as
+ * decode_func disables it.
+ */
+void pbuf_set_immediate_decode(struct pbuf *playout_buf, decode_frame_t *decode_func, void *data)
+{
+        playout_buf->immediate_func = decode_func;
+        playout_buf->immediate_data = data;
+}
+
+/**
+ * If enabled, pbuf_decode() skips complete frames that are ready to be decoded
+ * when a newer frame is ready as well, so that a decoder that cannot keep up
+ * with the stream always gets the most recent frame.
+ *
+ * @param skippable  called before skipping a frame, the frame is not skipped
+ *                   if it returns false (NULL - frames are always skippable)
+ */
+void pbuf_set_latest_wins(struct pbuf *playout_buf, bool enable, pbuf_skippable_t *skippable, void *udata)
+{
+        playout_buf->latest_wins = enable;
+        playout_buf->skippable = skippable;
+        playout_buf->skippable_udata = udata;
+}
+
+/**
+ * Enables decoding of frames that are not complete (the m-bit was not received
+ * and the next frame hasn't started yet) when their playout time has passed and
+ * no packet of the frame has arrived for deadline_ms. Negative value disables it.
+ */
+void pbuf_set_partial_decode(struct pbuf *playout_buf, int deadline_ms)
+{
+        playout_buf->partial_deadline_us = deadline_ms < 0 ? -1 : deadline_ms * 1000ll;
+}
+
+/**
+ * Enables (budget_ms > 0) or disables tracking of lost packets. With ARQ enabled,
+ * frames with missing packets are held back until the packets are retransmitted
+ * or their budget expires.
+ */
+void pbuf_set_arq(struct pbuf *playout_buf, int budget_ms)
+{
+        if (playout_buf->arq_budget_us == budget_ms * 1000ll) {
+                return;
+        }
+        playout_buf->arq_budget_us = budget_ms * 1000ll;
+        playout_buf->arq_max_seq = -1;
+        playout_buf->missing.clear();
+}
+
+/**
+ * Returns sequence numbers of lost packets whose retransmission should be
+ * requested now - newly detected losses immediately, unanswered ones again
+ * after a quarter of the budget. Losses older than the budget are given up.
+ *
+ * @returns number of sequence numbers written to seqs (in ascending order)
+ */
+int pbuf_get_nacks(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time,
+                uint16_t *seqs, int max_count)
+{
+        int count = 0;
+        auto budget = std::chrono::microseconds(playout_buf->arq_budget_us);
+        auto retry = std::chrono::microseconds(std::max<long long int>(playout_buf->arq_budget_us / 4,
+                                ARQ_MIN_RETRY_US));
+
+        for (auto it = playout_buf->missing.begin(); it != playout_buf->missing.end(); ) {
+                auto & m = it->second;
+                if (curr_time - m.detected > budget) {
+                        playout_buf->lost_pkts += 1;
+                        it = playout_buf->missing.erase(it);
+                        continue;
+                }
+                if (count < max_count && (m.nack_count == 0 || curr_time - m.last_nack > retry)) {
+                        if (m.nack_count == 0) {
+                                playout_buf->nacked_pkts += 1;
+                        }
+                        seqs[count++] = it->first;
+                        m.nack_count += 1;
+                        m.last_nack = curr_time;
+                }
+                ++it;
+        }
+        return count;
+}
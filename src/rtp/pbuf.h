@@ -72,7 +72,8 @@
 extern "C" {
 #endif
 
-/* The coded representation of a single frame */
+/* The coded representation of a single frame - packets are linked in descending */
+/* seqno order, the entries of a frame are stored contiguously by the pbuf.       */
 struct coded_data {
         struct coded_data       *nxt;
         struct coded_data       *prv;
@@ -83,6 +84,7 @@ struct coded_data {
 struct pbuf_stats {
         long long int received_pkts_cum;
         long long int expected_pkts_cum;
+        long long int skipped_frames_cum; ///< frames not passed to decoder (see pbuf_set_latest_wins())
 };
 
 /* The playout buffer */
@@ -108,10 +110,23 @@ struct pbuf_audio_data {
         bool reconfigured;
 };
 
+/**
+ * Returned by decode_frame_t if the frame cannot be processed now (eg. the
+ * decoder is being reconfigured). The frame and the following ones are kept
+ * in the buffer and the frame is passed again in next pbuf_decode() call.
+ */
+#define PBUF_DECODE_RETRY (-1)
+
 /**
  * @param decode_data
+ * @returns non-zero if the frame was decoded or @ref PBUF_DECODE_RETRY
  */
 typedef int decode_frame_t(struct coded_data *cdata, void *decode_data, struct pbuf_stats *stats);
+/**
+ * @returns whether frames of the stream may be skipped (eg. not for
+ *          inter-frame codecs where following frames depend on them)
+ */
+typedef bool pbuf_skippable_t(void *udata);
 
 /* 
  * External C interface: 
@@ -135,7 +150,16 @@ int 	 	 pbuf_decode(struct pbuf *playout_buf, std::chrono::high_resolution_clock
                              decode_frame_t decode_func, void *data);
                              //struct video_frame *framebuffer, int i, struct state_decoder *decoder);
 void		 pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time);
+bool		 pbuf_decode_ready(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time);
 void		 pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay);
+void		 pbuf_set_adaptive_playout(struct pbuf *playout_buf, int min_ms, int max_ms, double percentile);
+double		 pbuf_get_playout_delay(struct pbuf *playout_buf);
+void		 pbuf_set_partial_decode(struct pbuf *playout_buf, int deadline_ms);
+void		 pbuf_set_latest_wins(struct pbuf *playout_buf, bool enable, pbuf_skippable_t *skippable, void *udata);
+void		 pbuf_set_immediate_decode(struct pbuf *playout_buf, decode_frame_t *decode_func, void *data);
+void		 pbuf_set_arq(struct pbuf *playout_buf, int budget_ms);
+int		 pbuf_get_nacks(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time,
+                             uint16_t *seqs, int max_count);
 
 #endif
 
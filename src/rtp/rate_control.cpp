@@ -0,0 +1,277 @@
+/**
+ * @file   rtp/rate_control.cpp
+ * @brief  Equation-based (TFRC-like) sending rate control driven by RTCP receiver reports.
+ *
+ * The sender side of TFRC (RFC 5348) computed from regular RTCP report blocks
+ * instead of dedicated feedback packets. From consecutive reports of a receiver
+ * we get the receive rate and the number of lost packets. Feedback intervals
+ * containing a loss are treated as loss events and the loss event rate is derived
+ * from the weighted average of the last loss intervals. RTT is taken from the
+ * LSR/DLSR fields. Until the first loss the rate is doubled every RTT, bounded
+ * by twice the receive rate, then it follows the TCP throughput equation.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+#include "debug.h"
+#include "ntp.h"
+#include "rtp/rate_control.h"
+
+#define DEFAULT_RTT 0.1              ///< s, used until measured
+#define LOSS_INTERVALS 8             ///< RFC 5348 n
+#define NOFEEDBACK_MIN_SEC 0.5       ///< lower bound of the no-feedback timer
+#define RECEIVER_TIMEOUT_SEC 10      ///< receivers silent for longer are forgotten
+#define MIN_REPORT_INTERVAL_SEC 0.01 ///< closer reports are merged with the following one
+#define MOD_NAME "[TFRC] "
+
+using namespace std;
+using clk = chrono::steady_clock;
+
+static const double loss_interval_weights[LOSS_INTERVALS] = { 1.0, 1.0, 1.0, 1.0, 0.8, 0.6, 0.4, 0.2 };
+
+namespace {
+struct rc_receiver {
+        clk::time_point last_report;
+        clk::time_point last_increase;
+        clk::time_point nofeedback_deadline;
+        uint32_t last_seq = 0;
+        int32_t total_lost = 0;
+        uint32_t last_report_ntp = 0;           ///< LSR + DLSR of the last report (0 if unknown)
+        double rtt = DEFAULT_RTT;
+        bool rtt_measured = false;
+        double report_interval = 0.0;           ///< average interval between reports (s)
+        double x = 0.0;                         ///< allowed rate (bps), 0 before first estimate
+        double x_recv = 0.0;                    ///< receive rate (bps)
+        long long cur_interval = 0;             ///< packets since last loss event (I_0)
+        long long intervals[LOSS_INTERVALS] {}; ///< closed loss intervals, most recent first
+        int interval_count = 0;
+};
+}
+
+struct rate_control {
+        mutex lock;
+        double min_rate;
+        double max_rate;
+        int packet_size;
+        map<uint32_t, rc_receiver> receivers;
+};
+
+/// Sign-extends the 24-bit cumulative number of packets lost.
+static int32_t total_lost_value(uint32_t total_lost)
+{
+        return (int32_t) (total_lost << 8) >> 8;
+}
+
+static double loss_event_rate(const rc_receiver &r)
+{
+        if (r.interval_count == 0) {
+                return 0.0;
+        }
+        // RFC 5348 section 5.4 - the open interval is counted only if it increases the mean
+        double i_tot0 = 0.0, i_tot1 = 0.0, w_tot = 0.0;
+        for (int i = 0; i < r.interval_count; ++i) {
+                i_tot0 += (i == 0 ? r.cur_interval : r.intervals[i - 1]) * loss_interval_weights[i];
+                i_tot1 += r.intervals[i] * loss_interval_weights[i];
+                w_tot += loss_interval_weights[i];
+        }
+        double i_mean = max(1.0, max(i_tot0, i_tot1) / w_tot);
+        return 1.0 / i_mean;
+}
+
+/// TCP throughput equation (RFC 5348 section 3.1) with b = 1 and t_RTO = 4 * R, in bps
+static double throughput_equation(double s, double rtt, double p)
+{
+        double denominator = rtt * sqrt(2.0 * p / 3.0) +
+                4.0 * rtt * (3.0 * sqrt(3.0 * p / 8.0) * p * (1.0 + 32.0 * p * p));
+        return s * 8.0 / denominator;
+}
+
+/// RFC 5348 uses 4 * RTT, we also take the actual feedback frequency into account.
+static clk::time_point nofeedback_deadline(const rc_receiver &r, clk::time_point now)
+{
+        double timeout = max(max(4.0 * r.rtt, 2.0 * r.report_interval), NOFEEDBACK_MIN_SEC);
+        return now + chrono::duration_cast<clk::duration>(chrono::duration<double>(timeout));
+}
+
+/**
+ * Reports from a receiver may arrive in bursts (eg. if the sending thread reads
+ * RTCP only between frames), so the receiver's time of the report is used if
+ * known. LSR + DLSR is the time of the report shifted by one-way delay.
+ */
+static double report_interval(const rc_receiver &r, const rtcp_rr *rr, clk::time_point now)
+{
+        if (rr->lsr != 0 && r.last_report_ntp != 0) {
+                return (int32_t) (rr->lsr + rr->dlsr - r.last_report_ntp) / 65536.0;
+        }
+        return chrono::duration_cast<chrono::duration<double>>(now - r.last_report).count();
+}
+
+static void update_rtt(rc_receiver &r, const rtcp_rr *rr)
+{
+        if (rr->lsr == 0) {
+                return;
+        }
+        uint32_t ntp_sec, ntp_frac;
+        ntp64_time(&ntp_sec, &ntp_frac);
+        uint32_t rtt_ntp = ntp64_to_ntp32(ntp_sec, ntp_frac) - rr->lsr - rr->dlsr;
+        double sample = rtt_ntp / 65536.0;
+        if (sample <= 0.0 || sample > RECEIVER_TIMEOUT_SEC) {
+                return;
+        }
+        r.rtt = r.rtt_measured ? 0.9 * r.rtt + 0.1 * sample : sample;
+        r.rtt_measured = true;
+}
+
+struct rate_control *rate_control_init(long long min_bitrate, long long max_bitrate, int packet_size)
+{
+        auto rc = new rate_control();
+        rc->min_rate = min_bitrate;
+        rc->max_rate = max_bitrate;
+        rc->packet_size = packet_size;
+        return rc;
+}
+
+void rate_control_done(struct rate_control *rc)
+{
+        delete rc;
+}
+
+void rate_control_report(struct rate_control *rc, uint32_t reporter_ssrc, const rtcp_rr *rr)
+{
+        lock_guard<mutex> lk(rc->lock);
+        auto now = clk::now();
+        auto it = rc->receivers.find(reporter_ssrc);
+        if (it == rc->receivers.end()) {
+                rc_receiver &r = rc->receivers[reporter_ssrc];
+                r.last_report = r.last_increase = now;
+                r.last_seq = rr->last_seq;
+                r.total_lost = total_lost_value(rr->total_lost);
+                r.last_report_ntp = rr->lsr != 0 ? rr->lsr + rr->dlsr : 0;
+                update_rtt(r, rr);
+                return;
+        }
+        rc_receiver &r = it->second;
+        update_rtt(r, rr);
+
+        double dt = report_interval(r, rr, now);
+        int32_t expected = rr->last_seq - r.last_seq;
+        int32_t total_lost = total_lost_value(rr->total_lost);
+        if (expected < 0 || dt < 0.0) { // sender restarted or reordered report
+                r.last_seq = rr->last_seq;
+                r.total_lost = total_lost;
+                r.last_report_ntp = rr->lsr != 0 ? rr->lsr + rr->dlsr : 0;
+                r.last_report = now;
+                return;
+        }
+        if (dt < MIN_REPORT_INTERVAL_SEC) {
+                return;
+        }
+        int32_t lost = min(max(total_lost - r.total_lost, 0), expected);
+        r.last_seq = rr->last_seq;
+        r.total_lost = total_lost;
+        r.last_report_ntp = rr->lsr != 0 ? rr->lsr + rr->dlsr : 0;
+        r.last_report = now;
+        r.report_interval = r.report_interval == 0.0 ? dt : 0.8 * r.report_interval + 0.2 * dt;
+        r.x_recv = (double) (expected - lost) * rc->packet_size * 8.0 / dt;
+
+        // all losses within one feedback interval form a single loss event
+        if (lost > 0) {
+                copy_backward(r.intervals, r.intervals + LOSS_INTERVALS - 1, r.intervals + LOSS_INTERVALS);
+                r.intervals[0] = r.cur_interval + expected - lost;
+                r.interval_count = min(r.interval_count + 1, LOSS_INTERVALS);
+                r.cur_interval = 0;
+        } else {
+                r.cur_interval += expected;
+        }
+
+        double p = loss_event_rate(r);
+        double x;
+        if (p > 0.0) {
+                x = min(throughput_equation(rc->packet_size, r.rtt, p), 2.0 * r.x_recv);
+        } else if (r.x == 0.0) {
+                x = 2.0 * r.x_recv;
+        } else if (now - r.last_increase >= chrono::duration<double>(r.rtt)) { // slow start
+                x = min(2.0 * r.x, 2.0 * r.x_recv);
+                r.last_increase = now;
+        } else {
+                x = r.x;
+        }
+        x = max(x, rc->min_rate);
+        if (rc->max_rate > 0.0) {
+                x = min(x, rc->max_rate);
+        }
+        r.x = x;
+        r.nofeedback_deadline = nofeedback_deadline(r, now);
+
+        debug_msg(MOD_NAME "receiver 0x%08x: recv rate %.2f Mbps, RTT %.2f ms, p %f, rate %.2f Mbps\n",
+                        reporter_ssrc, r.x_recv / 1000000.0, r.rtt * 1000.0, p, x / 1000000.0);
+}
+
+long long rate_control_get_rate(struct rate_control *rc)
+{
+        lock_guard<mutex> lk(rc->lock);
+        auto now = clk::now();
+        double rate = 0.0;
+        for (auto it = rc->receivers.begin(); it != rc->receivers.end(); ) {
+                rc_receiver &r = it->second;
+                if (now - r.last_report > chrono::seconds(RECEIVER_TIMEOUT_SEC)) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "No feedback from receiver 0x%08x, removing.\n", it->first);
+                        it = rc->receivers.erase(it);
+                        continue;
+                }
+                if (r.x > 0.0 && now > r.nofeedback_deadline) { // feedback lost - halve the rate
+                        r.x = max(r.x / 2.0, rc->min_rate);
+                        r.nofeedback_deadline = nofeedback_deadline(r, now);
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Feedback from receiver 0x%08x timed out, "
+                                        "decreasing rate to %.2f Mbps.\n", it->first, r.x / 1000000.0);
+                }
+                if (r.x > 0.0 && (rate == 0.0 || r.x < rate)) {
+                        rate = r.x;
+                }
+                ++it;
+        }
+        return rate;
+}
+
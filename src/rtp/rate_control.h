@@ -0,0 +1,72 @@
+/**
+ * @file   rtp/rate_control.h
+ * @brief  Equation-based (TFRC-like) sending rate control driven by RTCP receiver reports.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_RATE_CONTROL_H_
+#define RTP_RATE_CONTROL_H_
+
+#include "rtp/rtp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rate_control;
+
+/**
+ * @param min_bitrate  rate that is never undercut (bps)
+ * @param max_bitrate  upper bound of the rate (bps), 0 for none
+ * @param packet_size  nominal size of sent packets (bytes)
+ */
+struct rate_control *rate_control_init(long long min_bitrate, long long max_bitrate, int packet_size);
+void rate_control_done(struct rate_control *rc);
+
+/**
+ * Processes a report block from a receiver. May be called from any thread.
+ */
+void rate_control_report(struct rate_control *rc, uint32_t reporter_ssrc, const rtcp_rr *rr);
+/**
+ * @returns allowed sending rate in bps (minimum over all receivers) or 0 if
+ * there has been no feedback yet
+ */
+long long rate_control_get_rate(struct rate_control *rc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_RATE_CONTROL_H_
+
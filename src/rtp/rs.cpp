@@ -41,11 +41,16 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
 #include <bitset>
 #include <stdlib.h>
+#include <thread>
+#include "debug.h"
+#include "host.h"
 #include "rtp/rs.h"
 #include "rtp/rtp_callback.h"
 #include "transmit.h"
+#include "utils/worker.h"
 #include "video.h"
 
 #define DEFAULT_K 128
@@ -54,6 +59,9 @@
 #define MAX_K 255
 #define MAX_N 255
 
+#define MAX_RS_THREADS 64
+#define MIN_RS_STRIPE 4096 ///< minimal part of a symbol coded by one thread
+
 extern "C" {
 #include "rs/fec.h"
 }
@@ -62,14 +70,84 @@ static void usage();
 
 using namespace std;
 
+ADD_TO_PARAM(rs_threads, "rs-threads",
+                "* rs-threads=<n>\n"
+                "  Number of threads used for Reed-Solomon coding of a frame (default number\n"
+                "  of CPU cores).\n");
+
+namespace {
+/**
+ * Byte range [start, start + len) of all symbols. RS codes every byte column
+ * independently, so stripes can be coded in parallel.
+ */
+struct rs_stripe_task {
+        const fec_t *state;
+        bool decode;
+        const gf *const *in;    ///< k input symbols
+        gf *const *out;         ///< out_count output symbols
+        const unsigned *index;  ///< block numbers of in (decode) or out (encode)
+        unsigned out_count;
+        size_t start;
+        size_t len;
+};
+}
+
+static void *rs_stripe_task_callback(void *arg)
+{
+        auto t = (struct rs_stripe_task *) arg;
+        const gf *in[MAX_N];
+        gf *out[MAX_N];
+        for (unsigned int i = 0; i < t->state->k; ++i) {
+                in[i] = t->in[i] + t->start;
+        }
+        for (unsigned int i = 0; i < t->out_count; ++i) {
+                out[i] = t->out[i] + t->start;
+        }
+        if (t->decode) {
+                fec_decode(t->state, in, out, t->index, t->len);
+        } else {
+                fec_encode(t->state, in, out, t->index, t->out_count, t->len);
+        }
+        return NULL;
+}
+
+/**
+ * Runs fec_encode() or fec_decode() over symbols of size ss split into stripes
+ * coded by up to threads workers.
+ */
+static void rs_code_striped(struct rs_stripe_task task, size_t ss, int threads)
+{
+        int stripes = max<int>(1, min<size_t>({(size_t) threads, ss / MIN_RS_STRIPE, MAX_RS_THREADS}));
+
+        struct rs_stripe_task tasks[MAX_RS_THREADS];
+        task_result_handle_t handles[MAX_RS_THREADS];
+        size_t start = 0;
+        for (int i = 0; i < stripes; ++i) {
+                // keep stripe boundaries aligned for the SIMD kernels
+                size_t end = i == stripes - 1 ? ss : ss * (i + 1) / stripes / 64 * 64;
+                tasks[i] = task;
+                tasks[i].start = start;
+                tasks[i].len = end - start;
+                start = end;
+        }
+
+        // the calling thread takes the first stripe itself
+        for (int i = 1; i < stripes; ++i) {
+                handles[i] = task_run_async(rs_stripe_task_callback, &tasks[i]);
+        }
+        rs_stripe_task_callback(&tasks[0]);
+        for (int i = 1; i < stripes; ++i) {
+                wait_task(handles[i]);
+        }
+}
+
 rs::rs(unsigned int k, unsigned int n)
         : m_k(k), m_n(n)
 {
         assert (k <= MAX_K);
         assert (n <= MAX_N);
         assert (m_k <= m_n);
-        state = fec_new(m_k, m_n);
-        assert(state != NULL);
+        init();
 }
 
 rs::rs(const char *c_cfg)
@@ -96,8 +174,22 @@ rs::rs(const char *c_cfg)
                 throw 1;
         }
 
+        init();
+}
+
+void rs::init()
+{
         state = fec_new(m_k, m_n);
         assert(state != NULL);
+
+        m_threads = thread::hardware_concurrency();
+        if (get_commandline_param("rs-threads")) {
+                m_threads = atoi(get_commandline_param("rs-threads"));
+        }
+        m_threads = max(1, min(m_threads, MAX_RS_THREADS));
+
+        log_msg(LOG_LEVEL_VERBOSE, "[RS] Using %s GF(2^8) arithmetic, %d thread(s).\n",
+                        fec_simd_name(fec_get_simd()), m_threads);
 }
 
 rs::~rs()
@@ -113,53 +205,48 @@ shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
         size_t len = in->tiles[0].data_len;
         char *data = in->tiles[0].data;
 
-        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in.get()));
-      
         //int encode(char *hdr, int hdr_len, char *in, int len, char **out) {
         int ss = get_ss(hdr_len, len);
         int buffer_len = ss * m_n;
-        char *out_data;
-        out_data = out->tiles[0].data = (char *) malloc(buffer_len);
+
+        struct video_desc desc = video_desc_from_frame(in.get());
+        if (m_pool_len < buffer_len || !video_desc_eq(desc, m_pool_desc)) {
+                // some headroom for compressed frames that vary in size
+                m_pool_len = buffer_len + buffer_len / 8;
+                m_pool_desc = desc;
+                m_pool->reconfigure(desc, m_pool_len);
+        }
+        auto pool = m_pool;
+        shared_ptr<video_frame> pooled = pool->get_frame();
+        // the frame returns to the pool first, pool is released afterwards
+        shared_ptr<video_frame> out(pooled.get(), [pool, pooled](struct video_frame *) mutable {
+                        pooled.reset();
+                        });
+        char *out_data = out->tiles[0].data;
         uint32_t len32 = len + hdr_len;
         memcpy(out_data, &len32, sizeof(len32));
         memcpy(out_data + sizeof(len32), hdr, hdr_len);
         memcpy(out_data + sizeof(len32) + hdr_len, data, len);
         memset(out_data + sizeof(len32) + hdr_len + len, 0, ss * m_k - (sizeof(len32) + hdr_len + len));
 
-#if 0
-        void *src[m_k];
-        for (int k = 0; k < m_k; ++k) {
-                src[k] = *out + ss * k;
-        }
-
-        for (int m = 0; m < m_n - m_k; ++m) {
-                fec_encode(state, src, *out + ss * (m_k + m), m, ss);
-        }
-#else
-        void *src[m_k];
+        const gf *src[MAX_K];
         for (unsigned int k = 0; k < m_k; ++k) {
-                src[k] = out_data + ss * k;
+                src[k] = (gf *) out_data + ss * k;
         }
-        void *dst[m_n-m_k];
-        unsigned int dst_idx[m_n-m_k];
+        gf *dst[MAX_N];
+        unsigned int dst_idx[MAX_N];
         for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                dst[m] = out_data + ss * (m_k + m);
+                dst[m] = (gf *) out_data + ss * (m_k + m);
                 dst_idx[m] = m_k + m;
         }
 
-        fec_encode((const fec_t *)state, (const gf *const *const) src,
-                        (gf *const *const) dst, dst_idx, m_n-m_k, ss);
-#endif
+        rs_code_striped(rs_stripe_task{(const fec_t *) state, false, src, dst, dst_idx, m_n - m_k, 0, 0},
+                        ss, m_threads);
 
         out->tiles[0].data_len = buffer_len;
         out->fec_params = fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss);
 
-        return {out,
-                [](video_frame *frame) {
-                        free(frame->tiles[0].data);
-                        vf_free(frame);
-                }
-        };
+        return out;
 }
 
 int rs::get_ss(int hdr_len, int len) {
@@ -167,9 +254,8 @@ int rs::get_ss(int hdr_len, int len) {
 }
 
 void rs::decode(const char *in, int in_len, char **out, int *len,
-                std::map<int, int> const & c_m)
+                received_ranges const & packets)
 {
-        std::map<int, int> m = c_m; // make private copy
         unsigned int ss = in_len / m_n;
         void *pkt[m_n];
         unsigned int index[m_n];
@@ -179,7 +265,7 @@ void rs::decode(const char *in, int in_len, char **out, int *len,
         ///fprintf(stderr, "%d\n\n%d\n%d\n", in_len, malloc_usable_size((void *)in), sizeof(short));
 
 
-        for (auto it = m.begin(); it != m.end(); ++it) {
+        for (auto it = packets.intervals().begin(); it != packets.intervals().end(); ++it) {
                 int start = it->first;
                 int offset = it->second;
 
@@ -214,24 +300,13 @@ void rs::decode(const char *in, int in_len, char **out, int *len,
         *len = out_sz;
         *out = (char *) in + 4;
 #else
-        for (auto it = m.begin(); it != m.end(); ++it) {
-                int start = it->first;
-                int size = it->second;
-
-                while (m.find(start + size) != m.end()) {
-                        auto item = m.find(start + size);
-                        it->second += m[start + size];
-                        size = it->second;
-                        m.erase(item);
-                }
-        }
-
         //const unsigned int bitset_size = m_k;
 
         std::bitset<MAX_K> empty_slots;
         std::bitset<MAX_K> repaired_slots;
 
-        for (auto it = m.begin(); it != m.end(); ++it) {
+        // intervals are already merged
+        for (auto it = packets.intervals().begin(); it != packets.intervals().end(); ++it) {
                 int start = it->first;
                 int size = it->second;
 
@@ -270,26 +345,20 @@ void rs::decode(const char *in, int in_len, char **out, int *len,
                 return;
         }
 
-        char **output = (char **) malloc(m_k * sizeof(char *));
-        for (unsigned int i = 0; i < m_k; ++i) {
-                output[i] = (char *) malloc(ss);
-        }
-
-        fec_decode((const fec_t *) state, (const gf *const *const) pkt,
-                        (gf *const *const) output, index, ss);
-
-        i = 0;
+        // Missing data symbols are not read by the decoder (their slots
+        // are filled with parity), so they can be repaired in place.
+        gf *output[MAX_K];
+        unsigned int repaired = 0;
         for (unsigned int j = 0; j < m_k; ++j) {
                 if (repaired_slots.test(j)) {
-                        memcpy((void *) (in + j * ss), output[i], ss);
-                        i++;
+                        output[repaired++] = (gf *) in + j * ss;
                 }
         }
 
-        for (unsigned int i = 0; i < m_k; ++i) {
-                free(output[i]);
+        if (repaired > 0) {
+                rs_code_striped(rs_stripe_task{(const fec_t *) state, true, (const gf *const *) pkt,
+                                output, index, repaired, 0, 0}, ss, m_threads);
         }
-        free(output);
 
         uint32_t out_sz;
         memcpy(&out_sz, in, sizeof(out_sz));
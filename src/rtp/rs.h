@@ -38,10 +38,10 @@
 #ifndef __RS_H__
 #define __RS_H__
 
-#include <map>
 #include <memory>
 
 #include "fec.h"
+#include "utils/video_frame_pool.h"
 
 struct video_frame;
 
@@ -51,12 +51,21 @@ struct rs : public fec {
         virtual ~rs();
         std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame> frame);
         void decode(const char *in, int in_len, char **out, int *len,
-                const std::map<int, int> &);
+                const received_ranges &);
 
 private:
+        void init();
         int get_ss(int hdr_len, int len);
         void *state;
         unsigned int m_k, m_n;
+        int m_threads;                                  ///< stripes coded in parallel
+
+        /// encoded frames, shared with frames given out so that FEC may be
+        /// reconfigured (and rs destroyed) while a frame is still being sent
+        std::shared_ptr<video_frame_pool<default_data_allocator>> m_pool =
+                std::make_shared<video_frame_pool<default_data_allocator>>();
+        struct video_desc m_pool_desc;
+        int m_pool_len = 0;
 };
 
 #endif /* __RS_H__ */
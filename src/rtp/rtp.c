@@ -126,6 +126,8 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
 #define RTCP_BYE  203
 #define RTCP_APP  204
 #define RTCP_RX   205
+#define RTCP_RTPFB 205         /* RFC 4585 transport layer feedback, shares PT with RX */
+#define RTCP_RTPFB_NACK 1      /* generic NACK FMT */
 
 typedef struct {
 #ifdef WORDS_BIGENDIAN
@@ -316,6 +318,13 @@ struct rtp {
         rtp_callback callback;
         struct msghdr *mhdr;
         bool mt_recv; /* whether the receiver uses separate thread for receiving */
+        struct rtp *sender_parent; /* session owning sequence numbers and statistics (sender clones only) */
+        rtp_send_hook send_hook;
+        void *send_hook_udata;
+        rtp_nack_callback nack_callback;
+        void *nack_callback_udata;
+        rtp_rr_callback rr_callback;
+        void *rr_callback_udata;
         uint32_t magic;         /* For debugging...  */
 };
 
@@ -1144,6 +1153,7 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
         session->tfrc_on = tfrc_on;
         session->rtp_bcount = 0;
         session->rtp_bytes_sent = 0;
+        session->sender_parent = NULL;
         gettimeofday(&(session->last_update), NULL);
         gettimeofday(&(session->last_rtcp_send_time), NULL);
         gettimeofday(&(session->next_rtcp_send_time), NULL);
@@ -1237,6 +1247,7 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
         session->tfrc_on = tfrc_on;
         session->rtp_bcount = 0;
         session->rtp_bytes_sent = 0;
+        session->sender_parent = NULL;
         gettimeofday(&(session->last_update), NULL);
         gettimeofday(&(session->last_rtcp_send_time), NULL);
         gettimeofday(&(session->next_rtcp_send_time), NULL);
@@ -1528,6 +1539,15 @@ int rtp_send_raw_rtp_data(struct rtp *session, char *data, int buflen)
         return udp_send(session->rtp_socket, data, buflen);
 }
 
+/**
+ * Releases a RTP packet passed to the application with RX_RTP event
+ * (packets are allocated from a pool shared with the network layer).
+ */
+void rtp_packet_free(rtp_packet *packet)
+{
+        udp_packet_free((char *) packet);
+}
+
 static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
 {
         int buflen;
@@ -1541,7 +1561,7 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
                 buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
         } else {
                 if (!session->opt->reuse_bufs || (packet == NULL)) {
-                        packet = (rtp_packet *) malloc(RTP_MAX_PACKET_LEN + (session->opt->record_source ? sizeof(struct sockaddr_storage) : 0));
+                        packet = (rtp_packet *) udp_packet_alloc();
                         buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
                 }
                 struct sockaddr_storage *sin = NULL;
@@ -1555,7 +1575,7 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
                                         RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
                                         (struct sockaddr *) sin, &addrlen);
                 if (buflen <= 0) {
-                        free(packet);
+                        rtp_packet_free(packet);
                 }
         }
 
@@ -1667,7 +1687,7 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                 }
 
                 if (!session->opt->reuse_bufs) {
-                        free(packet);
+                        rtp_packet_free(packet);
                 }
         }
 }
@@ -1886,6 +1906,10 @@ static void process_report_blocks(struct rtp *session, rtcp_t * packet,
                         /* Create a database entry for this SSRC, if one doesn't already exist... */
                         create_source(session, rr->ssrc, FALSE);
 
+                        if (session->rr_callback && rr->ssrc == session->my_ssrc) {
+                                session->rr_callback(session, session->rr_callback_udata, ssrc, rr);
+                        }
+
                         /* Store the RR for later use... */
                         insert_rr(session, ssrc, rr, rx);
 
@@ -1991,6 +2015,36 @@ static void process_rtcp_rx(struct rtp *session, rtcp_t * packet)
         }
 }
 
+static void process_rtcp_nack(struct rtp *session, rtcp_t * packet)
+{
+        /* Generic NACK (RFC 4585, section 6.2.1) - after the common header there */
+        /* is SSRC of packet sender, SSRC of media source and a list of FCI words */
+        /* each containing PID (lost packet) and a bitmask of following losses.   */
+        uint32_t *words = (uint32_t *) packet;
+        int len = ntohs(packet->common.length); /* in 32-bit words without header */
+        int i, j;
+
+        if (len < 2) {
+                debug_msg("Bogus RTCP NACK packet: too short\n");
+                return;
+        }
+        if (ntohl(words[2]) != session->my_ssrc || session->nack_callback == NULL) {
+                return;
+        }
+        for (i = 3; i <= len; i++) {
+                uint32_t fci = ntohl(words[i]);
+                uint16_t pid = fci >> 16;
+                uint16_t blp = fci & 0xffff;
+                session->nack_callback(session, session->nack_callback_udata, pid);
+                for (j = 0; j < 16; j++) {
+                        if (blp & (1 << j)) {
+                                session->nack_callback(session, session->nack_callback_udata,
+                                                pid + j + 1);
+                        }
+                }
+        }
+}
+
 static void process_rtcp_sdes(struct rtp *session, rtcp_t * packet)
 {
         int count = packet->common.count;
@@ -2184,6 +2238,11 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
                                         process_rtcp_rr(session, packet);
                                         break;
                                 case RTCP_RX:
+                                        if (packet->common.count == RTCP_RTPFB_NACK) {
+                                                /* RTPFB generic NACK - RX reports are not sent by us */
+                                                process_rtcp_nack(session, packet);
+                                                break;
+                                        }
                                         /* am not sending up a RX_RTCP_START... */
                                         process_rtcp_rx(session, packet);
                                         if (session->tfrc_on) {
@@ -2773,10 +2832,12 @@ rtp_send_data_hdr(struct rtp *session,
         struct iovec send_vector[3];
 #endif
         int send_vector_len;
+        uint16_t seq;
 
         void *d; // to be freed after packet is sent
+        struct rtp *owner = session->sender_parent ? session->sender_parent : session;
 
-        check_database(session);
+        check_database(owner);
 
         assert((data == NULL && data_len == 0)
                || (data != NULL && data_len > 0));
@@ -2857,9 +2918,10 @@ rtp_send_data_hdr(struct rtp *session,
         packet->cc = cc;
         packet->m = m;
         packet->pt = pt;
-        packet->seq = htons(session->rtp_seq++);
+        seq = __sync_fetch_and_add(&owner->rtp_seq, 1);
+        packet->seq = htons(seq);
         packet->ts = htonl(rtp_ts);
-        packet->ssrc = htonl(session->my_ssrc);
+        packet->ssrc = htonl(owner->my_ssrc);
 
         /* ... do tfrc stuff... */
         if (session->tfrc_on) {
@@ -2925,19 +2987,25 @@ rtp_send_data_hdr(struct rtp *session,
                                          buffer_len, initVec);
         }
 
+        if (session->send_hook) {
+                session->send_hook(session->send_hook_udata, seq,
+                                (char *) buffer + RTP_PACKET_HEADER_SIZE, buffer_len,
+                                phdr, phdr != NULL ? phdr_len : 0, data, data_len);
+        }
+
         rc = udp_sendv(session->rtp_socket, send_vector, send_vector_len, d);
         if (rc == -1) {
                 perror("sending RTP packet");
         }
 
         /* Update the RTCP statistics... */
-        session->we_sent = TRUE;
-        session->rtp_pcount += 1;
-        session->rtp_bcount += buffer_len;
-        session->rtp_bytes_sent += buffer_len + data_len;
-        gettimeofday(&session->last_rtp_send_time, NULL);
+        owner->we_sent = TRUE;
+        __sync_fetch_and_add(&owner->rtp_pcount, 1);
+        __sync_fetch_and_add(&owner->rtp_bcount, buffer_len);
+        __sync_fetch_and_add(&owner->rtp_bytes_sent, buffer_len + data_len);
+        gettimeofday(&owner->last_rtp_send_time, NULL);
 
-        check_database(session);
+        check_database(owner);
         return rc;
 }
 
@@ -3388,6 +3456,103 @@ static void send_rtcp(struct rtp *session, uint32_t rtp_ts,
         check_database(session);
 }
 
+/**
+ * rtp_send_nack:
+ * @session: the session pointer (returned by rtp_init())
+ * @media_ssrc: SSRC of the sender the NACK is addressed to
+ * @seqs: sequence numbers of lost packets in ascending order
+ * @count: number of items in @seqs
+ *
+ * Sends a compound RTCP packet consisting of an empty RR and a generic
+ * NACK (RFC 4585) requesting retransmission of @seqs. Sequence numbers
+ * that do not fit into a single packet are not requested.
+ *
+ * Return value: number of sequence numbers requested.
+ */
+int rtp_send_nack(struct rtp *session, uint32_t media_ssrc, const uint16_t *seqs, int count)
+{
+        uint32_t buffer[RTP_MAX_PACKET_LEN / 4];
+        rtcp_t *rr = (rtcp_t *) buffer;
+        rtcp_t *fb = (rtcp_t *) (buffer + 2);
+        uint32_t *fci = buffer + 5;
+        int max_fci = RTP_MAX_PACKET_LEN / 4 - 5;
+        int nfci = 0;
+        int i = 0;
+        int rc;
+
+        if (count == 0 || session->encryption_enabled) {
+                return 0;
+        }
+
+        rr->common.version = 2;
+        rr->common.p = 0;
+        rr->common.count = 0;
+        rr->common.pt = RTCP_RR;
+        rr->common.length = htons(1);
+        rr->r.rr.ssrc = htonl(session->my_ssrc);
+
+        while (i < count && nfci < max_fci) {
+                uint16_t pid = seqs[i++];
+                uint16_t blp = 0;
+                while (i < count && (uint16_t) (seqs[i] - pid) >= 1
+                                && (uint16_t) (seqs[i] - pid) <= 16) {
+                        blp |= 1 << ((uint16_t) (seqs[i] - pid) - 1);
+                        i++;
+                }
+                fci[nfci++] = htonl((uint32_t) pid << 16 | blp);
+        }
+
+        fb->common.version = 2;
+        fb->common.p = 0;
+        fb->common.count = RTCP_RTPFB_NACK;
+        fb->common.pt = RTCP_RTPFB;
+        fb->common.length = htons(2 + nfci);
+        buffer[3] = htonl(session->my_ssrc);
+        buffer[4] = htonl(media_ssrc);
+
+        if (!session->send_rtcp_to_origin) {
+                rc = udp_send(session->rtcp_socket, (char *) buffer, (5 + nfci) * 4);
+        } else if (session->rtcp_dest_len > 0) {
+                rc = udp_sendto(session->rtcp_socket, (char *) buffer, (5 + nfci) * 4,
+                                (struct sockaddr *) &session->rtcp_dest, session->rtcp_dest_len);
+        } else {
+                return 0;
+        }
+        if (rc == -1) {
+                perror("sending RTCP NACK");
+                return 0;
+        }
+        return i;
+}
+
+void rtp_set_send_hook(struct rtp *session, rtp_send_hook hook, void *udata)
+{
+        session->send_hook_udata = udata;
+        session->send_hook = hook;
+}
+
+void rtp_set_nack_callback(struct rtp *session, rtp_nack_callback callback, void *udata)
+{
+        session->nack_callback_udata = udata;
+        session->nack_callback = callback;
+}
+
+void rtp_set_rr_callback(struct rtp *session, rtp_rr_callback callback, void *udata)
+{
+        session->rr_callback_udata = udata;
+        session->rr_callback = callback;
+}
+
+/**
+ * Sends a RTCP report (SR or RR with SDES) immediately, regardless of the RTCP
+ * timer. Intended for the congestion control feedback, which needs to be more
+ * frequent than the RTCP interval. Doesn't reschedule the regular RTCP.
+ */
+void rtp_send_report(struct rtp *session, uint32_t rtp_ts)
+{
+        send_rtcp(session, rtp_ts, NULL);
+}
+
 /**
  * rtp_send_ctrl:
  * @session: the session pointer (returned by rtp_init())
@@ -4038,11 +4203,57 @@ void rtp_async_start(struct rtp *session, int nr_packets)
        udp_async_start(session->rtp_socket, nr_packets);
 }
 
+void rtp_async_flush(struct rtp *session)
+{
+       udp_async_flush(session->rtp_socket);
+}
+
 void rtp_async_wait(struct rtp *session)
 {
        udp_async_wait(session->rtp_socket);
 }
 
+/**
+ * Creates a sending-only clone of session that can be used with rtp_send_data_hdr()
+ * (and rtp_async_*) from a different thread than the original session. The clone
+ * queues packets in its own UDP socket state, sequence numbers, SSRC and sender
+ * statistics are those of the original session.
+ *
+ * The clone must be destroyed with rtp_done_sender_clone() before session.
+ */
+struct rtp *rtp_init_sender_clone(struct rtp *session)
+{
+        struct rtp *clone = (struct rtp *) malloc(sizeof(struct rtp));
+        memcpy(clone, session, sizeof(struct rtp));
+        clone->sender_parent = session;
+        clone->rtp_socket = udp_init_clone(session->rtp_socket);
+        if (clone->rtp_socket == NULL) {
+                free(clone);
+                return NULL;
+        }
+        return clone;
+}
+
+void rtp_done_sender_clone(struct rtp *clone)
+{
+        if (clone == NULL) {
+                return;
+        }
+        assert(clone->sender_parent != NULL);
+        udp_exit(clone->rtp_socket);
+        free(clone);
+}
+
+bool rtp_enable_txtime(struct rtp *session)
+{
+        return udp_enable_txtime(session->rtp_socket);
+}
+
+void rtp_set_txtime(struct rtp *session, uint64_t txtime)
+{
+        udp_set_txtime(session->rtp_socket, txtime);
+}
+
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session)
 {
         return udp_get_local(session->rtp_socket);
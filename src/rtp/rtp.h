@@ -186,6 +186,22 @@ typedef struct {
 /* Callback types */
 typedef void (*rtp_callback)(struct rtp *session, rtp_event *e);
 typedef rtcp_app* (*rtcp_app_callback)(struct rtp *session, uint32_t rtp_ts, int max_size);
+/**
+ * Called for every RTP packet sent by rtp_send_data_hdr() just before it is passed to
+ * the network. hdr points to the complete (serialized) RTP header.
+ */
+typedef void (*rtp_send_hook)(void *udata, uint16_t seq, const char *hdr, int hdr_len,
+                const char *phdr, int phdr_len, const char *data, int data_len);
+/**
+ * Called for every sequence number reported as lost by a received RTCP generic NACK
+ * (RFC 4585) addressed to this session.
+ */
+typedef void (*rtp_nack_callback)(struct rtp *session, void *udata, uint16_t seq);
+/**
+ * Called for every report block of a received RTCP SR/RR that reports on this
+ * session (rr->ssrc is our SSRC). rr is converted to host byte order.
+ */
+typedef void (*rtp_rr_callback)(struct rtp *session, void *udata, uint32_t reporter_ssrc, const rtcp_rr *rr);
 
 /* SDES packet types... */
 typedef enum  {
@@ -252,6 +268,7 @@ int 		 rtcp_recv_r(struct rtp *session,
 int 		 rtp_recv_poll_r(struct rtp **sessions, 
 			  struct timeval *timeout, uint32_t curr_rtp_ts);
 int 		 rtp_send_raw_rtp_data(struct rtp *session, char *buffer, int buffer_len);
+void		 rtp_packet_free(rtp_packet *packet);
 
 int 		 rtp_send_data(struct rtp *session, 
 			       uint32_t rtp_ts, char pt, int m, 
@@ -295,18 +312,48 @@ int              rtp_compute_fract_lost(struct rtp *session, uint32_t ssrc);
 bool             rtp_is_ipv6(struct rtp *session);
 
 /*
- * Async API - MSW specific
+ * Async API - MSW overlapped I/O, batched sendmmsg() in Linux
  *
  * Using async API hugely improves performance.
  * Usage is simple - prior to sending a bulk of packets (eg. video frame), rtp_async_start()
  * is started. Then, all packets are sent as usual, exept that neither data nor headers should
  * be altered up to rtp_async_wait() call, which waits upon completition of async operations
  * started after rtp_async_start(). Caller is responsible that rtp_send_data_hdr() is not called
- * more than nr_packet times.
+ * more than nr_packet times. rtp_async_flush() pushes packets queued so far to the network
+ * (eg. at the end of a pacing burst).
  */
 void             rtp_async_start(struct rtp *session, int nr_packets);
+void             rtp_async_flush(struct rtp *session);
 void             rtp_async_wait(struct rtp *session);
 
+/*
+ * Per-packet launch times (SO_TXTIME, Linux) - after successful rtp_enable_txtime(),
+ * packets sent after rtp_set_txtime() are released by the kernel at given CLOCK_MONOTONIC
+ * time (in ns) instead of immediately. Value 0 restores immediate sending.
+ */
+bool             rtp_enable_txtime(struct rtp *session);
+void             rtp_set_txtime(struct rtp *session, uint64_t txtime);
+
+/*
+ * Retransmission support - rtp_send_nack() requests retransmission of given packets
+ * from the sender with SSRC media_ssrc by a RTCP generic NACK. Sender keeps history of
+ * sent packets with a send hook and resends packets with rtp_send_raw_rtp_data() from
+ * NACK callback. Hooks are inherited by sender clones.
+ */
+void             rtp_set_send_hook(struct rtp *session, rtp_send_hook hook, void *udata);
+void             rtp_set_nack_callback(struct rtp *session, rtp_nack_callback callback, void *udata);
+int              rtp_send_nack(struct rtp *session, uint32_t media_ssrc, const uint16_t *seqs, int count);
+
+/*
+ * Congestion control support - receiver sends reports with rtp_send_report() more
+ * often than RTCP timer allows, sender gets the report blocks from the RR callback.
+ */
+void             rtp_set_rr_callback(struct rtp *session, rtp_rr_callback callback, void *udata);
+void             rtp_send_report(struct rtp *session, uint32_t rtp_ts);
+
+struct rtp      *rtp_init_sender_clone(struct rtp *session);
+void             rtp_done_sender_clone(struct rtp *clone);
+
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session);
 
 #ifdef __cplusplus
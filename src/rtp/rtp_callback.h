@@ -59,6 +59,8 @@ extern "C" {
 #define PT_ENCRYPT_AUDIO 25
 #define PT_ENCRYPT_VIDEO_LDGM 26
 #define PT_VIDEO_RS     27
+#define PT_AUDIO_RS     28
+#define PT_VIDEO_INTERLEAVED 29
 #define PT_H264 96
 #define PT_DynRTP_Type97    97 /* mU-law stereo amongst others */
 /*
@@ -112,6 +114,30 @@ typedef uint32_t video_payload_hdr_t[6];
  */
 typedef uint32_t audio_payload_hdr_t[5];
 
+/*
+ * Audio RS parity payload
+ *
+ * Parity packets of a group follow the (up to) K audio packets they protect,
+ * the first protected packet has RTP sequence number of the parity packet
+ * minus parity index minus number of protected packets. Symbol of a
+ * protected packet is its 16-bit payload length (network order) followed by
+ * the payload (including audio and crypto headers) zero-padded to symbol
+ * size. Symbols of the packets missing to K (the last group of a frame) are
+ * all zero.
+ *
+ * 1st word
+ * bits 0 - 7 K
+ * bits 8 - 15 M
+ * bits 16 - 23 number of protected packets
+ * bits 24 - 31 parity index
+ *
+ * 2nd word
+ * bits 0 - 6 payload type of protected packets
+ * bit 7 last protected packet has m-bit set
+ * bits 8 - 31 symbol size
+ */
+typedef uint32_t audio_fec_payload_hdr_t[2];
+
 /*
  * FEC video payload
  *
@@ -135,6 +161,28 @@ typedef uint32_t audio_payload_hdr_t[5];
  */
 typedef uint32_t fec_video_payload_hdr_t[5];
 
+/*
+ * Interleaved FEC parity payload
+ *
+ * A block of up to columns * rows video packets with consecutive sequence
+ * numbers (possibly spanning several frames) is protected by one parity
+ * packet per column, parity of column c is XOR of symbols of packets with
+ * sequence number first + c + i * columns. Symbol of a packet is its 16-bit
+ * payload length, 1 byte with m-bit (bit 0) and payload type (bits 1 - 7),
+ * 1 reserved byte and 32-bit RTP timestamp (all network order) followed by
+ * the payload, zero-padded to symbol size.
+ *
+ * 1st word
+ * bits 0 - 15 sequence number of the first packet of the block
+ * bits 16 - 31 number of packets in the block
+ *
+ * 2nd word
+ * bits 0 - 7 columns
+ * bits 8 - 15 column index
+ * bits 16 - 31 symbol size
+ */
+typedef uint32_t fec_interleaved_payload_hdr_t[2];
+
 /*
  * Crypto video payload
  *
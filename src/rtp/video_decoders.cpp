@@ -85,20 +85,22 @@
 #include "module.h"
 #include "perf.h"
 #include "rtp/fec.h"
+#include "rtp/line_decoder.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/pbuf.h"
 #include "rtp/video_decoders.h"
+#include "utils/received_ranges.h"
 #include "utils/synchronized_queue.h"
 #include "utils/timed_message.h"
 #include "video.h"
 #include "video_decompress.h"
 #include "video_display.h"
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
-#ifdef RECONFIGURE_IN_FUTURE_THREAD
 #include <future>
-#endif
 #include <iostream>
 #include <map>
 #include <memory>
@@ -111,8 +113,41 @@
 #endif
 
 
+#define DEFAULT_LINE_DECODE_THREADS 4
+#define MAX_DECODER_QUEUE_DEPTH 64
+#define MAX_FEC_THREADS 64
+
 using namespace std;
 
+ADD_TO_PARAM(decoder_line_threads, "decoder-line-threads",
+                "* decoder-line-threads=<n>\n"
+                "  Number of threads converting pixel format of received uncompressed video\n"
+                "  (1 - decode in the receiving thread, default: number of CPUs, at most 4).\n");
+ADD_TO_PARAM(decoder_queue_depth, "decoder-queue-depth",
+                "* decoder-queue-depth=<n>\n"
+                "  Number of frames that may wait for FEC decoding and for decompression\n"
+                "  (default 1).\n");
+ADD_TO_PARAM(decoder_fec_threads, "decoder-fec-threads",
+                "* decoder-fec-threads=<n>\n"
+                "  Number of threads decoding FEC of consecutive frames concurrently (default 1).\n");
+ADD_TO_PARAM(drop_policy, "drop-policy",
+                "* drop-policy=nonblock|blocking|latest\n"
+                "  Whether a frame is dropped if display is not ready (nonblock - default) or\n"
+                "  decoder waits (blocking). Latest additionally skips older frames waiting\n"
+                "  in playout buffer and decoder queues if a newer one is ready, so that\n"
+                "  latency stays bounded if the receiver cannot keep up (frames of\n"
+                "  inter-frame codecs are not skipped).\n");
+ADD_TO_PARAM(decoder_sync_reconfigure, "decoder-sync-reconfigure",
+                "* decoder-sync-reconfigure\n"
+                "  Reconfigure decoder and display in the receiving thread when the incoming\n"
+                "  video format changes. By default it is done in background while frames of\n"
+                "  the new format wait in the playout buffer.\n");
+ADD_TO_PARAM(decoder_conceal, "decoder-conceal",
+                "* decoder-conceal[=<ms>]\n"
+                "  Fill lines of uncompressed video missing due to packet loss from the previous\n"
+                "  frame. Frames not completed in <ms> from the last received packet after their\n"
+                "  playout time are decoded partially (default 10 ms).\n");
+
 struct state_video_decoder;
 
 /**
@@ -130,15 +165,7 @@ static void *fec_thread(void *args);
 static void *decompress_thread(void *args);
 static void cleanup(struct state_video_decoder *decoder);
 static void decoder_process_message(struct module *);
-
-static int sum_map(map<int, int> const & m) {
-        int ret = 0;
-        for (map<int, int>::const_iterator it = m.begin();
-                        it != m.end(); ++it) {
-                ret += it->second;
-        }
-        return ret;
-}
+static bool reconfiguration_pending(struct state_video_decoder *decoder, bool block);
 
 namespace {
 
@@ -157,26 +184,15 @@ enum decoder_type_t {
                           * a whole. */
 };
 
-/**
- * This structure holds data needed to use a linedecoder.
- */
-struct line_decoder {
-        int                  base_offset;  ///< from the beginning of buffer. Nonzero if decoding from mutiple tiles.
-        double               src_bpp;      ///< Source pixelformat BPP (bytes)
-        double               dst_bpp;      ///< Destination pixelformat BPP (bytes)
-        int                  shifts[3];    ///< requested red,green and blue shift (in bits)
-        decoder_t            decode_line;  ///< actual decoding function
-        unsigned int         dst_linesize; ///< destination linesize
-        unsigned int         dst_pitch;    ///< framebuffer pitch - it can be larger if SDL resolution is larger than data */
-        unsigned int         src_linesize; ///< source linesize
-};
-
 struct reported_statistics_cumul {
         mutex             lock;
         unsigned long long int     received_bytes_total = 0;
         unsigned long long int     expected_bytes_total = 0;
         unsigned long int displayed = 0, dropped = 0, corrupted = 0, missing = 0;
         unsigned long int fec_ok = 0, fec_nok = 0;
+        unsigned long int skipped = 0; ///< dropped by drop-policy=latest
+        unsigned long int concealed = 0;
+        unsigned long long int concealed_lines = 0;
         unsigned long long int     nano_per_frame_decompress = 0;
         unsigned long long int     nano_per_frame_error_correction = 0;
         unsigned long long int     nano_per_frame_expected = 0;
@@ -189,9 +205,13 @@ struct reported_statistics_cumul {
                                 displayed, dropped, corrupted,
                                 missing);
                 if (fec_ok + fec_nok > 0)
-                        sprintf(buff + bytes, " FEC OK/NOK: %ld/%ld\n", fec_ok, fec_nok);
-                else
-                        sprintf(buff + bytes, "\n");
+                        bytes += sprintf(buff + bytes, " FEC OK/NOK: %ld/%ld", fec_ok, fec_nok);
+                if (skipped > 0)
+                        bytes += sprintf(buff + bytes, " Skipped: %lu", skipped);
+                if (concealed > 0)
+                        bytes += sprintf(buff + bytes, " Concealed: %lu (%llu lines)", concealed,
+                                        concealed_lines);
+                sprintf(buff + bytes, "\n");
                 log_msg(LOG_LEVEL_INFO, buff);
         }
 };
@@ -213,7 +233,15 @@ struct frame_msg {
                                         stats.fec_ok += 1;
                                 }
                         }
-                        int received_bytes = sum_map(pckt_list[0]);
+                        if (is_skipped) {
+                                stats.dropped += 1;
+                                stats.skipped += 1;
+                        }
+                        if (concealed_lines > 0) {
+                                stats.concealed += 1;
+                                stats.concealed_lines += concealed_lines;
+                        }
+                        int received_bytes = pckt_list[0].total();
                         ostringstream oss;
                         oss << "RECV " << "bufferId " << buffer_num[0] << " expectedPackets " <<
                                 expected_pkts_cum <<  " receivedPackets " << received_pkts_cum <<
@@ -241,7 +269,7 @@ struct frame_msg {
         vector <uint32_t> buffer_num;
         struct video_frame *recv_frame; ///< received frame with FEC and/or compression
         struct video_frame *nofec_frame; ///< frame without FEC
-        unique_ptr<map<int, int>[]> pckt_list;
+        unique_ptr<received_ranges[]> pckt_list;
         unsigned long long int received_pkts_cum, expected_pkts_cum;
         struct reported_statistics_cumul &stats;
         unsigned long long int nanoPerFrameDecompress = 0;
@@ -249,6 +277,31 @@ struct frame_msg {
         unsigned long long int nanoPerFrameExpected = 0;
         bool is_displayed = false;
         bool is_corrupted = false;
+        int concealed_lines = 0; ///< lines filled from the previous frame
+        bool is_skipped = false; ///< dropped because newer frame was waiting
+        unsigned long long int seq = 0; ///< order of the message in FEC queue
+};
+
+/**
+ * Serializes processing of frames by multiple threads in the order of their
+ * sequence numbers. Every sequence number must be passed exactly once.
+ */
+struct ordered_stage {
+        /// blocks until all frames with lower seq are done
+        void wait_turn(unsigned long long int seq) {
+                unique_lock<mutex> lk(lock);
+                cv.wait(lk, [this, seq]{ return next == seq; });
+        }
+        void done() {
+                unique_lock<mutex> lk(lock);
+                next += 1;
+                lk.unlock();
+                cv.notify_all();
+        }
+
+        mutex lock;
+        condition_variable cv;
+        unsigned long long int next = 0;
 };
 
 struct main_msg_reconfigure {
@@ -277,8 +330,8 @@ struct state_video_decoder
         struct module mod;
         struct control_state *control = {};
 
-        thread decompress_thread_id,
-                  fec_thread_id;
+        thread decompress_thread_id;
+        vector<thread> fec_thread_ids;
         struct video_desc received_vid_desc = {}; ///< description of the network video
         struct video_desc display_desc = {};      ///< description of the mode that display is currently configured to
 
@@ -313,6 +366,10 @@ struct state_video_decoder
         int               pitch = 0;
 
         synchronized_queue<unique_ptr<frame_msg>, 1> fec_queue;
+        int fec_threads = 1;                          ///< number of fec_thread() workers
+        atomic<int> fec_workers_running{0};
+        atomic<unsigned long long int> fec_seq{0};    ///< next seq assigned in fec_queue_push()
+        ordered_stage fec_order;                      ///< keeps order of frames passed by FEC workers
 
         enum video_mode   video_mode = {} ;  ///< video mode set for this decoder
         bool          merged_fb = false; ///< flag if the display device driver requires tiled video or not
@@ -325,14 +382,44 @@ struct state_video_decoder
         const struct openssl_decrypt_info *dec_funcs = NULL; ///< decrypt state
         struct openssl_decrypt      *decrypt = NULL; ///< decrypt state
 
-#ifdef RECONFIGURE_IN_FUTURE_THREAD
+        /// @{
+        /// Background reconfiguration, flags are accessed only from the receiving thread.
+        bool             async_reconfiguration = true;
         std::future<bool> reconfiguration_future;
         bool             reconfiguration_in_progress = false;
-#endif
+        unique_ptr<frame_msg> reconfiguration_last_frame; ///< FEC frame that triggered the reconfiguration
+        /// @}
+
+        /// @{
+        /// drop-policy
+        int              putf_flags = PUTF_NONBLOCK;
+        bool             latest_wins = false;
+        long long int    last_skipped_frames = 0; ///< pbuf_stats::skipped_frames_cum of last frame
+        /// @}
 
         struct reported_statistics_cumul stats = {}; ///< stats to be reported through control socket
+
+        int line_decode_threads = 1; ///< threads used to run line decoder
+        vector<line_decode_pkt> line_decode_queue; ///< packets of current frame to be line-decoded
+
+        /// @{
+        /// Copy of the last displayed uncompressed frame used to conceal lost lines,
+        /// accessed only from the decompress thread.
+        bool conceal = false;
+        vector<vector<char>> conceal_prev;  ///< per tile
+        struct video_desc conceal_desc = {}; ///< codec and tile size of @ref conceal_prev
+        /// @}
 };
 
+/**
+ * Pushes the message to FEC workers, the messages are passed further in the
+ * order of pushing.
+ */
+static void fec_queue_push(struct state_video_decoder *decoder, unique_ptr<frame_msg> msg) {
+        msg->seq = decoder->fec_seq++;
+        decoder->fec_queue.push(move(msg));
+}
+
 /**
  * This function blocks until video frame is displayed and decoder::frame
  * can be filled with new data. Until this point, the video frame is not considered
@@ -343,29 +430,180 @@ static void wait_for_framebuffer_swap(struct state_video_decoder *decoder) {
         decoder->buffer_swapped_cv.wait(lk, [decoder]{return decoder->buffer_swapped;});
 }
 
+#define FRAMEBUFFER_SMALL_ERR "WARNING!! Discarding input data as frame buffer is too small.\n" \
+        "Well this should not happened. Expect troubles pretty soon.\n"
 #define ENCRYPTED_ERR "Receiving encrypted video data but " \
         "no decryption key entered!\n"
 #define NOT_ENCRYPTED_ERR "Receiving unencrypted video data " \
         "while expecting encrypted.\n"
 
+/**
+ * Passes frame after FEC decoding to decompress thread. Runs in the order the
+ * frames were received (see @ref ordered_stage).
+ * @param fec_out output of FEC for every substream (unused for PT_VIDEO)
+ */
+static void fec_deliver_frame(struct state_video_decoder *decoder, unique_ptr<frame_msg> data,
+                vector<pair<char *, int>> const & fec_out,
+                std::chrono::high_resolution_clock::time_point t0)
+{
+        struct video_frame *frame = decoder->frame;
+        struct tile *tile = NULL;
+
+        data->nofec_frame = vf_alloc(data->recv_frame->tile_count);
+        data->nofec_frame->ssrc = data->recv_frame->ssrc;
+
+        if (data->recv_frame->fec_params.type != FEC_NONE) {
+                bool buffer_swapped = false;
+                for (int pos = 0; pos < get_video_mode_tiles_x(decoder->video_mode)
+                                * get_video_mode_tiles_y(decoder->video_mode); ++pos) {
+                        char *fec_out_buffer = fec_out[pos].first;
+                        int fec_out_len = fec_out[pos].second;
+
+                        video_payload_hdr_t video_hdr;
+                        memcpy(&video_hdr, fec_out_buffer,
+                                        sizeof(video_payload_hdr_t));
+                        fec_out_buffer += sizeof(video_payload_hdr_t);
+                        fec_out_len -= sizeof(video_payload_hdr_t);
+
+                        struct video_desc network_desc;
+                        parse_video_hdr(video_hdr, &network_desc);
+                        if (!video_desc_eq_excl_param(decoder->received_vid_desc,
+                                                network_desc, PARAM_TILE_COUNT)) {
+                                decoder->msg_queue.push(new main_msg_reconfigure(network_desc, move(data)));
+                                return;
+                        }
+
+                        if(!frame) {
+                                return;
+                        }
+
+                        if(decoder->decoder_type == EXTERNAL_DECODER) {
+                                data->nofec_frame->tiles[pos].data_len = fec_out_len;
+                                data->nofec_frame->tiles[pos].data = fec_out_buffer;
+                        } else { // linedecoder
+                                if (!buffer_swapped) {
+                                        buffer_swapped = true;
+                                        wait_for_framebuffer_swap(decoder);
+                                        unique_lock<mutex> lk(decoder->lock);
+                                        decoder->buffer_swapped = false;
+                                }
+
+                                int divisor;
+
+                                if (!decoder->merged_fb) {
+                                        divisor = decoder->max_substreams;
+                                } else {
+                                        divisor = 1;
+                                }
+
+                                tile = vf_get_tile(frame, pos % divisor);
+
+                                struct line_decoder *line_decoder =
+                                        &decoder->line_decoder[pos];
+
+                                int data_pos = 0;
+                                char *src = fec_out_buffer;
+                                char *dst = tile->data + line_decoder->base_offset;
+                                while(data_pos < (int) fec_out_len) {
+                                        line_decoder->decode_line((unsigned char*)dst, (unsigned char *) src, line_decoder->src_linesize,
+                                                        line_decoder->shifts[0],
+                                                        line_decoder->shifts[1],
+                                                        line_decoder->shifts[2]);
+                                        src += line_decoder->src_linesize;
+                                        dst += vc_get_linesize(tile->width ,frame->color_spec);
+                                        data_pos += line_decoder->src_linesize;
+                                }
+                        }
+                }
+        } else { /* PT_VIDEO */
+                for(int i = 0; i < (int) decoder->max_substreams; ++i) {
+                        data->nofec_frame->tiles[i].data_len = data->recv_frame->tiles[i].data_len;
+                        data->nofec_frame->tiles[i].data = data->recv_frame->tiles[i].data;
+
+                        if (data->recv_frame->tiles[i].data_len != (unsigned int) data->pckt_list[i].total()) {
+                                verbose_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.%s\n", i,
+                                                (unsigned int) data->buffer_num[i],
+                                                data->recv_frame->tiles[i].data_len,
+                                                (unsigned int) data->pckt_list[i].total(),
+                                                decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame ? " dropped.\n" : "");
+                                data->is_corrupted = true;
+                                if(decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
+                                        return;
+                                }
+                        }
+                }
+        }
+
+        data->nanoPerFrameErrorCorrection =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - t0).count();
+
+        decoder->decompress_queue.push(move(data));
+}
+
+/**
+ * Returns true if the frame may be dropped in favor of a newer one (with
+ * drop-policy=latest). Uncompressed frame without FEC is already written to
+ * the display frame buffer, frames of inter-frame codecs are needed for the
+ * following ones.
+ */
+static bool frame_skippable(struct state_video_decoder *decoder, struct frame_msg *msg)
+{
+        if (decoder->decoder_type == LINE_DECODER && msg->recv_frame->fec_params.type == FEC_NONE) {
+                return false;
+        }
+        return !is_codec_interframe(decoder->received_vid_desc.color_spec);
+}
+
+/**
+ * Tells the playout buffer whether it may skip frames (drop-policy=latest).
+ * Frames of inter-frame codecs are never skipped, neither are frames of
+ * a stream whose format is not yet known.
+ *
+ * @param decoder_data vcodec_state as passed to decode_video_frame()
+ */
+bool video_decoder_frames_skippable(void *decoder_data)
+{
+        struct state_video_decoder *decoder = ((struct vcodec_state *) decoder_data)->decoder;
+        codec_t codec = decoder->received_vid_desc.color_spec;
+        return codec != VIDEO_CODEC_NONE && !is_codec_interframe(codec);
+}
+
+/**
+ * FEC worker - several instances may run concurrently. FEC decoding of
+ * consecutive frames is done in parallel, the rest of processing (which
+ * touches the decoder state) is serialized in the frame order.
+ */
 static void *fec_thread(void *args) {
         struct state_video_decoder *decoder =
                 (struct state_video_decoder *) args;
 
         fec *fec_state = NULL;
         struct fec_desc desc(FEC_NONE);
+        vector<pair<char *, int>> fec_out;
 
         while(1) {
                 unique_ptr<frame_msg> data = decoder->fec_queue.pop();
 
                 if (!data->recv_frame) { // poisoned
-                        decoder->decompress_queue.push(move(data));
+                        // wait until frames received before are passed
+                        decoder->fec_order.wait_turn(data->seq);
+                        decoder->fec_order.done();
+                        if (--decoder->fec_workers_running == 0) {
+                                decoder->decompress_queue.push(move(data));
+                        }
                         break; // exit from loop
                 }
 
-                struct video_frame *frame = decoder->frame;
-                struct tile *tile = NULL;
+                if (decoder->latest_wins && decoder->fec_queue.size() > 0 && frame_skippable(decoder, data.get())) {
+                        decoder->fec_order.wait_turn(data->seq);
+                        data->is_skipped = true;
+                        data.reset();
+                        decoder->fec_order.done();
+                        continue;
+                }
+
                 auto t0 = std::chrono::high_resolution_clock::now();
+                bool fec_ok = true;
 
                 if (data->recv_frame->fec_params.type != FEC_NONE) {
                         if(!fec_state || desc.k != data->recv_frame->fec_params.k ||
@@ -379,124 +617,86 @@ static void *fec_thread(void *args) {
                                 if(fec_state == NULL) {
                                         log_msg(LOG_LEVEL_FATAL, "[decoder] Unable to initialize FEC.\n");
                                         exit_uv(1);
-                                        goto cleanup;
+                                        fec_ok = false;
                                 }
                         }
-                }
-
-                data->nofec_frame = vf_alloc(data->recv_frame->tile_count);
-                data->nofec_frame->ssrc = data->recv_frame->ssrc;
-
-                if (data->recv_frame->fec_params.type != FEC_NONE) {
-                        bool buffer_swapped = false;
-                        for (int pos = 0; pos < get_video_mode_tiles_x(decoder->video_mode)
-                                        * get_video_mode_tiles_y(decoder->video_mode); ++pos) {
-                                char *fec_out_buffer = NULL;
-                                int fec_out_len = 0;
 
+                        fec_out.assign(get_video_mode_tiles_x(decoder->video_mode)
+                                        * get_video_mode_tiles_y(decoder->video_mode), pair<char *, int>(nullptr, 0));
+                        for (int pos = 0; fec_ok && pos < (int) fec_out.size(); ++pos) {
                                 fec_state->decode(data->recv_frame->tiles[pos].data,
                                                 data->recv_frame->tiles[pos].data_len,
-                                                &fec_out_buffer, &fec_out_len, data->pckt_list[pos]);
+                                                &fec_out[pos].first, &fec_out[pos].second, data->pckt_list[pos]);
 
-                                if (data->recv_frame->tiles[pos].data_len != (unsigned int) sum_map(data->pckt_list[pos])) {
+                                if (data->recv_frame->tiles[pos].data_len != (unsigned int) data->pckt_list[pos].total()) {
                                         verbose_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.\n", pos,
                                                         (unsigned int) data->buffer_num[pos],
                                                         data->recv_frame->tiles[pos].data_len,
-                                                        (unsigned int) sum_map(data->pckt_list[pos]));
+                                                        (unsigned int) data->pckt_list[pos].total());
                                 }
 
-                                if(fec_out_len == 0) {
+                                if(fec_out[pos].second == 0) {
                                         verbose_msg("[decoder] FEC: unable to reconstruct data.\n");
                                         data->is_corrupted = true;
-                                        goto cleanup;
-                                }
-
-                                video_payload_hdr_t video_hdr;
-                                memcpy(&video_hdr, fec_out_buffer,
-                                                sizeof(video_payload_hdr_t));
-                                fec_out_buffer += sizeof(video_payload_hdr_t);
-                                fec_out_len -= sizeof(video_payload_hdr_t);
-
-                                struct video_desc network_desc;
-                                parse_video_hdr(video_hdr, &network_desc);
-                                if (!video_desc_eq_excl_param(decoder->received_vid_desc,
-                                                        network_desc, PARAM_TILE_COUNT)) {
-                                        decoder->msg_queue.push(new main_msg_reconfigure(network_desc, move(data)));
-                                        goto cleanup;
+                                        fec_ok = false;
                                 }
+                        }
+                }
 
-                                if(!frame) {
-                                        goto cleanup;
-                                }
+                decoder->fec_order.wait_turn(data->seq);
+                if (fec_ok) {
+                        fec_deliver_frame(decoder, move(data), fec_out, t0);
+                } else {
+                        data.reset();
+                }
+                decoder->fec_order.done();
+        }
 
-                                if(decoder->decoder_type == EXTERNAL_DECODER) {
-                                        data->nofec_frame->tiles[pos].data_len = fec_out_len;
-                                        data->nofec_frame->tiles[pos].data = fec_out_buffer;
-                                } else { // linedecoder
-                                        if (!buffer_swapped) {
-                                                buffer_swapped = true;
-                                                wait_for_framebuffer_swap(decoder);
-                                                unique_lock<mutex> lk(decoder->lock);
-                                                decoder->buffer_swapped = false;
-                                        }
+        delete fec_state;
 
-                                        int divisor;
+        return NULL;
+}
 
-                                        if (!decoder->merged_fb) {
-                                                divisor = decoder->max_substreams;
-                                        } else {
-                                                divisor = 1;
-                                        }
+/**
+ * Fills parts of LINE_DECODER frame that were not received with the previously
+ * displayed frame and stores the resulting frame for the next one. If the
+ * stored frame has the same layout, only received lines are updated in it
+ * (concealed ones are already there), otherwise the whole frame is copied.
+ */
+static void conceal_missing_lines(struct state_video_decoder *decoder, struct frame_msg *msg)
+{
+        struct video_frame *frame = decoder->frame;
+        struct video_desc desc = video_desc_from_frame(frame);
+
+        bool prev_valid = msg->recv_frame->fec_params.type == FEC_NONE
+                        && video_desc_eq(desc, decoder->conceal_desc)
+                        && decoder->conceal_prev.size() == frame->tile_count;
+        for (unsigned int i = 0; prev_valid && i < frame->tile_count; ++i) {
+                prev_valid = decoder->conceal_prev[i].size() == vf_get_tile(frame, i)->data_len;
+        }
 
-                                        tile = vf_get_tile(frame, pos % divisor);
-
-                                        struct line_decoder *line_decoder =
-                                                &decoder->line_decoder[pos];
-
-                                        int data_pos = 0;
-                                        char *src = fec_out_buffer;
-                                        char *dst = tile->data + line_decoder->base_offset;
-                                        while(data_pos < (int) fec_out_len) {
-                                                line_decoder->decode_line((unsigned char*)dst, (unsigned char *) src, line_decoder->src_linesize,
-                                                                line_decoder->shifts[0],
-                                                                line_decoder->shifts[1],
-                                                                line_decoder->shifts[2]);
-                                                src += line_decoder->src_linesize;
-                                                dst += vc_get_linesize(tile->width ,frame->color_spec);
-                                                data_pos += line_decoder->src_linesize;
-                                        }
-                                }
-                        }
-                } else { /* PT_VIDEO */
-                        for(int i = 0; i < (int) decoder->max_substreams; ++i) {
-                                data->nofec_frame->tiles[i].data_len = data->recv_frame->tiles[i].data_len;
-                                data->nofec_frame->tiles[i].data = data->recv_frame->tiles[i].data;
-
-                                if (data->recv_frame->tiles[i].data_len != (unsigned int) sum_map(data->pckt_list[i])) {
-                                        verbose_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.%s\n", i,
-                                                        (unsigned int) data->buffer_num[i],
-                                                        data->recv_frame->tiles[i].data_len,
-                                                        (unsigned int) sum_map(data->pckt_list[i]),
-                                                        decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame ? " dropped.\n" : "");
-                                        data->is_corrupted = true;
-                                        if(decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
-                                                goto cleanup;
-                                        }
-                                }
+        if (prev_valid) {
+                for (unsigned int pos = 0; pos < decoder->max_substreams; ++pos) {
+                        int tile_idx = decoder->merged_fb ? 0 : pos;
+                        struct tile *tile = vf_get_tile(frame, tile_idx);
+                        char *prev = decoder->conceal_prev[tile_idx].data();
+                        int src_len = msg->recv_frame->tiles[pos].data_len;
+                        if (msg->is_corrupted) {
+                                msg->concealed_lines += line_conceal_missing(&decoder->line_decoder[pos], tile,
+                                                prev, msg->pckt_list[pos], src_len);
                         }
+                        line_store_received(&decoder->line_decoder[pos], tile, prev,
+                                        msg->pckt_list[pos], src_len);
                 }
-
-                data->nanoPerFrameErrorCorrection =
-                        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - t0).count();
-
-                decoder->decompress_queue.push(move(data));
-cleanup:
-                ;
+                return;
         }
 
-        delete fec_state;
-
-        return NULL;
+        decoder->conceal_prev.resize(frame->tile_count);
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                struct tile *tile = vf_get_tile(frame, i);
+                decoder->conceal_prev[i].assign(tile->data, tile->data + tile->data_len);
+        }
+        decoder->conceal_desc = desc;
 }
 
 static void *decompress_thread(void *args) {
@@ -512,6 +712,12 @@ static void *decompress_thread(void *args) {
 
                 auto t0 = std::chrono::high_resolution_clock::now();
 
+                if (decoder->latest_wins && decoder->decoder_type == EXTERNAL_DECODER &&
+                                decoder->decompress_queue.size() > 0 && frame_skippable(decoder, msg.get())) {
+                        msg->is_skipped = true;
+                        goto skip_frame;
+                }
+
                 if(decoder->decoder_type == EXTERNAL_DECODER) {
                         int tile_width = decoder->received_vid_desc.width; // get_video_mode_tiles_x(decoder->video_mode);
                         int tile_height = decoder->received_vid_desc.height; // get_video_mode_tiles_y(decoder->video_mode);
@@ -547,6 +753,10 @@ static void *decompress_thread(void *args) {
                         }
                 }
 
+                if (decoder->conceal && decoder->decoder_type == LINE_DECODER) {
+                        conceal_missing_lines(decoder, msg.get());
+                }
+
                 msg->nanoPerFrameDecompress =
                         std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - t0).count();
 
@@ -559,27 +769,9 @@ static void *decompress_thread(void *args) {
                 }
 
                 {
-                        int putf_flags = PUTF_NONBLOCK;
-
-                        if (is_codec_interframe(decoder->received_vid_desc.color_spec)) {
-                                putf_flags = PUTF_NONBLOCK;
-                        }
-
-                        auto drop_policy = commandline_params.find("drop-policy");
-                        if (drop_policy != commandline_params.end()) {
-                                if (drop_policy->second == "nonblock") {
-                                        putf_flags = PUTF_NONBLOCK;
-                                } else if (drop_policy->second == "blocking") {
-                                        putf_flags = PUTF_BLOCKING;
-                                } else {
-                                        LOG(LOG_LEVEL_WARNING) << "Wrong drop policy "
-                                                << drop_policy->second << "!\n";
-                                }
-                        }
-
                         decoder->frame->ssrc = msg->nofec_frame->ssrc;
                         int ret = display_put_frame(decoder->display,
-                                        decoder->frame, putf_flags);
+                                        decoder->frame, decoder->putf_flags);
                         if (ret == 0) {
                                 msg->is_displayed = true;
                         }
@@ -642,6 +834,37 @@ struct state_video_decoder *video_decoder_init(struct module *parent,
                 }
         }
 
+        s->conceal = get_commandline_param("decoder-conceal") != NULL;
+        s->async_reconfiguration = get_commandline_param("decoder-sync-reconfigure") == NULL;
+        if (get_commandline_param("drop-policy")) {
+                string drop_policy = get_commandline_param("drop-policy");
+                if (drop_policy == "nonblock") {
+                        s->putf_flags = PUTF_NONBLOCK;
+                } else if (drop_policy == "blocking") {
+                        s->putf_flags = PUTF_BLOCKING;
+                } else if (drop_policy == "latest") {
+                        s->putf_flags = PUTF_NONBLOCK;
+                        s->latest_wins = true;
+                } else {
+                        LOG(LOG_LEVEL_WARNING) << "Wrong drop policy "
+                                << drop_policy << "!\n";
+                }
+        }
+        if (get_commandline_param("decoder-queue-depth")) {
+                int depth = max(1, min(MAX_DECODER_QUEUE_DEPTH, atoi(get_commandline_param("decoder-queue-depth"))));
+                s->fec_queue.set_max_len(depth);
+                s->decompress_queue.set_max_len(depth);
+        }
+        if (get_commandline_param("decoder-fec-threads")) {
+                s->fec_threads = max(1, min(MAX_FEC_THREADS, atoi(get_commandline_param("decoder-fec-threads"))));
+        }
+        if (get_commandline_param("decoder-line-threads")) {
+                s->line_decode_threads = max(1, atoi(get_commandline_param("decoder-line-threads")));
+        } else {
+                s->line_decode_threads = max<int>(1, min<int>(DEFAULT_LINE_DECODE_THREADS,
+                                        thread::hardware_concurrency()));
+        }
+
         decoder_set_video_mode(s, video_mode);
 
         if(!video_decoder_register_display(s, display)) {
@@ -666,7 +889,10 @@ static void video_decoder_start_threads(struct state_video_decoder *decoder)
         assert(decoder->display); // we want to run threads only if decoder is active
 
         decoder->decompress_thread_id = thread(decompress_thread, decoder);
-        decoder->fec_thread_id = thread(fec_thread, decoder);
+        decoder->fec_workers_running = decoder->fec_threads;
+        for (int i = 0; i < decoder->fec_threads; ++i) {
+                decoder->fec_thread_ids.push_back(thread(fec_thread, decoder));
+        }
 }
 
 /**
@@ -679,10 +905,15 @@ static void video_decoder_stop_threads(struct state_video_decoder *decoder)
 {
         assert(decoder->display);
 
-        unique_ptr<frame_msg> msg(new frame_msg(decoder->control, decoder->stats));
-        decoder->fec_queue.push(move(msg));
+        // every worker consumes one poison, the last one passes it to decompress thread
+        for (int i = 0; i < decoder->fec_threads; ++i) {
+                fec_queue_push(decoder, unique_ptr<frame_msg>(new frame_msg(decoder->control, decoder->stats)));
+        }
 
-        decoder->fec_thread_id.join();
+        for (auto & t : decoder->fec_thread_ids) {
+                t.join();
+        }
+        decoder->fec_thread_ids.clear();
         decoder->decompress_thread_id.join();
 }
 
@@ -743,6 +974,7 @@ bool video_decoder_register_display(struct state_video_decoder *decoder, struct
 void video_decoder_remove_display(struct state_video_decoder *decoder)
 {
         if (decoder->display) {
+                reconfiguration_pending(decoder, true);
                 video_decoder_stop_threads(decoder);
                 control_report_event(decoder->control, string("RECV stream ended"));
                 if (decoder->frame) {
@@ -1187,21 +1419,49 @@ static int reconfigure_if_needed(struct state_video_decoder *decoder,
 
                 decoder->received_vid_desc = network_desc;
 
-#ifdef RECONFIGURE_IN_FUTURE_THREAD
-                decoder->reconfiguration_in_progress = true;
-                decoder->reconfiguration_future = std::async(std::launch::async,
-                                [decoder](){ return reconfigure_decoder(decoder, decoder->received_vid_desc); });
-#else
-                int ret = reconfigure_decoder(decoder, decoder->received_vid_desc);
-                if (!ret) {
-                        log_msg(LOG_LEVEL_ERROR, "[video dec.] Reconfiguration failed!!!\n");
-                        decoder->frame = NULL;
+                if (decoder->async_reconfiguration) {
+                        decoder->reconfiguration_in_progress = true;
+                        decoder->reconfiguration_future = std::async(std::launch::async,
+                                        [decoder, network_desc](){ return reconfigure_decoder(decoder, network_desc); });
+                } else {
+                        int ret = reconfigure_decoder(decoder, decoder->received_vid_desc);
+                        if (!ret) {
+                                log_msg(LOG_LEVEL_ERROR, "[video dec.] Reconfiguration failed!!!\n");
+                                decoder->frame = NULL;
+                        }
                 }
-#endif
                 return TRUE;
         }
         return FALSE;
 }
+
+/**
+ * Checks the state of background reconfiguration started by
+ * reconfigure_if_needed(). When it is finished, the FEC frame that triggered
+ * it (if any) is passed to FEC workers again.
+ *
+ * @param block wait for the reconfiguration to finish
+ * @returns     true if the reconfiguration is still in progress
+ */
+static bool reconfiguration_pending(struct state_video_decoder *decoder, bool block)
+{
+        if (!decoder->reconfiguration_in_progress) {
+                return false;
+        }
+        if (!block && decoder->reconfiguration_future.wait_for(std::chrono::seconds(0)) !=
+                        std::future_status::ready) {
+                return true;
+        }
+        if (!decoder->reconfiguration_future.get()) {
+                log_msg(LOG_LEVEL_ERROR, "[video dec.] Reconfiguration failed!!!\n");
+                decoder->frame = NULL;
+        }
+        decoder->reconfiguration_in_progress = false;
+        if (decoder->reconfiguration_last_frame) {
+                fec_queue_push(decoder, move(decoder->reconfiguration_last_frame));
+        }
+        return false;
+}
 /**
  * Checks if network format has changed.
  *
@@ -1230,6 +1490,8 @@ static int check_for_mode_change(struct state_video_decoder *decoder,
  *                     It stil doesn't mean that the frame will be correctly displayed,
  *                     decoding may fail in some subsequent (asynchronous) steps.
  * @retval FALSE       if decoding failed
+ * @retval PBUF_DECODE_RETRY the decoder is being reconfigured, the frame should
+ *                     be passed again later
  */
 int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf_stats *stats)
 {
@@ -1249,54 +1511,41 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
         // is just the FEC buffer present, so we point to it instead to copying
         struct video_frame *frame = vf_alloc(max_substreams);
         frame->data_deleter = vf_data_deleter;
-        unique_ptr<map<int, int>[]> pckt_list(new map<int, int>[max_substreams]);
+        unique_ptr<received_ranges[]> pckt_list(new received_ranges[max_substreams]);
 
         int k = 0, m = 0, c = 0, seed = 0; // LDGM
-        int buffer_number, buffer_length;
+        int buffer_number = -1; // -1 - no video packet consumed
+        int buffer_length = 0;
 
         int pt;
         bool buffer_swapped = false;
 
         perf_record(UVP_DECODEFRAME, cdata);
 
+        decoder->line_decode_queue.clear();
+
         // We have no framebuffer assigned, exitting
         if(!decoder->display) {
                 vf_free(frame);
                 return FALSE;
         }
 
-#ifdef RECONFIGURE_IN_FUTURE_THREAD
         // check if we are not in the middle of reconfiguration
-        if (decoder->reconfiguration_in_progress) {
-                std::future_status status =
-                        decoder->reconfiguration_future.wait_until(std::chrono::system_clock::now());
-                if (status == std::future_status::ready) {
-                        bool ret = decoder->reconfiguration_future.get();
-                        if (ret) {
-                                decoder->frame = display_get_frame(decoder->display);
-                        } else {
-                                log_msg(LOG_LEVEL_ERROR, "Decoder reconfiguration failed!!!\n");
-                                decoder->frame = NULL;
-                        }
-                        decoder->reconfiguration_in_progress = false;
-                } else {
-                        // skip the frame if we are not yet reconfigured
-                        vf_free(frame);
-                        return FALSE;
-                }
+        if (reconfiguration_pending(decoder, false)) {
+                vf_free(frame);
+                return PBUF_DECODE_RETRY;
         }
-#endif
 
         main_msg_reconfigure *msg_reconf;
         while ((msg_reconf = decoder->msg_queue.pop(true /* nonblock */))) {
-                if (reconfigure_if_needed(decoder, msg_reconf->desc)) {
-#ifdef RECONFIGURE_IN_FUTURE_THREAD
+                if (reconfigure_if_needed(decoder, msg_reconf->desc) && decoder->reconfiguration_in_progress) {
+                        decoder->reconfiguration_last_frame = move(msg_reconf->last_frame);
+                        delete msg_reconf;
                         vf_free(frame);
-                        return FALSE;
-#endif
+                        return PBUF_DECODE_RETRY;
                 }
                 if (msg_reconf->last_frame) {
-                        decoder->fec_queue.push(move(msg_reconf->last_frame));
+                        fec_queue_push(decoder, move(msg_reconf->last_frame));
                 }
                 delete msg_reconf;
         }
@@ -1305,8 +1554,6 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 uint32_t tmp;
                 uint32_t *hdr;
                 int len;
-                uint32_t offset;
-                unsigned char *source;
                 char *data;
                 uint32_t data_pos;
                 uint32_t substream;
@@ -1419,11 +1666,10 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         /* Critical section
                          * each thread *MUST* wait here if this condition is true
                          */
-                        if (check_for_mode_change(decoder, hdr)) {
-#ifdef RECONFIGURE_IN_FUTURE_THREAD
+                        if (check_for_mode_change(decoder, hdr) && decoder->reconfiguration_in_progress) {
+                                // decoded again when reconfigured
                                 vf_free(frame);
-                                return FALSE;
-#endif
+                                return PBUF_DECODE_RETRY;
                         }
 
                         // hereafter, display framebuffer can be used, so we
@@ -1434,7 +1680,7 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         }
                 }
 
-                pckt_list[substream][data_pos] = len;
+                pckt_list[substream].add(data_pos, len);
 
                 if ((pt == PT_VIDEO || pt == PT_ENCRYPT_VIDEO) && decoder->decoder_type == LINE_DECODER) {
                         struct tile *tile = NULL;
@@ -1456,76 +1702,19 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
 
                         /* End of critical section */
 
-                        /* MAGIC, don't touch it, you definitely break it
-                         *  *source* is data from network, *destination* is frame buffer
-                         */
-
-                        /* compute Y pos in source frame and convert it to
-                         * byte offset in the destination frame
-                         */
-                        int y = (data_pos / line_decoder->src_linesize) * line_decoder->dst_pitch;
-
-                        /* compute X pos in source frame */
-                        int s_x = data_pos % line_decoder->src_linesize;
-
-                        /* convert X pos from source frame into the destination frame.
-                         * it is byte offset from the beginning of a line.
-                         */
-                        int d_x = ((int)((s_x) / line_decoder->src_bpp)) *
-                                line_decoder->dst_bpp;
-
-                        /* pointer to data payload in packet */
-                        source = (unsigned char*)(data);
-
-                        /* copy whole packet that can span several lines.
-                         * we need to clip data (v210 case) or center data (RGBA, R10k cases)
-                         */
-                        while (len > 0) {
-                                /* len id payload length in source BPP
-                                 * decoder needs len in destination BPP, so convert it
+                        if (decoder->line_decode_threads > 1 && pt == PT_VIDEO) {
+                                // decoded in parallel when the whole frame is classified
+                                decoder->line_decode_queue.push_back(line_decode_pkt{line_decoder,
+                                                tile, data_pos, (unsigned char *) data, len});
+                        } else if (!line_decode_packet(line_decoder, tile, data_pos, (unsigned char *) data, len)) {
+                                /* this should not ever happen as we call reconfigure before each packet
+                                 * iff reconfigure is needed. But if it still happens, something is terribly wrong
+                                 * say it loudly
                                  */
-                                int l = ((int)(len / line_decoder->src_bpp)) * line_decoder->dst_bpp;
-
-                                /* do not copy multiple lines, we need to
-                                 * copy (& clip, center) line by line
-                                 */
-                                if (l + d_x > (int) line_decoder->dst_linesize) {
-                                        l = line_decoder->dst_linesize - d_x;
-                                }
-
-                                /* compute byte offset in destination frame */
-                                offset = y + d_x;
-
-                                /* watch the SEGV */
-                                if (l + line_decoder->base_offset + offset <= tile->data_len) {
-                                        /*decode frame:
-                                         * we have offset for destination
-                                         * we update source contiguously
-                                         * we pass {r,g,b}shifts */
-                                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
-                                                        line_decoder->shifts[0], line_decoder->shifts[1],
-                                                        line_decoder->shifts[2]);
-                                        /* we decoded one line (or a part of one line) to the end of the line
-                                         * so decrease *source* len by 1 line (or that part of the line */
-                                        len -= line_decoder->src_linesize - s_x;
-                                        /* jump in source by the same amount */
-                                        source += line_decoder->src_linesize - s_x;
-                                } else {
-                                        /* this should not ever happen as we call reconfigure before each packet
-                                         * iff reconfigure is needed. But if it still happens, something is terribly wrong
-                                         * say it loudly
-                                         */
-                                        if((prints % 100) == 0) {
-                                                log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
-                                                                "Well this should not happened. Expect troubles pretty soon.\n");
-                                        }
-                                        prints++;
-                                        len = 0;
+                                if((prints % 100) == 0) {
+                                        log_msg(LOG_LEVEL_ERROR, FRAMEBUFFER_SMALL_ERR);
                                 }
-                                /* each new line continues from the beginning */
-                                d_x = 0;        /* next line from beginning */
-                                s_x = 0;
-                                y += line_decoder->dst_pitch;  /* next line */
+                                prints++;
                         }
                 } else { /* PT_VIDEO_LDGM or external decoder */
                         if(!frame->tiles[substream].data) {
@@ -1540,6 +1729,14 @@ next_packet:
                 cdata = cdata->nxt;
         }
 
+        if (!decoder->line_decode_queue.empty()) {
+                int failed = line_decode_packets(decoder->line_decode_queue.data(),
+                                decoder->line_decode_queue.size(), decoder->line_decode_threads);
+                if (failed > 0) {
+                        log_msg(LOG_LEVEL_ERROR, FRAMEBUFFER_SMALL_ERR);
+                }
+        }
+
         if(!pckt) {
                 vf_free(frame);
                 return FALSE;
@@ -1571,7 +1768,7 @@ next_packet:
                 fec_msg->nanoPerFrameExpected = decoder->frame ? 1000000000 / decoder->frame->fps : 0;
 
                 auto t0 = std::chrono::high_resolution_clock::now();
-                decoder->fec_queue.push(move(fec_msg));
+                fec_queue_push(decoder, move(fec_msg));
                 auto t1 = std::chrono::high_resolution_clock::now();
                 double tpf = 1.0 / decoder->display_desc.fps;
                 if (std::chrono::duration_cast<std::chrono::duration<double>>(t1 - t0).count() > tpf && decoder->stats.displayed > 20) {
@@ -1588,19 +1785,30 @@ cleanup:
         pbuf_data->max_frame_size = max(pbuf_data->max_frame_size, frame_size);
         pbuf_data->decoded++;
 
+        if (buffer_number == -1) {
+                return ret;
+        }
+
         /// @todo figure out multiple substreams
         if (decoder->last_buffer_number != -1) {
                 long int missing = buffer_number -
                         ((decoder->last_buffer_number + 1) & 0x3fffff);
                 missing = (missing + 0x3fffff) % 0x3fffff;
+                // frames skipped by playout buffer are not missing
+                long int skipped = stats->skipped_frames_cum - decoder->last_skipped_frames;
                 lock_guard<mutex> lk(decoder->stats.lock);
                 if (missing < 0x3fffff / 2) {
+                        skipped = min(skipped, missing);
+                        missing -= skipped;
+                        decoder->stats.dropped += skipped;
+                        decoder->stats.skipped += skipped;
                         decoder->stats.missing += missing;
                 } else { // frames may have been reordered, add arbitrary 1
                         decoder->stats.missing += 1;
                 }
         }
         decoder->last_buffer_number = buffer_number;
+        decoder->last_skipped_frames = stats->skipped_frames_cum;
 
         return ret;
 }
@@ -52,6 +52,7 @@
  */
 
 #include "types.h"
+#include "rtp/rtp.h"
 
 struct coded_data;
 struct display;
@@ -67,6 +68,7 @@ extern "C" {
 #endif // __cplusplus
 
 int decode_video_frame(struct coded_data *received_data, void *decoder_data, struct pbuf_stats *stats);
+bool video_decoder_frames_skippable(void *decoder_data);
 
 struct state_video_decoder *video_decoder_init(struct module *parent, enum video_mode,
                 struct display *display, const char *encryption);
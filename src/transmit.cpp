@@ -72,15 +72,32 @@
 #include "crypto/openssl_encrypt.h"
 #include "module.h"
 #include "rtp/fec.h"
+#include "rtp/fec_control.h"
+#include "rtp/fec_interleaved.h"
+#include "rtp/pacer.h"
+#include "rtp/rate_control.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/rtpenc_h264.h"
 #include "tv.h"
 #include "transmit.h"
+#include "utils/misc.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_codec.h"
 
+extern "C" {
+#include "rs/fec.h"
+}
+
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #define TRANSMIT_MAGIC	0xe80ab15f
 
@@ -102,6 +119,17 @@
 
 #define DEFAULT_CIPHER_MODE MODE_AES128_CFB
 
+#define DEFAULT_ARQ_HISTORY 16384 ///< packets, must be a power of two
+#define ARQ_STATS_INTERVAL_SEC 10
+#define TX_SESSION_IDLE_SEC 5   ///< per-session state unused for this time is released
+#define TX_MAX_SESSIONS 16      ///< max sessions with ARQ history or interleaved encoder
+
+#define DEFAULT_TFRC_MIN_BITRATE (1000ll * 1000)
+#define TFRC_COMPRESS_UPDATE_INTERVAL_SEC 1 ///< minimal interval between compression bitrate changes
+#define TFRC_COMPRESS_HEADROOM 0.9          ///< portion of the sending rate left for compressed data
+#define FEC_CONTROL_UPDATE_INTERVAL_SEC 1   ///< minimal interval between FEC redundancy changes
+#define AUDIO_FEC_MAX_N 255                 ///< maximal number of packets of an audio RS group
+
 // Mulaw audio memory reservation
 #define BUFFER_MTU_SIZE 1500
 static char *data_buffer_mulaw;
@@ -111,15 +139,53 @@ static void tx_update(struct tx *tx, struct video_frame *frame, int substream);
 static void tx_done(struct module *tx);
 static uint32_t format_interl_fps_hdr_row(enum interlacing_t interlacing, double input_fps);
 
+struct tx_tile_barrier;
+
+/**
+ * Sending context of one tile
+ */
+struct tx_tile_ctx {
+        struct rtp *rtp_session;
+        struct pacer *pacer;
+        unsigned int buffer_id;
+        int parallel;                     ///< number of tiles sent simultaneously
+        struct tx_tile_barrier *m_barrier; ///< if set, packet with m-bit waits for the other tiles
+};
+
 static void
-tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
+tx_send_base(struct tx *tx, struct video_frame *frame, struct tx_tile_ctx *ctx,
                 uint32_t ts, int send_m,
                 unsigned int substream,
                 int fragment_offset);
+static bool tx_can_send_parallel(struct tx *tx, struct video_frame *frame);
+static void tx_send_parallel(struct tx *tx, struct video_frame *frame,
+                struct rtp **rtp_sessions, struct rtp *rtp_session, uint32_t ts);
+
+ADD_TO_PARAM(arq, "arq",
+                "* arq[=<budget_ms>[:<history>]]\n"
+                "  Retransmit lost video packets requested by receiver (RTCP NACK), must be\n"
+                "  set on both sides. Packets older than budget (default 50 ms) are neither\n"
+                "  requested nor resent, history is number of packets kept by sender.\n");
+ADD_TO_PARAM(tfrc, "tfrc",
+                "* tfrc[=<min_bitrate>]\n"
+                "  Equation-based congestion control of video, must be set on both sides.\n"
+                "  Receiver sends frequent RTCP reports, sender adapts its sending rate (and\n"
+                "  libavcodec bitrate) to them, never below min_bitrate (default 1M).\n"
+                "  Bitrate given by -l is used as the upper bound.\n");
+ADD_TO_PARAM(adaptive_fec, "adaptive-fec",
+                "* adaptive-fec\n"
+                "  Adapt redundancy of video RS (-f rs:<k>:<n>) or mult FEC to the loss\n"
+                "  reported by receivers, configured n or mult count is the maximum. Must be set\n"
+                "  on both sides (receiver then sends frequent RTCP reports).\n");
+ADD_TO_PARAM(tx_parallel, "tx-parallel",
+                "* tx-parallel\n"
+                "  Send individual tiles (or split substreams) simultaneously, each from\n"
+                "  its own thread and socket queue (not used with encryption).\n");
 
 
 static bool set_fec(struct tx *tx, const char *fec);
 static void fec_check_messages(struct tx *tx);
+static void tx_rate_control_update(struct tx *tx, struct video_frame *frame);
 
 struct tx {
         struct module mod;
@@ -145,12 +211,350 @@ struct tx {
         const struct openssl_encrypt_info *enc_funcs;
         struct openssl_encrypt *encryption;
         long long int bitrate;
+
+        struct pacer *pacer;
+        bool parallel;              ///< send tiles in parallel, see tx-parallel param
+        struct pacer **tile_pacers; ///< pacers for tiles sent in parallel
+        int tile_pacers_count;
+        struct tx_arq *arq;         ///< retransmission state, NULL if ARQ is disabled
+        struct tx_audio_fec *audio_fec;    ///< audio RS coding state (-f A:rs:<k>:<n>)
+        struct tx_interleaved *interleaved; ///< interleaved parity state, kept after switching to other FEC
+        struct rate_control *rate_control; ///< NULL if congestion control is disabled
+        struct fec_control *fec_control;   ///< NULL if FEC redundancy is not adaptive
+        int fec_k;                         ///< RS k (adaptive FEC)
+        int fec_max_m;                     ///< RS n - k or mult count requested by user
+        int fec_m;                         ///< current RS n - k
+        struct timeval fec_changed;
+        long long int compress_bitrate;    ///< sending rate of last compression bitrate change
+        struct timeval compress_bitrate_changed;
 		
 #ifdef HAVE_RTSP_SERVER
         struct rtpenc_h264_state *rtpenc_h264_state;
 #endif
 };
 
+/**
+ * Makes the tile sending the m-bit wait until the other tiles of the frame
+ * are sent, so that the receiver doesn't consider the frame complete prematurely.
+ */
+struct tx_tile_barrier {
+        std::mutex lock;
+        std::condition_variable cv;
+        int remaining;
+
+        void done() {
+                std::unique_lock<std::mutex> lk(lock);
+                remaining -= 1;
+                lk.unlock();
+                cv.notify_one();
+        }
+        void wait() {
+                std::unique_lock<std::mutex> lk(lock);
+                cv.wait(lk, [this]{ return remaining == 0; });
+        }
+};
+
+/**
+ * Recently sent packets of one RTP session that can be retransmitted upon
+ * NACK. Packets are stored in a ring indexed by sequence number.
+ */
+struct tx_arq_history {
+        struct packet {
+                bool valid = false;
+                uint16_t seq;
+                std::chrono::steady_clock::time_point sent;
+                std::vector<char> data;
+        };
+
+        tx_arq_history(int size, std::chrono::milliseconds b) : ring(size), budget(b) {}
+
+        uint32_t ssrc = 0;                               ///< SSRC of the session the history belongs to
+        std::chrono::steady_clock::time_point last_used; ///< last tx_attach_session()
+        std::mutex lock;
+        std::vector<packet> ring;
+        std::chrono::milliseconds budget;
+
+        long long retransmitted = 0;
+        long long expired = 0;
+        std::chrono::steady_clock::time_point last_stats = std::chrono::steady_clock::now();
+};
+
+/**
+ * Histories are looked up by the session when a NACK arrives (from the
+ * receiving thread), so that a released history is never accessed.
+ */
+struct tx_arq {
+        std::chrono::milliseconds budget{DEFAULT_ARQ_BUDGET_MS};
+        int history = DEFAULT_ARQ_HISTORY;
+        std::mutex lock; ///< protects sessions
+        std::map<struct rtp *, std::unique_ptr<tx_arq_history>> sessions;
+};
+
+static void tx_arq_store(void *udata, uint16_t seq, const char *hdr, int hdr_len,
+                const char *phdr, int phdr_len, const char *data, int data_len)
+{
+        auto h = static_cast<tx_arq_history *>(udata);
+        std::lock_guard<std::mutex> lk(h->lock);
+        auto &p = h->ring[seq & (h->ring.size() - 1)];
+        p.valid = true;
+        p.seq = seq;
+        p.sent = std::chrono::steady_clock::now();
+        p.data.resize(hdr_len + phdr_len + data_len);
+        memcpy(p.data.data(), hdr, hdr_len);
+        memcpy(p.data.data() + hdr_len, phdr, phdr_len);
+        memcpy(p.data.data() + hdr_len + phdr_len, data, data_len);
+}
+
+static void tx_arq_resend(struct rtp *session, void *udata, uint16_t seq)
+{
+        auto arq = static_cast<tx_arq *>(udata);
+        std::lock_guard<std::mutex> arq_lk(arq->lock);
+        auto it = arq->sessions.find(session);
+        if (it == arq->sessions.end() || it->second->ssrc != rtp_my_ssrc(session)) {
+                return;
+        }
+        tx_arq_history *h = it->second.get();
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lk(h->lock);
+        auto &p = h->ring[seq & (h->ring.size() - 1)];
+        if (p.valid && p.seq == seq && now - p.sent < h->budget) {
+                rtp_send_raw_rtp_data(session, p.data.data(), p.data.size());
+                h->retransmitted += 1;
+        } else {
+                h->expired += 1;
+        }
+
+        if (now - h->last_stats > std::chrono::seconds(ARQ_STATS_INTERVAL_SEC)) {
+                log_msg(LOG_LEVEL_VERBOSE, "[ARQ] %lld packets retransmitted, %lld requests "
+                                "for packets out of history (cumulative)\n",
+                                h->retransmitted, h->expired);
+                h->last_stats = now;
+        }
+}
+
+static struct tx_arq *tx_arq_init(const char *cfg)
+{
+        auto arq = new tx_arq();
+        if (strlen(cfg) > 0) {
+                arq->budget = std::chrono::milliseconds(atoi(cfg));
+                if (strchr(cfg, ':')) {
+                        arq->history = atoi(strchr(cfg, ':') + 1);
+                }
+        }
+        if (arq->history <= 0 || (arq->history & (arq->history - 1)) != 0) {
+                log_msg(LOG_LEVEL_WARNING, "[ARQ] History size must be a power of two, using %d.\n",
+                                DEFAULT_ARQ_HISTORY);
+                arq->history = DEFAULT_ARQ_HISTORY;
+        }
+        return arq;
+}
+
+/**
+ * Interleaved parity encoders of RTP sessions. The parity is computed from
+ * packets passed to the send hook, which also forwards them to the ARQ
+ * history if retransmissions are enabled.
+ */
+struct tx_interleaved {
+        struct session {
+                struct fec_interleaved_tx *enc = nullptr;
+                tx_arq_history *arq = nullptr;
+                uint32_t ssrc = 0;
+                std::chrono::steady_clock::time_point last_used;
+                ~session() {
+                        fec_interleaved_tx_done(enc);
+                }
+        };
+
+        std::string cfg;
+        std::map<struct rtp *, std::unique_ptr<session>> sessions;
+};
+
+static void tx_interleaved_store(void *udata, uint16_t seq, const char *hdr, int hdr_len,
+                const char *phdr, int phdr_len, const char *data, int data_len)
+{
+        auto s = static_cast<tx_interleaved::session *>(udata);
+        fec_interleaved_tx_add(s->enc, seq, hdr, hdr_len, phdr, phdr_len, data, data_len);
+        if (s->arq) {
+                tx_arq_store(s->arq, seq, hdr, hdr_len, phdr, phdr_len, data, data_len);
+        }
+}
+
+/// @returns interleaved parity encoder of rtp_session or NULL if not used
+static struct fec_interleaved_tx *tx_interleaved_encoder(struct tx *tx, struct rtp *rtp_session)
+{
+        if (tx->fec_scheme != FEC_INTERLEAVED) {
+                return NULL;
+        }
+        auto it = tx->interleaved->sessions.find(rtp_session);
+        return it != tx->interleaved->sessions.end() ? it->second->enc : NULL;
+}
+
+/**
+ * Packet-level RS coding of audio. Symbols of the packets sent in the current
+ * group are collected and parity packets are sent after K packets or after
+ * the last packet of a frame, see audio_fec_payload_hdr_t.
+ */
+struct tx_audio_fec {
+        tx_audio_fec(int k, int n, unsigned mtu) : k(k), m(n - k),
+                max_ss(sizeof(uint16_t) + mtu + MAX_CRYPTO_EXCEED), symbols(n * max_ss)
+        {
+                code = fec_new(k, n);
+        }
+        ~tx_audio_fec() {
+                fec_free(code);
+        }
+
+        fec_t *code;
+        int k, m;
+        int max_ss;
+        int count = 0;                       ///< packets in current group
+        int ss = 0;                          ///< symbol size of current group
+        std::vector<unsigned char> symbols;  ///< k data followed by m parity symbols
+};
+
+static void tx_audio_fec_add(struct tx_audio_fec *f, const char *hdr, int hdr_len,
+                const char *data, int data_len)
+{
+        unsigned char *sym = f->symbols.data() + f->count * f->max_ss;
+        uint16_t len = htons(hdr_len + data_len);
+        memcpy(sym, &len, sizeof len);
+        memcpy(sym + sizeof len, hdr, hdr_len);
+        memcpy(sym + sizeof len + hdr_len, data, data_len);
+        f->ss = std::max<int>(f->ss, sizeof len + hdr_len + data_len);
+        f->count += 1;
+}
+
+/**
+ * Sends parity packets of the current group and starts a new one.
+ * @param m whether the last packet of the group had the m-bit set
+ */
+static void tx_audio_fec_flush(struct tx_audio_fec *f, struct rtp *rtp_session, uint32_t timestamp,
+                int pt, bool m)
+{
+        if (f->count == 0) {
+                return;
+        }
+        const gf *src[AUDIO_FEC_MAX_N];
+        gf *dst[AUDIO_FEC_MAX_N];
+        unsigned int dst_idx[AUDIO_FEC_MAX_N];
+        for (int i = 0; i < f->k; ++i) {
+                unsigned char *sym = f->symbols.data() + i * f->max_ss;
+                if (i < f->count) {
+                        uint16_t len;
+                        memcpy(&len, sym, sizeof len);
+                        memset(sym + sizeof len + ntohs(len), 0, f->ss - sizeof len - ntohs(len));
+                } else {
+                        memset(sym, 0, f->ss);
+                }
+                src[i] = sym;
+        }
+        for (int i = 0; i < f->m; ++i) {
+                dst[i] = f->symbols.data() + (f->k + i) * f->max_ss;
+                dst_idx[i] = f->k + i;
+        }
+        fec_encode(f->code, src, dst, dst_idx, f->m, f->ss);
+
+        for (int i = 0; i < f->m; ++i) {
+                audio_fec_payload_hdr_t hdr;
+                hdr[0] = htonl(f->k << 24 | f->m << 16 | f->count << 8 | i);
+                hdr[1] = htonl(pt << 25 | (m ? 1 : 0) << 24 | f->ss);
+                rtp_send_data_hdr(rtp_session, timestamp, PT_AUDIO_RS, 0, 0, 0,
+                                (char *) hdr, sizeof hdr, (char *) dst[i], f->ss, 0, 0, 0);
+        }
+        f->count = 0;
+        f->ss = 0;
+}
+
+static void tx_receiver_report(struct rtp *session, void *udata, uint32_t reporter_ssrc, const rtcp_rr *rr)
+{
+        UNUSED(session);
+        struct tx *tx = (struct tx *) udata;
+        if (tx->rate_control) {
+                rate_control_report(tx->rate_control, reporter_ssrc, rr);
+        }
+        if (tx->fec_control) {
+                fec_control_report(tx->fec_control, reporter_ssrc, rr);
+        }
+}
+
+/**
+ * Releases state of sessions not used for TX_SESSION_IDLE_SEC (sessions are
+ * destroyed after a network reconfiguration). Above TX_MAX_SESSIONS, the least
+ * recently used ones are released sooner, but never those used in the last
+ * second, whose hooks may be in use by the current frame.
+ */
+template<typename T>
+static void tx_release_idle_sessions(std::map<struct rtp *, std::unique_ptr<T>> &sessions,
+                std::chrono::steady_clock::time_point now)
+{
+        typedef typename std::map<struct rtp *, std::unique_ptr<T>>::value_type entry;
+        for (auto it = sessions.begin(); it != sessions.end(); ) {
+                if (now - it->second->last_used > std::chrono::seconds(TX_SESSION_IDLE_SEC)) {
+                        it = sessions.erase(it);
+                } else {
+                        ++it;
+                }
+        }
+        while (sessions.size() > TX_MAX_SESSIONS) {
+                auto lru = std::min_element(sessions.begin(), sessions.end(),
+                                [](entry const &a, entry const &b) {
+                                        return a.second->last_used < b.second->last_used;
+                                });
+                if (now - lru->second->last_used < std::chrono::seconds(1)) {
+                        break;
+                }
+                sessions.erase(lru);
+        }
+}
+
+/**
+ * Registers hooks storing sent packets, serving NACKs and passing receiver
+ * reports to the congestion and FEC control for rtp_session. The hooks are set
+ * again with every frame because the session may be recreated (at the same
+ * address) after a network reconfiguration. State of a recreated session is
+ * detected by a changed SSRC and reset.
+ *
+ * Must be called before sending to rtp_session, because state of other
+ * sessions may be released.
+ */
+static void tx_attach_session(struct tx *tx, struct rtp *rtp_session)
+{
+        if (tx->rate_control || tx->fec_control) {
+                rtp_set_rr_callback(rtp_session, tx_receiver_report, tx);
+        }
+        auto now = std::chrono::steady_clock::now();
+        uint32_t ssrc = rtp_my_ssrc(rtp_session);
+        tx_arq_history *arq = NULL;
+        if (tx->arq) {
+                std::lock_guard<std::mutex> lk(tx->arq->lock);
+                tx_release_idle_sessions(tx->arq->sessions, now);
+                auto &h = tx->arq->sessions[rtp_session];
+                if (!h || h->ssrc != ssrc) {
+                        h = std::unique_ptr<tx_arq_history>(new tx_arq_history(tx->arq->history, tx->arq->budget));
+                        h->ssrc = ssrc;
+                }
+                h->last_used = now;
+                arq = h.get();
+                rtp_set_nack_callback(rtp_session, tx_arq_resend, tx->arq);
+        }
+        if (tx->fec_scheme == FEC_INTERLEAVED) {
+                tx_release_idle_sessions(tx->interleaved->sessions, now);
+                auto &s = tx->interleaved->sessions[rtp_session];
+                if (!s || s->ssrc != ssrc) {
+                        s = std::unique_ptr<tx_interleaved::session>(new tx_interleaved::session());
+                        s->enc = fec_interleaved_tx_init(tx->interleaved->cfg.c_str());
+                        s->ssrc = ssrc;
+                }
+                s->last_used = now;
+                s->arq = arq;
+                rtp_set_send_hook(rtp_session, tx_interleaved_store, s.get());
+        } else if (arq) {
+                rtp_set_send_hook(rtp_session, tx_arq_store, arq);
+        } else if (tx->interleaved) {
+                rtp_set_send_hook(rtp_session, NULL, NULL);
+        }
+}
+
 // Mulaw audio memory reservation
 static void init_tx_mulaw_buffer() {
     if (!buffer_mulaw_init) {
@@ -221,6 +625,11 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                 tx->avg_len = tx->avg_len_last = tx->sent_frames = 0u;
                 tx->fec_scheme = FEC_NONE;
                 tx->last_frame_fragment_id = -1;
+                tx->pacer = pacer_init();
+                tx->parallel = get_commandline_param("tx-parallel") != NULL;
+                if (get_commandline_param("arq") && media_type == TX_MEDIA_VIDEO) {
+                        tx->arq = tx_arq_init(get_commandline_param("arq"));
+                }
                 if (fec) {
                         if(!set_fec(tx, fec)) {
                                 module_done(&tx->mod);
@@ -244,6 +653,19 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                 }
 
                 tx->bitrate = bitrate;
+                if (get_commandline_param("tfrc") && media_type == TX_MEDIA_VIDEO) {
+                        const char *min_bitrate = get_commandline_param("tfrc");
+                        tx->rate_control = rate_control_init(strlen(min_bitrate) > 0 ? unit_evaluate(min_bitrate) :
+                                        DEFAULT_TFRC_MIN_BITRATE, std::max(bitrate, 0ll), mtu);
+                }
+                if (get_commandline_param("adaptive-fec") && media_type == TX_MEDIA_VIDEO) {
+                        if ((tx->fec_scheme == FEC_RS && tx->fec_k > 0) ||
+                                        (tx->fec_scheme == FEC_MULT && tx->mult_count > 1)) {
+                                tx->fec_control = fec_control_init();
+                        } else {
+                                log_msg(LOG_LEVEL_WARNING, "Adaptive FEC needs -f rs:<k>:<n> or -f mult:<count>, disabled.\n");
+                        }
+                }
 #ifdef HAVE_RTSP_SERVER
                 tx->rtpenc_h264_state = rtpenc_h264_init_state();
 #endif
@@ -282,6 +704,7 @@ static bool set_fec(struct tx *tx, const char *fec_const)
                 assert(fec_cfg);
                 tx->mult_count = (unsigned int) atoi(fec_cfg);
                 assert(tx->mult_count <= FEC_MAX_MULT);
+                tx->fec_max_m = tx->mult_count;
         } else if(strcasecmp(fec, "LDGM") == 0) {
                 if(tx->media_type == TX_MEDIA_AUDIO) {
                         fprintf(stderr, "LDGM is not currently supported for audio!\n");
@@ -297,12 +720,43 @@ static bool set_fec(struct tx *tx, const char *fec_const)
                 }
         } else if(strcasecmp(fec, "RS") == 0) {
                 if(tx->media_type == TX_MEDIA_AUDIO) {
-                        fprintf(stderr, "LDGM is not currently supported for audio!\n");
-                        ret = false;
+                        int k, n;
+                        if (!fec_cfg || sscanf(fec_cfg, "%d:%d", &k, &n) != 2 || k < 1 || n <= k ||
+                                        n > AUDIO_FEC_MAX_N) {
+                                log_msg(LOG_LEVEL_ERROR, "Audio RS usage: -f A:rs:<k>:<n>, where "
+                                                "0 < k < n <= %d (packets)\n", AUDIO_FEC_MAX_N);
+                                ret = false;
+                        } else {
+                                delete tx->audio_fec;
+                                tx->audio_fec = new tx_audio_fec(k, n, tx->mtu);
+                                tx->fec_scheme = FEC_RS;
+                        }
                 } else {
                         snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "RS cfg %s",
                                         fec_cfg ? fec_cfg : "");
                         tx->fec_scheme = FEC_RS;
+                        int k, n;
+                        if (fec_cfg && sscanf(fec_cfg, "%d:%d", &k, &n) == 2 && n >= k) {
+                                tx->fec_k = k;
+                                tx->fec_m = tx->fec_max_m = n - k;
+                        } else {
+                                tx->fec_k = 0;
+                        }
+                }
+        } else if (strcasecmp(fec, "interleaved") == 0) {
+                struct fec_interleaved_tx *test;
+                if (tx->media_type == TX_MEDIA_AUDIO) {
+                        fprintf(stderr, "Interleaved FEC is not currently supported for audio!\n");
+                        ret = false;
+                } else if (!(test = fec_interleaved_tx_init(fec_cfg))) {
+                        ret = false;
+                } else {
+                        fec_interleaved_tx_done(test);
+                        // encoders are created per session by tx_attach_session()
+                        delete tx->interleaved;
+                        tx->interleaved = new tx_interleaved();
+                        tx->interleaved->cfg = fec_cfg;
+                        tx->fec_scheme = FEC_INTERLEAVED;
                 }
         } else {
                 fprintf(stderr, "Unknown FEC: %s\n", fec);
@@ -344,10 +798,112 @@ static void fec_check_messages(struct tx *tx)
         }
 }
 
+/**
+ * Sets the sending rate allowed by the congestion control and asks the
+ * compression (via sender) to follow it if it changed significantly.
+ */
+static void tx_rate_control_update(struct tx *tx, struct video_frame *frame)
+{
+        if (!tx->rate_control) {
+                return;
+        }
+        long long rate = rate_control_get_rate(tx->rate_control);
+        if (rate == 0) { // no feedback yet
+                return;
+        }
+        tx->bitrate = rate;
+
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        if (tv_diff(now, tx->compress_bitrate_changed) < TFRC_COMPRESS_UPDATE_INTERVAL_SEC ||
+                        llabs(rate - tx->compress_bitrate) < tx->compress_bitrate / 10) {
+                return;
+        }
+        tx->compress_bitrate = rate;
+        tx->compress_bitrate_changed = now;
+        log_msg(LOG_LEVEL_VERBOSE, "[TFRC] Sending rate changed to %.2f Mbps.\n", rate / 1000000.0);
+
+        if (!is_codec_opaque(frame->color_spec)) {
+                return;
+        }
+        double payload_ratio = TFRC_COMPRESS_HEADROOM / tx->mult_count;
+        if (frame->fec_params.type != FEC_NONE && frame->fec_params.k > 0) {
+                payload_ratio = payload_ratio * frame->fec_params.k / (frame->fec_params.k + frame->fec_params.m);
+        }
+        struct msg_sender *msg = (struct msg_sender *) new_message(sizeof(struct msg_sender));
+        msg->type = SENDER_MSG_CHANGE_BITRATE;
+        msg->bitrate = rate * payload_ratio;
+        struct response *resp = send_message_to_receiver(get_parent_module(&tx->mod),
+                        (struct message *) msg);
+        free_response(resp);
+}
+
+/**
+ * Changes redundancy of RS or mult FEC according to the loss reported by
+ * receivers. Redundancy is changed at most once per
+ * FEC_CONTROL_UPDATE_INTERVAL_SEC, RS is reconfigured via sender as if
+ * requested by user.
+ */
+static void tx_fec_control_update(struct tx *tx, struct video_frame *frame)
+{
+        if (!tx->fec_control || (tx->fec_scheme == FEC_RS && tx->fec_k == 0) ||
+                        (tx->fec_scheme != FEC_RS && tx->fec_scheme != FEC_MULT)) {
+                return;
+        }
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        if (tv_diff(now, tx->fec_changed) < FEC_CONTROL_UPDATE_INTERVAL_SEC) {
+                return;
+        }
+
+        if (tx->fec_scheme == FEC_MULT) {
+                int mult = fec_control_mult(tx->fec_control, std::max(tx->fec_max_m, 1));
+                if (mult != tx->mult_count) {
+                        log_msg(LOG_LEVEL_VERBOSE, "[FEC control] Loss %.2f %%, sending %d copies of packets.\n",
+                                        fec_control_get_loss(tx->fec_control) * 100.0, mult);
+                        tx->mult_count = mult;
+                        tx->fec_changed = now;
+                }
+                return;
+        }
+
+        int payload_len = tx->mtu - (40 + sizeof(fec_video_payload_hdr_t));
+        int symbol_packets = frame->fec_params.type == FEC_RS ?
+                (frame->fec_params.symbol_size + payload_len - 1) / payload_len : 1;
+        int m = fec_control_rs_parity(tx->fec_control, tx->fec_k, tx->fec_max_m, symbol_packets);
+        if (m == tx->fec_m) {
+                return;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, "[FEC control] Loss %.2f %%, changing RS to %d:%d.\n",
+                        fec_control_get_loss(tx->fec_control) * 100.0, tx->fec_k, tx->fec_k + m);
+        struct msg_sender *msg = (struct msg_sender *) new_message(sizeof(struct msg_sender));
+        msg->type = SENDER_MSG_CHANGE_FEC;
+        snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "RS cfg %d:%d", tx->fec_k, tx->fec_k + m);
+        struct response *resp = send_message_to_receiver(get_parent_module(&tx->mod),
+                        (struct message *) msg);
+        free_response(resp);
+        tx->fec_m = m;
+        tx->fec_changed = now;
+}
+
 static void tx_done(struct module *mod)
 {
         struct tx *tx = (struct tx *) mod->priv_data;
         assert(tx->magic == TRANSMIT_MAGIC);
+        pacer_done(tx->pacer);
+        for (int i = 0; i < tx->tile_pacers_count; ++i) {
+                pacer_done(tx->tile_pacers[i]);
+        }
+        free(tx->tile_pacers);
+        delete tx->arq;
+        delete tx->audio_fec;
+        delete tx->interleaved;
+        if (tx->rate_control) {
+                rate_control_done(tx->rate_control);
+        }
+        if (tx->fec_control) {
+                fec_control_done(tx->fec_control);
+        }
         free(tx);
 }
 
@@ -363,6 +919,9 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
         fec_check_messages(tx);
+        tx_attach_session(tx, rtp_session);
+        tx_rate_control_update(tx, frame);
+        tx_fec_control_update(tx, frame);
 
         ts = get_local_mediatime();
         if(frame->fragment &&
@@ -373,6 +932,11 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
                 tx->last_ts = ts;
         }
 
+        if (tx_can_send_parallel(tx, frame)) {
+                tx_send_parallel(tx, frame, NULL, rtp_session, ts);
+                return;
+        }
+
         for(i = 0; i < frame->tile_count; ++i)
         {
                 int last = FALSE;
@@ -385,12 +949,37 @@ tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
                 if(frame->fragment)
                         fragment_offset = vf_get_tile(frame, i)->offset;
 
-                tx_send_base(tx, frame, rtp_session, ts, last,
+                struct tx_tile_ctx ctx = { rtp_session, tx->pacer, tx->buffer, 1, NULL };
+                tx_update(tx, frame, i);
+                tx_send_base(tx, frame, &ctx, ts, last,
                                 i, fragment_offset);
                 tx->buffer ++;
         }
 }
 
+/*
+ * sends each tile of frame to corresponding session from rtp_sessions (eg. split
+ * connections), in parallel if requested (see tx-parallel param)
+ */
+void
+tx_send_tiles(struct tx *tx, struct video_frame *frame, struct rtp **rtp_sessions)
+{
+        if (!tx_can_send_parallel(tx, frame)) {
+                for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                        tx_send_tile(tx, frame, i, rtp_sessions[i]);
+                }
+                return;
+        }
+
+        fec_check_messages(tx);
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                tx_attach_session(tx, rtp_sessions[i]);
+        }
+        tx_rate_control_update(tx, frame);
+        tx_fec_control_update(tx, frame);
+        tx_send_parallel(tx, frame, rtp_sessions, NULL, get_local_mediatime());
+}
+
 void format_video_header(struct video_frame *frame, int tile_idx, int buffer_idx, uint32_t *video_hdr)
 {
         uint32_t tmp;
@@ -416,6 +1005,9 @@ tx_send_tile(struct tx *tx, struct video_frame *frame, int pos, struct rtp *rtp_
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
         fec_check_messages(tx);
+        tx_attach_session(tx, rtp_session);
+        tx_rate_control_update(tx, frame);
+        tx_fec_control_update(tx, frame);
 
         ts = get_local_mediatime();
         if(frame->fragment &&
@@ -429,11 +1021,103 @@ tx_send_tile(struct tx *tx, struct video_frame *frame, int pos, struct rtp *rtp_
                 last = TRUE;
         if(frame->fragment)
                 fragment_offset = vf_get_tile(frame, pos)->offset;
-        tx_send_base(tx, frame, rtp_session, ts, last, pos,
+        struct tx_tile_ctx ctx = { rtp_session, tx->pacer, tx->buffer, 1, NULL };
+        tx_update(tx, frame, pos);
+        tx_send_base(tx, frame, &ctx, ts, last, pos,
                         fragment_offset);
         tx->buffer ++;
 }
 
+static bool tx_can_send_parallel(struct tx *tx, struct video_frame *frame)
+{
+        return tx->parallel && frame->tile_count > 1 && !frame->fragment && !tx->encryption &&
+                tx->fec_scheme != FEC_INTERLEAVED;
+}
+
+struct tx_tile_task {
+        struct tx *tx;
+        struct video_frame *frame;
+        struct tx_tile_ctx ctx;
+        uint32_t ts;
+        int send_m;
+        unsigned int substream;
+};
+
+static void *tx_send_tile_task(void *arg)
+{
+        struct tx_tile_task *t = (struct tx_tile_task *) arg;
+        tx_send_base(t->tx, t->frame, &t->ctx, t->ts, t->send_m, t->substream, 0);
+        if (t->ctx.m_barrier && !t->send_m) {
+                t->ctx.m_barrier->done();
+        }
+        return NULL;
+}
+
+/**
+ * Sends all tiles of the frame simultaneously.
+ *
+ * @param rtp_sessions if not NULL, tile i is sent as a standalone stream to
+ *                     rtp_sessions[i] (split connections)
+ * @param rtp_session  otherwise all tiles are sent as one frame through sender
+ *                     clones of this session, m-bit is sent after all the tiles
+ */
+static void tx_send_parallel(struct tx *tx, struct video_frame *frame,
+                struct rtp **rtp_sessions, struct rtp *rtp_session, uint32_t ts)
+{
+        int count = frame->tile_count;
+        struct tx_tile_task tasks[count];
+        task_result_handle_t handles[count];
+        struct rtp *clones[count];
+        struct tx_tile_barrier barrier;
+        barrier.remaining = count - 1;
+
+        if (tx->tile_pacers_count < count) {
+                tx->tile_pacers = (struct pacer **) realloc(tx->tile_pacers, count * sizeof(struct pacer *));
+                for (int i = tx->tile_pacers_count; i < count; ++i) {
+                        tx->tile_pacers[i] = pacer_init();
+                }
+                tx->tile_pacers_count = count;
+        }
+
+        for (int i = 0; i < count; ++i) {
+                clones[i] = rtp_sessions ? NULL : rtp_init_sender_clone(rtp_session);
+                if (rtp_sessions == NULL && clones[i] == NULL) {
+                        log_msg(LOG_LEVEL_ERROR, "Unable to create sender clone, sending serially.\n");
+                        for (int j = 0; j < i; ++j) {
+                                rtp_done_sender_clone(clones[j]);
+                        }
+                        tx->parallel = false;
+                        tx_send(tx, frame, rtp_session);
+                        return;
+                }
+                tasks[i].tx = tx;
+                tasks[i].frame = frame;
+                tasks[i].ctx.rtp_session = rtp_sessions ? rtp_sessions[i] : clones[i];
+                tasks[i].ctx.pacer = tx->tile_pacers[i];
+                tasks[i].ctx.buffer_id = tx->buffer + i;
+                tasks[i].ctx.parallel = count;
+                tasks[i].ctx.m_barrier = rtp_sessions ? NULL : &barrier;
+                tasks[i].ts = ts;
+                tasks[i].send_m = rtp_sessions || i == count - 1;
+                tasks[i].substream = i;
+                tx_update(tx, frame, i);
+        }
+
+        // last tile is sent from this thread
+        for (int i = 0; i < count - 1; ++i) {
+                handles[i] = task_run_async(tx_send_tile_task, &tasks[i]);
+        }
+        tx_send_tile_task(&tasks[count - 1]);
+        for (int i = 0; i < count - 1; ++i) {
+                wait_task(handles[i]);
+        }
+
+        for (int i = 0; i < count; ++i) {
+                rtp_done_sender_clone(clones[i]);
+        }
+        tx->buffer += count;
+}
+
 static uint32_t format_interl_fps_hdr_row(enum interlacing_t interlacing, double input_fps)
 {
         unsigned int fpsd, fd, fps, fi;
@@ -480,12 +1164,13 @@ static inline int get_data_len(bool with_fec, int mtu, int hdrs_len,
 }
 
 static void
-tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
+tx_send_base(struct tx *tx, struct video_frame *frame, struct tx_tile_ctx *ctx,
                 uint32_t ts, int send_m,
                 unsigned int substream,
                 int fragment_offset)
 {
         struct tile *tile = &frame->tiles[substream];
+        struct rtp *rtp_session = ctx->rtp_session;
 
         int m, data_len;
         // see definition in rtp_callback.h
@@ -498,14 +1183,6 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         int pt;            /* A value specified in our packet format */
         char *data;
         unsigned int pos;
-#ifdef HAVE_LINUX
-        struct timespec start, stop;
-#elif defined HAVE_MACOSX
-        struct timeval start, stop;
-#else // Windows
-	LARGE_INTEGER start, stop, freq;
-#endif
-        long delta, overslept = 0;
         uint32_t tmp;
         int mult_pos[FEC_MAX_MULT];
         int mult_index = 0;
@@ -516,8 +1193,6 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
 
         assert(tx->magic == TRANSMIT_MAGIC);
 
-        tx_update(tx, frame, substream);
-
         perf_record(UVP_SEND, ts);
 
         if(tx->fec_scheme == FEC_MULT) {
@@ -566,6 +1241,10 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                         hdrs_len += (sizeof(video_payload_hdr_t));
                 }
         }
+        struct fec_interleaved_tx *interleaved = tx_interleaved_encoder(tx, rtp_session);
+        if (interleaved) { // parity of largest packets must also fit in MTU
+                hdrs_len += fec_interleaved_overhead();
+        }
 
         if (frame->fec_params.type != FEC_NONE) {
                 static bool status_printed = false;
@@ -582,11 +1261,11 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 }
         }
 
-        format_video_header(frame, substream, tx->buffer, video_hdr);
+        format_video_header(frame, substream, ctx->buffer_id, video_hdr);
 
         if (frame->fec_params.type != FEC_NONE) {
                 tmp = substream << 22;
-                tmp |= 0x3fffff & tx->buffer;
+                tmp |= 0x3fffff & ctx->buffer_id;
                 // see definition in rtp_callback.h
                 fec_hdr[0] = htonl(tmp);
                 fec_hdr[2] = htonl(tile->data_len);
@@ -616,7 +1295,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         if (tx->bitrate == RATE_UNLIMITED) {
                 packet_rate = 0;
         } else if (tx->bitrate == RATE_AUTO) {
-                double time_for_frame = 1.0 / frame->fps / frame->tile_count;
+                double time_for_frame = 1.0 / frame->fps / frame->tile_count * ctx->parallel;
                 double interval_between_pkts = time_for_frame / tx->mult_count / packet_count;
                 // use only 75% of the time
                 interval_between_pkts = interval_between_pkts * 0.75;
@@ -625,7 +1304,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 packet_rate = interval_between_pkts * 1000ll * 1000 * 1000;
         } else { // bitrate given manually
                 int avg_packet_size = tile->data_len / packet_count;
-                packet_rate = 1000ll * 1000 * 1000 * avg_packet_size * 8 / tx->bitrate;
+                packet_rate = 1000ll * 1000 * 1000 * avg_packet_size * 8 / tx->bitrate * ctx->parallel;
         }
 
         // initialize header array with values (except offset which is different among
@@ -642,8 +1321,9 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 rtp_async_start(rtp_session, packet_count);
         }
 
+        pacer_begin(ctx->pacer, rtp_session, packet_rate);
+
         do {
-                GET_STARTTIME;
                 if(tx->fec_scheme == FEC_MULT) {
                         pos = mult_pos[mult_index];
                 }
@@ -658,6 +1338,10 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 if (pos + data_len >= (unsigned int) tile->data_len) {
                         if (send_m) {
                                 m = 1;
+                                if (ctx->m_barrier) {
+                                        rtp_async_flush(rtp_session);
+                                        ctx->m_barrier->wait();
+                                }
                         }
                         data_len = tile->data_len - pos;
                 }
@@ -678,6 +1362,11 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                         rtp_send_data_hdr(rtp_session, ts, pt, m, 0, 0,
                                   (char *) rtp_hdr_packet, rtp_hdr_len,
                                   data, data_len, 0, 0, 0);
+                        // header slots are only for packets actually sent
+                        rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
+                        if (interleaved) {
+                                fec_interleaved_tx_flush(interleaved, rtp_session, ts);
+                        }
                 }
 
                 if(tx->fec_scheme == FEC_MULT) {
@@ -691,22 +1380,20 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 if(tx->fec_scheme == FEC_MULT) {
                         pos = mult_pos[tx->mult_count - 1];
                 }
-                rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
 
-                // TRAFFIS SHAPER
+                // TRAFFIC SHAPER
                 if (pos < (unsigned int) tile->data_len) { // wait for all but last packet
-                        do {
-                                GET_STOPTIME;
-                                GET_DELTA;
-                        } while (packet_rate - delta - overslept > 0);
-                        overslept = -(packet_rate - delta - overslept);
-                        //fprintf(stdout, "%ld ", overslept);
+                        pacer_packet_sent(ctx->pacer);
                 }
         } while (pos < (unsigned int) tile->data_len);
 
+        if (interleaved && send_m) {
+                fec_interleaved_tx_frame_done(interleaved, rtp_session, ts);
+        }
         if (!tx->encryption) {
                 rtp_async_wait(rtp_session);
         }
+        pacer_end(ctx->pacer);
         free(rtp_headers);
 }
 
@@ -758,6 +1445,9 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
         if(tx->encryption) {
                 hdrs_len += sizeof(crypto_payload_hdr_t);
         }
+        if (tx->fec_scheme == FEC_RS) { // parity packet carries also its header and symbol length
+                hdrs_len += sizeof(audio_fec_payload_hdr_t) + sizeof(uint16_t);
+        }
 
         for(channel = 0; channel < buffer->get_channel_count(); ++channel)
         {
@@ -850,6 +1540,14 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
                                       (char *) audio_hdr, rtp_hdr_len,
                                       const_cast<char *>(data), data_len,
                                       0, 0, 0);
+
+                                if (tx->fec_scheme == FEC_RS) {
+                                        tx_audio_fec_add(tx->audio_fec, (char *) audio_hdr, rtp_hdr_len,
+                                                        data, data_len);
+                                        if (tx->audio_fec->count == tx->audio_fec->k || m) {
+                                                tx_audio_fec_flush(tx->audio_fec, rtp_session, timestamp, pt, m);
+                                        }
+                                }
                         }
 
                         if(tx->fec_scheme == FEC_MULT) {
@@ -65,6 +65,9 @@
 extern "C" {
 #endif
 
+/// default time limit for retransmission of lost packets, see "arq" param
+#define DEFAULT_ARQ_BUDGET_MS 50
+
 struct module;
 struct rtp;
 struct tx;
@@ -74,6 +77,7 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                 const char *fec, const char *encryption, long long bitrate);
 void		 tx_send_tile(struct tx *tx_session, struct video_frame *frame, int pos, struct rtp *rtp_session);
 void             tx_send(struct tx *tx_session, struct video_frame *frame, struct rtp *rtp_session);
+void             tx_send_tiles(struct tx *tx_session, struct video_frame *frame, struct rtp **rtp_sessions);
 void             format_video_header(struct video_frame *frame, int tile_idx, int buffer_idx,
                 uint32_t *hdr);
 
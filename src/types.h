@@ -142,6 +142,7 @@ enum fec_type {
         FEC_MULT = 1,
         FEC_LDGM = 2,
         FEC_RS   = 3,
+        FEC_INTERLEAVED = 4, ///< XOR parity over interleaved packets, see rtp/fec_interleaved.h
 };
 
 struct fec_desc {
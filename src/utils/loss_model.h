@@ -0,0 +1,116 @@
+/**
+ * @file   utils/loss_model.h
+ * @brief  Synthetic packet loss models for offline FEC evaluation.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef LOSS_MODEL_H_
+#define LOSS_MODEL_H_
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+/**
+ * Decides which of the sent packets are lost. Packets are passed in the order
+ * they are sent, so models with memory (bursts) behave as on the network.
+ */
+class loss_model {
+public:
+        /**
+         * @param cfg bernoulli:<p> - every packet is lost with probability p
+         *            ge:<p>:<r>[:<loss_good>:<loss_bad>] - Gilbert-Elliott
+         *            model, p is probability of transition from good to bad
+         *            state, r from bad to good, packets are lost with
+         *            loss_good (default 0) and loss_bad (default 1)
+         *            probability in the respective state
+         * @returns NULL if cfg is invalid
+         */
+        static inline loss_model *create(const char *cfg, unsigned int seed) {
+                double p = 0.0, r = 1.0, loss_good = 0.0, loss_bad = 1.0;
+                if (strncmp(cfg, "bernoulli:", strlen("bernoulli:")) == 0) {
+                        if (sscanf(cfg + strlen("bernoulli:"), "%lf", &loss_bad) != 1) {
+                                return NULL;
+                        }
+                        p = 1.0; // always in bad state
+                        r = 0.0;
+                } else if (strncmp(cfg, "ge:", strlen("ge:")) == 0) {
+                        if (sscanf(cfg + strlen("ge:"), "%lf:%lf:%lf:%lf", &p, &r, &loss_good, &loss_bad) < 2) {
+                                return NULL;
+                        }
+                } else {
+                        return NULL;
+                }
+                if (!valid(p) || !valid(r) || !valid(loss_good) || !valid(loss_bad) || p + r == 0.0) {
+                        return NULL;
+                }
+                return new loss_model(p, r, loss_good, loss_bad, seed);
+        }
+
+        /// @returns whether the next sent packet is lost
+        inline bool lost() {
+                bool ret = m_uniform(m_gen) < (m_bad ? m_loss_bad : m_loss_good);
+                m_bad = m_uniform(m_gen) < (m_bad ? 1.0 - m_r : m_p);
+                return ret;
+        }
+
+        /// @returns long-term average loss rate
+        inline double mean_loss() const {
+                double bad = m_p / (m_p + m_r);
+                return bad * m_loss_bad + (1.0 - bad) * m_loss_good;
+        }
+
+private:
+        inline loss_model(double p, double r, double loss_good, double loss_bad, unsigned int seed) :
+                m_p(p), m_r(r), m_loss_good(loss_good), m_loss_bad(loss_bad), m_gen(seed),
+                m_uniform(0.0, 1.0)
+        {
+                // start in the stationary distribution
+                m_bad = m_uniform(m_gen) < p / (p + r);
+        }
+
+        static inline bool valid(double prob) {
+                return prob >= 0.0 && prob <= 1.0;
+        }
+
+        double m_p, m_r;
+        double m_loss_good, m_loss_bad;
+        bool m_bad;
+        std::mt19937 m_gen;
+        std::uniform_real_distribution<double> m_uniform;
+};
+
+#endif // LOSS_MODEL_H_
+
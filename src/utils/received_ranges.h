@@ -0,0 +1,172 @@
+/**
+ * @file   utils/received_ranges.h
+ * @brief  Set of received byte ranges of a (video) buffer.
+ */
+/*
+ * Copyright (c) 2018 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RECEIVED_RANGES_H_
+#define RECEIVED_RANGES_H_
+
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+/**
+ * Keeps received <offset, length> ranges of a buffer as a sorted array of
+ * merged (disjoint and non-adjacent) intervals.
+ *
+ * Packets of a frame mostly arrive in order, so adding a packet usually only
+ * extends the last interval. A new interval is needed only after a loss,
+ * reordered packets are merged in place. Up to INLINE_INTERVALS intervals are
+ * stored inline, so no allocation takes place unless the frame is heavily
+ * fragmented by losses.
+ */
+class received_ranges {
+public:
+        typedef std::pair<int, int> interval; ///< <offset, length>
+        static constexpr int INLINE_INTERVALS = 16;
+
+        /// Read-only view of the intervals, valid until next modification.
+        class interval_range {
+        public:
+                inline interval_range(const interval *b, const interval *e) : m_begin(b), m_end(e) {}
+                inline const interval *begin() const { return m_begin; }
+                inline const interval *end() const { return m_end; }
+                inline size_t size() const { return m_end - m_begin; }
+                inline bool empty() const { return m_begin == m_end; }
+        private:
+                const interval *m_begin;
+                const interval *m_end;
+        };
+
+        inline void add(int offset, int len) {
+                if (len <= 0) {
+                        return;
+                }
+                interval *d = data();
+                if (m_count == 0 || offset > end(d[m_count - 1])) {
+                        insert(m_count, interval(offset, len));
+                        m_total += len;
+                        return;
+                }
+                if (offset == end(d[m_count - 1])) {
+                        d[m_count - 1].second += len;
+                        m_total += len;
+                        return;
+                }
+
+                // out-of-order or duplicate data - merge with all touched intervals
+                interval *first = std::lower_bound(d, d + m_count, offset,
+                                [](interval const & i, int off) { return end(i) < off; });
+                int start = offset;
+                int stop = offset + len;
+                interval *last = first;
+                while (last != d + m_count && last->first <= stop) {
+                        start = std::min(start, last->first);
+                        stop = std::max(stop, end(*last));
+                        m_total -= last->second;
+                        ++last;
+                }
+                m_total += stop - start;
+                if (first == last) {
+                        insert(first - d, interval(start, stop - start));
+                } else {
+                        *first = interval(start, stop - start);
+                        std::copy(last, d + m_count, first + 1);
+                        m_count -= last - (first + 1);
+                }
+        }
+
+        /// @returns whether whole range [offset, offset + len) was received
+        inline bool covers(int offset, int len) const {
+                const interval *d = data();
+                const interval *it = std::upper_bound(d, d + m_count, offset,
+                                [](int off, interval const & i) { return off < i.first; });
+                if (it == d) {
+                        return false;
+                }
+                --it;
+                return end(*it) >= offset + len;
+        }
+
+        /// @returns number of received bytes (overlapping data counted once)
+        inline int total() const {
+                return m_total;
+        }
+
+        /// @returns sorted merged intervals
+        inline interval_range intervals() const {
+                return interval_range(data(), data() + m_count);
+        }
+
+        /// Removes all intervals, allocated storage (if any) is kept.
+        inline void clear() {
+                m_count = 0;
+                m_total = 0;
+        }
+
+private:
+        static inline int end(interval const & i) {
+                return i.first + i.second;
+        }
+
+        inline interval *data() {
+                return m_overflow.empty() ? m_inline.data() : m_overflow.data();
+        }
+
+        inline const interval *data() const {
+                return m_overflow.empty() ? m_inline.data() : m_overflow.data();
+        }
+
+        inline void insert(int pos, interval const & i) {
+                size_t capacity = m_overflow.empty() ? m_inline.size() : m_overflow.size();
+                if ((size_t) m_count == capacity) {
+                        std::vector<interval> grown(capacity * 2);
+                        std::copy(data(), data() + m_count, grown.begin());
+                        m_overflow.swap(grown);
+                }
+                interval *d = data();
+                std::copy_backward(d + pos, d + m_count, d + m_count + 1);
+                d[pos] = i;
+                m_count += 1;
+        }
+
+        std::array<interval, INLINE_INTERVALS> m_inline;
+        std::vector<interval> m_overflow; ///< used instead of m_inline when it gets full
+        int m_count = 0;
+        int m_total = 0;
+};
+
+#endif // RECEIVED_RANGES_H_
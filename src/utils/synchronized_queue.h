@@ -56,7 +56,8 @@ struct msg_quit : public msg {};
  * if there is no element in the queue.
  *
  * @tparam T type to be stored
- * @tparam max_len maximal length of the queue until it bloks (-1 means unlimited)
+ * @tparam max_len maximal length of the queue until it bloks (-1 means unlimited),
+ *                 can be changed at runtime with set_max_len()
  */
 template<typename T = struct msg *, int max_len = 1>
 class synchronized_queue {
@@ -70,8 +71,8 @@ public:
         void push(T const & message)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (max_len != -1) {
-                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) max_len;});
+                if (m_max_len != -1) {
+                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) m_max_len;});
                 }
                 m_queue.push(message);
                 l.unlock();
@@ -81,14 +82,23 @@ public:
         void push(T && message)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (max_len != -1) {
-                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) max_len;});
+                if (m_max_len != -1) {
+                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) m_max_len;});
                 }
                 m_queue.push(std::move(message));
                 l.unlock();
                 m_queue_incremented.notify_one();
         }
 
+        /// @param len new maximal length (-1 means unlimited)
+        void set_max_len(int len)
+        {
+                std::unique_lock<std::mutex> l(m_lock);
+                m_max_len = len;
+                l.unlock();
+                m_queue_decremented.notify_all();
+        }
+
         T pop(bool nonblocking = false)
         {
                 std::unique_lock<std::mutex> l(m_lock);
@@ -111,6 +121,7 @@ private:
         std::mutex              m_lock;
         std::condition_variable m_queue_decremented;
         std::condition_variable m_queue_incremented;
+        int                     m_max_len = max_len;
 };
 
 #ifndef NO_EXTERN_MSGQ_MSG
@@ -1667,6 +1667,32 @@ static void setparam_vp8_vp9(AVCodecContext *codec_ctx, struct setparam_param *p
         }
 }
 
+/**
+ * Applies a sole bitrate change (eg. from congestion control) to a running
+ * encoder that already uses ABR, without reinitialization. Encoders that
+ * support it (eg. libx264) reconfigure themselves on the next frame.
+ * @retval false the change requires full reconfiguration
+ */
+static bool change_bitrate_live(struct state_video_compress_libav *s, const char *config)
+{
+        if (strncasecmp(config, "bitrate=", strlen("bitrate=")) != 0 || strchr(config, ':') != NULL ||
+                        s->codec_ctx == NULL || s->requested_bitrate <= 0 || s->saved_desc.fps <= 0.0) {
+                return false;
+        }
+        long long bitrate = unit_evaluate(config + strlen("bitrate="));
+        if (bitrate <= 0) {
+                return false;
+        }
+        s->requested_bitrate = bitrate;
+        s->codec_ctx->bit_rate = bitrate;
+        s->codec_ctx->bit_rate_tolerance = bitrate / s->saved_desc.fps * 6;
+        if (s->codec_ctx->rc_max_rate > 0) {
+                s->codec_ctx->rc_max_rate = bitrate;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, "[lavc] Bitrate changed to %lld bps.\n", bitrate);
+        return true;
+}
+
 static void libavcodec_check_messages(struct state_video_compress_libav *s)
 {
         struct message *msg;
@@ -1674,6 +1700,10 @@ static void libavcodec_check_messages(struct state_video_compress_libav *s)
                 struct msg_change_compress_data *data =
                         (struct msg_change_compress_data *) msg;
                 struct response *r;
+                if (change_bitrate_live(s, data->config_string)) {
+                        free_message(msg, new_response(RESPONSE_OK, NULL));
+                        continue;
+                }
                 if (parse_fmt(s, data->config_string) == 0) {
                         log_msg(LOG_LEVEL_NOTICE, "[Libavcodec] Compression successfully changed.\n");
                         r = new_response(RESPONSE_OK, NULL);
@@ -44,6 +44,7 @@
 
 #include "debug.h"
 
+#include <cstring>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -174,6 +175,26 @@ int video_rxtx::check_sender_messages() {
         return ret;
 }
 
+/**
+ * Asks the compression to encode with given bitrate (requested by congestion
+ * control). Only libavcodec supports changing the bitrate on the fly.
+ */
+struct response *video_rxtx::change_compress_bitrate(long long bitrate) {
+        const char *compress_name = get_compress_name(m_compression);
+        if (compress_name == nullptr || strcmp(compress_name, "libavcodec") != 0) {
+                return new_response(RESPONSE_NOT_IMPL, NULL);
+        }
+
+        auto msg = (struct msg_change_compress_data *)
+                new_message(sizeof(struct msg_change_compress_data));
+        msg->what = CHANGE_PARAMS;
+        snprintf(msg->config_string, sizeof msg->config_string, "bitrate=%lld", bitrate);
+        struct response *resp = send_message_to_receiver(CAST_MODULE(m_compression), (struct message *) msg);
+        free_response(resp);
+
+        return new_response(RESPONSE_OK, NULL);
+}
+
 void *video_rxtx::sender_loop() {
         struct video_desc saved_vid_desc;
 
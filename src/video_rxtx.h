@@ -88,6 +88,7 @@ public:
 protected:
         video_rxtx(std::map<std::string, param_u> const &);
         int check_sender_messages();
+        struct response *change_compress_bitrate(long long bitrate);
         bool m_paused;
         bool m_report_paused_play;
         struct module m_sender_mod;
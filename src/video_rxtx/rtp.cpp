@@ -203,6 +203,8 @@ struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg,
                                 }
                         }
                         break;
+                case SENDER_MSG_CHANGE_BITRATE:
+                        return change_compress_bitrate(msg->bitrate);
         }
 
         return new_response(RESPONSE_OK, NULL);
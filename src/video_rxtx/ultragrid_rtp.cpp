@@ -61,7 +61,6 @@
 #include "rtp/rtp_callback.h"
 #include "rtp/video_decoders.h"
 #include "rtp/pbuf.h"
-#include "tfrc.h"
 #include "transmit.h"
 #include "tv.h"
 #include "utils/vf_split.h"
@@ -76,9 +75,85 @@
 #include <chrono>
 #include <sstream>
 #include <utility>
+#include <vector>
+
+#define ARQ_MAX_NACKS 256
+#define TFRC_FEEDBACK_INTERVAL_MS 100
+#define PLAYOUT_DELAY_REPORT_INTERVAL_SEC 1
 
 using namespace std;
 
+ADD_TO_PARAM(adaptive_playout, "adaptive-playout",
+                "* adaptive-playout[=<min_ms>:<max_ms>[:<percentile>]]\n"
+                "  Set playout delay of received video continuously to the percentile of\n"
+                "  measured frame lateness (default 0:500:99) instead of a fixed delay.\n");
+ADD_TO_PARAM(immediate_decode, "immediate-decode",
+                "* immediate-decode\n"
+                "  Decode received video frames as soon as they are complete (from the packet\n"
+                "  reception callback), ignoring playout delay.\n");
+ADD_TO_PARAM(participant_decode_threads, "participant-decode-threads",
+                "* participant-decode-threads=<n>\n"
+                "  Maximal number of threads decoding frames of different senders at once\n"
+                "  (default 1 - decode in the receiving thread only).\n");
+
+namespace {
+/// frames of participants decoded by one thread, see participant_decode_task()
+struct participant_decode_task_data {
+        struct pdb_e **participants;
+        int *results;            ///< pbuf_decode() return values (decoded frame counts)
+        int count;
+        std::chrono::high_resolution_clock::time_point curr_time;
+};
+}
+
+static void *participant_decode_task(void *arg)
+{
+        auto *d = (struct participant_decode_task_data *) arg;
+        for (int i = 0; i < d->count; ++i) {
+                struct pdb_e *cp = d->participants[i];
+                d->results[i] = pbuf_decode(cp->playout_buffer, d->curr_time, decode_video_frame,
+                                cp->decoder_state);
+                pbuf_remove(cp->playout_buffer, d->curr_time);
+        }
+        return NULL;
+}
+
+/**
+ * Decodes frames of participants, the participants are split among at most
+ * max_threads threads (the calling one included). Worker threads are used only
+ * if more participants have a frame ready. Participants must have distinct
+ * decoders.
+ */
+static void participants_decode(vector<struct pdb_e *> & participants, vector<int> & results,
+                std::chrono::high_resolution_clock::time_point const & curr_time, int max_threads)
+{
+        int count = participants.size();
+        int ready = 0;
+        if (max_threads > 1) {
+                for (auto cp : participants) {
+                        ready += cp->decoder_state && pbuf_decode_ready(cp->playout_buffer, curr_time) ? 1 : 0;
+                }
+        }
+        int threads = max(1, min(max_threads, ready));
+        results.resize(count);
+        vector<participant_decode_task_data> tasks(threads);
+        vector<task_result_handle_t> handles(threads);
+        int start = 0;
+        for (int i = 0; i < threads; ++i) {
+                int end = count * (i + 1) / threads;
+                tasks[i] = participant_decode_task_data{participants.data() + start, results.data() + start,
+                        end - start, curr_time};
+                start = end;
+        }
+        for (int i = 1; i < threads; ++i) {
+                handles[i] = task_run_async(participant_decode_task, &tasks[i]);
+        }
+        participant_decode_task(&tasks[0]);
+        for (int i = 1; i < threads; ++i) {
+                wait_task(handles[i]);
+        }
+}
+
 ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &params) :
         rtp_video_rxtx(params), m_send_bytes_total(0)
 {
@@ -88,6 +163,40 @@ ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &p
         m_async_sending = false;
 
         m_control = (struct control_state *) get_module(get_root_module(static_cast<struct module *>(params.at("parent").ptr)), "control");
+
+        if (get_commandline_param("arq")) {
+                m_arq_budget_ms = atoi(get_commandline_param("arq"));
+                if (m_arq_budget_ms <= 0) {
+                        m_arq_budget_ms = DEFAULT_ARQ_BUDGET_MS;
+                }
+        }
+        m_tfrc_feedback = get_commandline_param("tfrc") != NULL ||
+                get_commandline_param("adaptive-fec") != NULL;
+        if (get_commandline_param("adaptive-playout")) {
+                m_adaptive_playout = true;
+                const char *cfg = get_commandline_param("adaptive-playout");
+                if (strlen(cfg) > 0 && sscanf(cfg, "%d:%d:%lf", &m_playout_min_ms, &m_playout_max_ms,
+                                        &m_playout_percentile) < 2) {
+                        log_msg(LOG_LEVEL_ERROR, "Wrong adaptive-playout config: %s, using defaults.\n", cfg);
+                        m_playout_min_ms = DEFAULT_PLAYOUT_MIN_MS;
+                        m_playout_max_ms = DEFAULT_PLAYOUT_MAX_MS;
+                        m_playout_percentile = DEFAULT_PLAYOUT_PERCENTILE;
+                }
+        }
+        if (get_commandline_param("decoder-conceal")) {
+                const char *cfg = get_commandline_param("decoder-conceal");
+                m_partial_deadline_ms = strlen(cfg) > 0 ? max(0, atoi(cfg)) : DEFAULT_CONCEAL_DEADLINE_MS;
+        }
+        m_immediate_decode = get_commandline_param("immediate-decode") != NULL;
+        m_latest_wins = get_commandline_param("drop-policy") &&
+                strcmp(get_commandline_param("drop-policy"), "latest") == 0;
+#ifdef SHARED_DECODER
+        m_participant_decode_threads = 1;
+#else
+        if (get_commandline_param("participant-decode-threads")) {
+                m_participant_decode_threads = max(1, atoi(get_commandline_param("participant-decode-threads")));
+        }
+#endif
 }
 
 ultragrid_rtp_video_rxtx::~ultragrid_rtp_video_rxtx()
@@ -158,10 +267,7 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                 //assert(frame_count == 1);
                 vf_split_horizontal(split_frames, tx_frame.get(),
                                 m_connections_count);
-                for (int i = 0; i < m_connections_count; ++i) {
-                        tx_send_tile(m_tx, split_frames, i,
-                                        m_network_devices[i]);
-                }
+                tx_send_tiles(m_tx, split_frames, m_network_devices);
 
                 vf_free(split_frames);
         }
@@ -174,11 +280,14 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                 rtp_update(m_network_devices[0], curr_time);
                 rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
 
-                // receive RTCP
-                struct timeval timeout;
-                timeout.tv_sec = 0;
-                timeout.tv_usec = 0;
-                rtcp_recv_r(m_network_devices[0], &timeout, ts);
+                // receive RTCP (including retransmission requests) of all connections
+                for (int i = 0; i < m_connections_count; ++i) {
+                        struct timeval timeout;
+                        timeout.tv_sec = 0;
+                        timeout.tv_usec = 0;
+                        while (rtcp_recv_r(m_network_devices[i], &timeout, ts)) {
+                        }
+                }
         }
 
 after_send:
@@ -346,7 +455,12 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
 
         fr = 1;
 
+        vector<struct pdb_e *> participants;
+        vector<int> decode_results;
+
         auto last_not_timeout = std::chrono::steady_clock::time_point::min();
+        auto next_tfrc_feedback = std::chrono::steady_clock::now();
+        auto next_playout_report = std::chrono::steady_clock::now();
 
         while (!should_exit) {
                 struct timeval timeout;
@@ -358,6 +472,12 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
 
                 rtp_update(m_network_devices[0], curr_time);
                 rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
+                // regular RTCP is too infrequent for sender's congestion control
+                if (m_tfrc_feedback && curr_time_st >= next_tfrc_feedback &&
+                                last_not_timeout > curr_time_st - std::chrono::seconds(1)) {
+                        rtp_send_report(m_network_devices[0], ts);
+                        next_tfrc_feedback = curr_time_st + std::chrono::milliseconds(TFRC_FEEDBACK_INTERVAL_MS);
+                }
 
                 /* Receive packets from the network... The timeout is adjusted */
                 /* to match the video capture rate, so the transmitter works.  */
@@ -386,16 +506,15 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                         last_not_timeout = curr_time_st;
                 }
 
+                bool report_playout_delay = m_adaptive_playout && curr_time_st >= next_playout_report;
+                if (report_playout_delay) {
+                        next_playout_report = curr_time_st + std::chrono::seconds(PLAYOUT_DELAY_REPORT_INTERVAL_SEC);
+                }
+
                 /* Decode and render for each participant in the conference... */
                 pdb_iter_t it;
                 cp = pdb_iter_init(m_participants, &it);
                 while (cp != NULL) {
-                        if (tfrc_feedback_is_due(cp->tfrc_state, curr_time)) {
-                                debug_msg("tfrc rate %f\n",
-                                          tfrc_feedback_txrate(cp->tfrc_state,
-                                                               curr_time));
-                        }
-
                         if(cp->decoder_state == NULL &&
                                         !pbuf_is_empty(cp->playout_buffer)) { // the second check is needed because we want to assign display to participant that really sends data
 #ifdef SHARED_DECODER
@@ -431,13 +550,39 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                         break;
                                 }
 #endif // SHARED_DECODER
+                                if (m_adaptive_playout) {
+                                        pbuf_set_adaptive_playout(cp->playout_buffer, m_playout_min_ms,
+                                                        m_playout_max_ms, m_playout_percentile);
+                                }
+                                pbuf_set_partial_decode(cp->playout_buffer, m_partial_deadline_ms);
+                                pbuf_set_latest_wins(cp->playout_buffer, m_latest_wins,
+                                                video_decoder_frames_skippable, cp->decoder_state);
+                                if (m_immediate_decode) {
+                                        pbuf_set_immediate_decode(cp->playout_buffer, decode_video_frame,
+                                                        cp->decoder_state);
+                                }
+                        }
+
+                        if (m_arq_budget_ms > 0) {
+                                uint16_t nacks[ARQ_MAX_NACKS];
+                                pbuf_set_arq(cp->playout_buffer, m_arq_budget_ms);
+                                int count = pbuf_get_nacks(cp->playout_buffer, curr_time_hr, nacks, ARQ_MAX_NACKS);
+                                rtp_send_nack(m_network_devices[0], cp->ssrc, nacks, count);
                         }
 
+                        participants.push_back(cp);
+                        cp = pdb_iter_next(&it);
+                }
+
+                /* Decode and render video of participants (each has its own decoder)... */
+                participants_decode(participants, decode_results, curr_time_hr, m_participant_decode_threads);
+
+                for (size_t i = 0; i < participants.size(); ++i) {
+                        cp = participants[i];
                         struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
 
-                        /* Decode and render video... */
-                        if (pbuf_decode
-                            (cp->playout_buffer, curr_time_hr, decode_video_frame, vdecoder_state)) {
+                        // with immediate decode, more frames may have been decoded since last round
+                        for (int frame = 0; frame < decode_results[i]; ++frame) {
                                 tiles_post++;
                                 /* we have data from all connections we need */
                                 if(tiles_post == m_connections_count)
@@ -486,9 +631,14 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                 }
                         }
 
-                        pbuf_remove(cp->playout_buffer, curr_time_hr);
-                        cp = pdb_iter_next(&it);
+                        if (report_playout_delay && cp->decoder_state) {
+                                ostringstream oss;
+                                oss << "RECV ssrc " << hex << cp->ssrc << dec << " playoutDelayMs " <<
+                                        pbuf_get_playout_delay(cp->playout_buffer) * 1000.0;
+                                control_report_stats(m_control, oss.str());
+                        }
                 }
+                participants.clear();
                 pdb_iter_done(&it);
         }
 
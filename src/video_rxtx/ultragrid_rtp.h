@@ -47,6 +47,11 @@
 #include <mutex>
 #include <string>
 
+#define DEFAULT_PLAYOUT_MIN_MS 0
+#define DEFAULT_PLAYOUT_MAX_MS 500
+#define DEFAULT_PLAYOUT_PERCENTILE 99.0
+#define DEFAULT_CONCEAL_DEADLINE_MS 10
+
 struct control_state;
 
 class ultragrid_rtp_video_rxtx : public rtp_video_rxtx {
@@ -93,6 +98,17 @@ private:
         long long int m_nano_per_frame_actual_cumul = 0;
         long long int m_nano_per_frame_expected_cumul = 0;
         long long int m_compress_millis_cumul = 0;
+
+        int m_arq_budget_ms = 0; ///< retransmission requests disabled if 0, see "arq" param
+        bool m_tfrc_feedback = false; ///< send frequent reports for sender congestion or FEC control, see "tfrc" and "adaptive-fec" params
+        bool m_adaptive_playout = false; ///< see "adaptive-playout" param
+        int m_playout_min_ms = DEFAULT_PLAYOUT_MIN_MS;
+        int m_playout_max_ms = DEFAULT_PLAYOUT_MAX_MS;
+        double m_playout_percentile = DEFAULT_PLAYOUT_PERCENTILE;
+        int m_partial_deadline_ms = -1; ///< see "decoder-conceal" param, -1 if disabled
+        int m_participant_decode_threads = 1; ///< see "participant-decode-threads" param
+        bool m_latest_wins = false; ///< "drop-policy=latest"
+        bool m_immediate_decode = false; ///< see "immediate-decode" param
 };
 
 #endif // VIDEO_RXTX_ULTRAGRID_RTP_H_
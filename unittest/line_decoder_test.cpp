@@ -0,0 +1,224 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <cppunit/config/SourcePrefix.h>
+#include "line_decoder_test.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "rtp/line_decoder.h"
+#include "utils/received_ranges.h"
+#include "video.h"
+
+#define WIDTH 3840
+#define HEIGHT 2160
+#define PAYLOAD_SIZE 8400 ///< divisible by both R10k and v210 pixel block size
+#define FRAMES 20
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( line_decoder_test );
+
+line_decoder_test::line_decoder_test()
+{
+}
+
+line_decoder_test::~line_decoder_test()
+{
+}
+
+void
+line_decoder_test::setUp()
+{
+}
+
+
+void
+line_decoder_test::tearDown()
+{
+}
+
+/**
+ * Decodes a 4K frame received as packets (in reverse order as passed by the
+ * playout buffer) in the receiving thread and with worker threads, checks that
+ * the result is the same and prints throughput of both modes.
+ */
+void
+line_decoder_test::benchmark(codec_t in, codec_t out)
+{
+        struct line_decoder ld{};
+        ld.src_bpp = get_bpp(in);
+        ld.dst_bpp = get_bpp(out);
+        ld.shifts[0] = 0;
+        ld.shifts[1] = 8;
+        ld.shifts[2] = 16;
+        ld.decode_line = get_decoder_from_to(in, out, true);
+        ld.src_linesize = vc_get_linesize(WIDTH, in);
+        ld.dst_linesize = ld.dst_pitch = vc_get_linesize(WIDTH, out);
+        CPPUNIT_ASSERT(ld.decode_line != NULL);
+
+        int src_len = ld.src_linesize * HEIGHT;
+        vector<unsigned char> src(src_len);
+        for (auto & c : src) {
+                c = rand();
+        }
+        vector<char> dst_st(ld.dst_pitch * HEIGHT);
+        vector<char> dst_mt(ld.dst_pitch * HEIGHT);
+        struct tile tile_st{};
+        tile_st.data = dst_st.data();
+        tile_st.data_len = dst_st.size();
+        struct tile tile_mt = tile_st;
+        tile_mt.data = dst_mt.data();
+
+        vector<line_decode_pkt> pkts_st;
+        vector<line_decode_pkt> pkts_mt;
+        for (int pos = (src_len - 1) / PAYLOAD_SIZE * PAYLOAD_SIZE; pos >= 0; pos -= PAYLOAD_SIZE) {
+                int len = min(PAYLOAD_SIZE, src_len - pos);
+                pkts_st.push_back(line_decode_pkt{&ld, &tile_st, (uint32_t) pos, src.data() + pos, len});
+                pkts_mt.push_back(line_decode_pkt{&ld, &tile_mt, (uint32_t) pos, src.data() + pos, len});
+        }
+
+        int threads = max(2u, thread::hardware_concurrency());
+        double duration[2];
+        for (int mt = 0; mt < 2; ++mt) {
+                auto & pkts = mt ? pkts_mt : pkts_st;
+                auto t0 = chrono::steady_clock::now();
+                for (int i = 0; i < FRAMES; ++i) {
+                        CPPUNIT_ASSERT_EQUAL(0, line_decode_packets(pkts.data(), pkts.size(), mt ? threads : 1));
+                }
+                duration[mt] = chrono::duration_cast<chrono::duration<double>>(chrono::steady_clock::now() - t0).count();
+        }
+
+        CPPUNIT_ASSERT_MESSAGE("Parallel decoding result differs", dst_st == dst_mt);
+
+        cout << "\n" << get_codec_name(in) << "->" << get_codec_name(out) << " " << WIDTH << "x" << HEIGHT <<
+                ": receiving thread " << FRAMES / duration[0] << " fps (" <<
+                FRAMES * src_len / duration[0] / 1000000 << " MB/s), " << threads << " threads " <<
+                FRAMES / duration[1] << " fps (" << FRAMES * src_len / duration[1] / 1000000 << " MB/s)\n";
+}
+
+void
+line_decoder_test::testParallelDecodeR10k()
+{
+        benchmark(R10k, RGBA);
+}
+
+void
+line_decoder_test::testParallelDecodeV210()
+{
+        benchmark(v210, UYVY);
+}
+
+/**
+ * Decodes a v210 frame with some packets missing over a frame buffer with
+ * garbage and conceals the missing parts from the same frame decoded
+ * completely - the result must match the complete frame.
+ */
+void
+line_decoder_test::testConceal()
+{
+        const int width = 1920;
+        const int height = 64;
+        const int payload_size = 1200; // v210 blocks, not aligned to line size
+        struct line_decoder ld{};
+        ld.src_bpp = get_bpp(v210);
+        ld.dst_bpp = get_bpp(UYVY);
+        ld.decode_line = get_decoder_from_to(v210, UYVY, true);
+        ld.src_linesize = vc_get_linesize(width, v210);
+        ld.dst_linesize = ld.dst_pitch = vc_get_linesize(width, UYVY);
+        CPPUNIT_ASSERT(ld.decode_line != NULL);
+
+        int src_len = ld.src_linesize * height;
+        vector<unsigned char> src(src_len);
+        for (auto & c : src) {
+                c = rand();
+        }
+        vector<char> complete(ld.dst_pitch * height);
+        vector<char> partial(ld.dst_pitch * height);
+        for (auto & c : partial) {
+                c = rand();
+        }
+        struct tile tile_complete{};
+        tile_complete.data = complete.data();
+        tile_complete.data_len = complete.size();
+        struct tile tile_partial = tile_complete;
+        tile_partial.data = partial.data();
+
+        received_ranges received;
+        for (int pos = 0; pos < src_len; pos += payload_size) {
+                int len = min(payload_size, src_len - pos);
+                CPPUNIT_ASSERT(line_decode_packet(&ld, &tile_complete, pos, src.data() + pos, len));
+                // drop every 7th packet and the last one
+                if ((pos / payload_size) % 7 == 3 || pos + len == src_len) {
+                        continue;
+                }
+                CPPUNIT_ASSERT(line_decode_packet(&ld, &tile_partial, pos, src.data() + pos, len));
+                received.add(pos, len);
+        }
+
+        CPPUNIT_ASSERT(complete != partial);
+        int lines = line_conceal_missing(&ld, &tile_partial, complete.data(), received, src_len);
+        CPPUNIT_ASSERT(lines > 0);
+        CPPUNIT_ASSERT_MESSAGE("Concealed frame differs", complete == partial);
+}
+
+/**
+ * Conceals a partially received frame from the previous one and updates the
+ * previous frame with the received lines only - it must then match the
+ * concealed frame.
+ */
+void
+line_decoder_test::testStoreReceived()
+{
+        const int width = 1920;
+        const int height = 64;
+        const int payload_size = 1200;
+        struct line_decoder ld{};
+        ld.src_bpp = get_bpp(v210);
+        ld.dst_bpp = get_bpp(UYVY);
+        ld.decode_line = get_decoder_from_to(v210, UYVY, true);
+        ld.src_linesize = vc_get_linesize(width, v210);
+        ld.dst_linesize = ld.dst_pitch = vc_get_linesize(width, UYVY);
+        CPPUNIT_ASSERT(ld.decode_line != NULL);
+
+        int src_len = ld.src_linesize * height;
+        vector<unsigned char> src(src_len);
+        for (auto & c : src) {
+                c = rand();
+        }
+        vector<char> prev(ld.dst_pitch * height);
+        vector<char> curr(ld.dst_pitch * height);
+        for (auto & c : prev) {
+                c = rand();
+        }
+        for (auto & c : curr) {
+                c = rand();
+        }
+        struct tile tile{};
+        tile.data = curr.data();
+        tile.data_len = curr.size();
+
+        received_ranges received;
+        for (int pos = 0; pos < src_len; pos += payload_size) {
+                int len = min(payload_size, src_len - pos);
+                // drop the first packet and every 5th one
+                if ((pos / payload_size) % 5 == 0) {
+                        continue;
+                }
+                CPPUNIT_ASSERT(line_decode_packet(&ld, &tile, pos, src.data() + pos, len));
+                received.add(pos, len);
+        }
+
+        CPPUNIT_ASSERT(line_conceal_missing(&ld, &tile, prev.data(), received, src_len) > 0);
+        CPPUNIT_ASSERT(prev != curr);
+        line_store_received(&ld, &tile, prev.data(), received, src_len);
+        CPPUNIT_ASSERT_MESSAGE("Stored frame differs", prev == curr);
+}
@@ -0,0 +1,31 @@
+#ifndef LINE_DECODER_TEST_H
+#define LINE_DECODER_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "types.h"
+
+class line_decoder_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( line_decoder_test );
+  CPPUNIT_TEST( testParallelDecodeR10k );
+  CPPUNIT_TEST( testParallelDecodeV210 );
+  CPPUNIT_TEST( testConceal );
+  CPPUNIT_TEST( testStoreReceived );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  line_decoder_test();
+  ~line_decoder_test();
+  void setUp();
+  void tearDown();
+
+  void testParallelDecodeR10k();
+  void testParallelDecodeV210();
+  void testConceal();
+  void testStoreReceived();
+private:
+  void benchmark(codec_t in, codec_t out);
+};
+
+#endif //  LINE_DECODER_TEST_H
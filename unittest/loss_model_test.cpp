@@ -0,0 +1,87 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <cppunit/config/SourcePrefix.h>
+#include "loss_model_test.h"
+
+#include <memory>
+
+#include "utils/loss_model.h"
+
+#define SAMPLES 1000000
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( loss_model_test );
+
+loss_model_test::loss_model_test()
+{
+}
+
+loss_model_test::~loss_model_test()
+{
+}
+
+void
+loss_model_test::setUp()
+{
+}
+
+void
+loss_model_test::tearDown()
+{
+}
+
+void
+loss_model_test::testConfig()
+{
+        const char *valid[] = { "bernoulli:0", "bernoulli:0.05", "ge:0.01:0.3", "ge:0.01:0.3:0.001:0.5" };
+        const char *invalid[] = { "", "bernoulli", "bernoulli:1.5", "ge:0.01", "ge:0:0", "ge:0.1:-1", "gilbert:0.1:0.1" };
+        for (auto cfg : valid) {
+                unique_ptr<loss_model> m(loss_model::create(cfg, 1));
+                CPPUNIT_ASSERT_MESSAGE(cfg, m != nullptr);
+        }
+        for (auto cfg : invalid) {
+                unique_ptr<loss_model> m(loss_model::create(cfg, 1));
+                CPPUNIT_ASSERT_MESSAGE(cfg, m == nullptr);
+        }
+}
+
+void
+loss_model_test::testBernoulli()
+{
+        unique_ptr<loss_model> m(loss_model::create("bernoulli:0.05", 1));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.05, m->mean_loss(), 1e-9);
+        int lost = 0;
+        for (int i = 0; i < SAMPLES; ++i) {
+                lost += m->lost();
+        }
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.05, (double) lost / SAMPLES, 0.002);
+}
+
+/**
+ * With lossless good and lossy bad state, the loss rate is p / (p + r) and
+ * bursts are geometric with mean length 1 / r.
+ */
+void
+loss_model_test::testGilbertElliott()
+{
+        unique_ptr<loss_model> m(loss_model::create("ge:0.01:0.25", 1));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.01 / 0.26, m->mean_loss(), 1e-9);
+        int lost = 0;
+        int bursts = 0;
+        bool last = false;
+        for (int i = 0; i < SAMPLES; ++i) {
+                bool l = m->lost();
+                lost += l;
+                bursts += l && !last;
+                last = l;
+        }
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(m->mean_loss(), (double) lost / SAMPLES, 0.004);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(4.0, (double) lost / bursts, 0.2);
+}
+
@@ -0,0 +1,25 @@
+#ifndef LOSS_MODEL_TEST_H
+#define LOSS_MODEL_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class loss_model_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( loss_model_test );
+  CPPUNIT_TEST( testConfig );
+  CPPUNIT_TEST( testBernoulli );
+  CPPUNIT_TEST( testGilbertElliott );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  loss_model_test();
+  ~loss_model_test();
+  void setUp();
+  void tearDown();
+
+  void testConfig();
+  void testBernoulli();
+  void testGilbertElliott();
+};
+
+#endif //  LOSS_MODEL_TEST_H
@@ -0,0 +1,161 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <cppunit/config/SourcePrefix.h>
+#include "pbuf_test.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "rtp/net_udp.h"
+#include "rtp/pbuf.h"
+#include "rtp/rtp.h"
+#include "rtp/rtp_callback.h"
+
+#define LARGE_FRAME_PKTS 45000 ///< eg. 8K UYVY with 1500 B MTU
+#define REORDERED_PKTS 10      ///< first packets of the frame arrive last
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( pbuf_test );
+
+pbuf_test::pbuf_test()
+{
+}
+
+pbuf_test::~pbuf_test()
+{
+}
+
+void
+pbuf_test::setUp()
+{
+}
+
+void
+pbuf_test::tearDown()
+{
+}
+
+static rtp_packet *create_packet(uint16_t seq, uint32_t ts, bool m)
+{
+        rtp_packet *pkt = (rtp_packet *)(void *) udp_packet_alloc();
+        memset(pkt, 0, RTP_PACKET_HEADER_SIZE + 12);
+        pkt->v = 2;
+        pkt->pt = PT_VIDEO;
+        pkt->m = m;
+        pkt->seq = seq;
+        pkt->ts = ts;
+        pkt->data = (char *) pkt + RTP_PACKET_HEADER_SIZE + 12;
+        pkt->data_len = 0;
+        return pkt;
+}
+
+struct decoded_frame {
+        int packets = 0;
+        bool descending = true;
+        uint16_t first_seq = 0;
+};
+
+static int count_packets(struct coded_data *cdata, void *udata, struct pbuf_stats *)
+{
+        auto f = static_cast<decoded_frame *>(udata);
+        for (struct coded_data *c = cdata; c != NULL; c = c->nxt) {
+                if (c->nxt && (uint16_t) (c->seqno - c->nxt->seqno) != 1) {
+                        f->descending = false;
+                }
+                f->first_seq = c->seqno;
+                f->packets += 1;
+        }
+        return TRUE;
+}
+
+/**
+ * Frame spanning more than a half of the seqno space (with wrap-around and
+ * reordered packets preceding the first received one) must be complete.
+ */
+void
+pbuf_test::testLargeFrame()
+{
+        struct pbuf *pb = pbuf_init(NULL);
+        uint16_t first_seq = 60000;
+        for (int i = REORDERED_PKTS; i < LARGE_FRAME_PKTS; ++i) {
+                pbuf_insert(pb, create_packet(first_seq + i, 1000, i == LARGE_FRAME_PKTS - 1));
+        }
+        for (int i = REORDERED_PKTS - 1; i >= 0; --i) {
+                pbuf_insert(pb, create_packet(first_seq + i, 1000, false));
+        }
+
+        decoded_frame f;
+        auto later = chrono::high_resolution_clock::now() + chrono::seconds(1);
+        CPPUNIT_ASSERT(pbuf_decode(pb, later, count_packets, &f));
+        CPPUNIT_ASSERT_EQUAL(LARGE_FRAME_PKTS, f.packets);
+        CPPUNIT_ASSERT(f.descending);
+        CPPUNIT_ASSERT_EQUAL(first_seq, f.first_seq);
+        pbuf_destroy(pb);
+}
+
+/**
+ * Frame whose m-bit packet overtakes another packet of it must not be decoded
+ * immediately before the packet arrives.
+ */
+void
+pbuf_test::testImmediateDecodeReordered()
+{
+        struct pbuf *pb = pbuf_init(NULL);
+        decoded_frame f;
+        pbuf_set_immediate_decode(pb, count_packets, &f);
+
+        pbuf_insert(pb, create_packet(100, 1000, false));
+        pbuf_insert(pb, create_packet(101, 1000, false));
+        pbuf_insert(pb, create_packet(103, 1000, true));
+        CPPUNIT_ASSERT_EQUAL(0, f.packets);
+        pbuf_insert(pb, create_packet(102, 1000, false));
+        CPPUNIT_ASSERT_EQUAL(4, f.packets);
+
+        // next frame must follow the previous one
+        f = decoded_frame();
+        pbuf_insert(pb, create_packet(105, 2000, true));
+        CPPUNIT_ASSERT_EQUAL(0, f.packets);
+        pbuf_insert(pb, create_packet(104, 2000, false));
+        CPPUNIT_ASSERT_EQUAL(2, f.packets);
+
+        // both frames are accounted for
+        auto now = chrono::high_resolution_clock::now();
+        CPPUNIT_ASSERT_EQUAL(2, pbuf_decode(pb, now, count_packets, &f));
+        CPPUNIT_ASSERT_EQUAL(0, pbuf_decode(pb, now, count_packets, &f));
+        pbuf_destroy(pb);
+}
+
+static bool skippable(void *udata)
+{
+        return *static_cast<bool *>(udata);
+}
+
+/**
+ * With latest-wins, older complete frame is skipped only if the stream
+ * allows skipping (not an inter-frame codec).
+ */
+void
+pbuf_test::testLatestWins()
+{
+        for (bool allowed : { false, true }) {
+                struct pbuf *pb = pbuf_init(NULL);
+                pbuf_set_latest_wins(pb, true, skippable, &allowed);
+                pbuf_insert(pb, create_packet(100, 1000, false));
+                pbuf_insert(pb, create_packet(101, 1000, true));
+                pbuf_insert(pb, create_packet(102, 2000, false));
+                pbuf_insert(pb, create_packet(103, 2000, true));
+
+                decoded_frame f;
+                auto later = chrono::high_resolution_clock::now() + chrono::seconds(1);
+                CPPUNIT_ASSERT(pbuf_decode(pb, later, count_packets, &f));
+                CPPUNIT_ASSERT_EQUAL(2, f.packets);
+                CPPUNIT_ASSERT_EQUAL((uint16_t) (allowed ? 102 : 100), f.first_seq);
+                pbuf_destroy(pb);
+        }
+}
@@ -0,0 +1,25 @@
+#ifndef PBUF_TEST_H
+#define PBUF_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class pbuf_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( pbuf_test );
+  CPPUNIT_TEST( testLargeFrame );
+  CPPUNIT_TEST( testImmediateDecodeReordered );
+  CPPUNIT_TEST( testLatestWins );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  pbuf_test();
+  ~pbuf_test();
+  void setUp();
+  void tearDown();
+
+  void testLargeFrame();
+  void testImmediateDecodeReordered();
+  void testLatestWins();
+};
+
+#endif //  PBUF_TEST_H
@@ -0,0 +1,162 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <cppunit/config/SourcePrefix.h>
+#include "received_ranges_test.h"
+
+#include <utility>
+#include <vector>
+
+#include "utils/received_ranges.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( received_ranges_test );
+
+received_ranges_test::received_ranges_test()
+{
+}
+
+received_ranges_test::~received_ranges_test()
+{
+}
+
+void
+received_ranges_test::setUp()
+{
+}
+
+void
+received_ranges_test::tearDown()
+{
+}
+
+static vector<pair<int, int>> get_intervals(received_ranges const & r)
+{
+        auto i = r.intervals();
+        return vector<pair<int, int>>(i.begin(), i.end());
+}
+
+void
+received_ranges_test::testInOrder()
+{
+        received_ranges r;
+        r.add(0, 100);
+        r.add(100, 100); // adjacent
+        r.add(300, 100); // gap
+        r.add(200, 0);   // empty range is ignored
+        vector<pair<int, int>> expected{{0, 200}, {300, 100}};
+        CPPUNIT_ASSERT(get_intervals(r) == expected);
+        CPPUNIT_ASSERT_EQUAL(300, r.total());
+
+        r.clear();
+        CPPUNIT_ASSERT(r.intervals().empty());
+        CPPUNIT_ASSERT_EQUAL(0, r.total());
+}
+
+void
+received_ranges_test::testOutOfOrder()
+{
+        received_ranges r;
+        r.add(400, 100);
+        r.add(0, 100);
+        r.add(200, 100);
+        vector<pair<int, int>> expected{{0, 100}, {200, 100}, {400, 100}};
+        CPPUNIT_ASSERT(get_intervals(r) == expected);
+
+        // fills the gap and joins both adjacent neighbours
+        r.add(100, 100);
+        expected = {{0, 300}, {400, 100}};
+        CPPUNIT_ASSERT(get_intervals(r) == expected);
+        r.add(300, 100);
+        expected = {{0, 500}};
+        CPPUNIT_ASSERT(get_intervals(r) == expected);
+        CPPUNIT_ASSERT_EQUAL(500, r.total());
+}
+
+void
+received_ranges_test::testOverlapping()
+{
+        received_ranges r;
+        r.add(100, 100);
+        r.add(300, 100);
+        r.add(500, 100);
+        r.add(150, 100);  // overlaps first one
+        vector<pair<int, int>> expected{{100, 150}, {300, 100}, {500, 100}};
+        CPPUNIT_ASSERT(get_intervals(r) == expected);
+        CPPUNIT_ASSERT_EQUAL(350, r.total());
+
+        r.add(50, 500);   // spans all intervals partially
+        expected = {{50, 550}};
+        CPPUNIT_ASSERT(get_intervals(r) == expected);
+        CPPUNIT_ASSERT_EQUAL(550, r.total());
+}
+
+void
+received_ranges_test::testDuplicate()
+{
+        received_ranges r;
+        r.add(0, 100);
+        r.add(200, 100);
+        r.add(0, 100);
+        r.add(200, 100);
+        r.add(220, 50);   // contained in existing interval
+        vector<pair<int, int>> expected{{0, 100}, {200, 100}};
+        CPPUNIT_ASSERT(get_intervals(r) == expected);
+        CPPUNIT_ASSERT_EQUAL(200, r.total());
+}
+
+void
+received_ranges_test::testCovers()
+{
+        received_ranges r;
+        r.add(100, 100);
+        r.add(300, 100);
+
+        CPPUNIT_ASSERT(r.covers(100, 100));
+        CPPUNIT_ASSERT(r.covers(100, 1));
+        CPPUNIT_ASSERT(r.covers(199, 1));
+        CPPUNIT_ASSERT(r.covers(300, 100));
+        CPPUNIT_ASSERT(!r.covers(99, 1));
+        CPPUNIT_ASSERT(!r.covers(99, 2));
+        CPPUNIT_ASSERT(!r.covers(200, 1));
+        CPPUNIT_ASSERT(!r.covers(199, 2));
+        CPPUNIT_ASSERT(!r.covers(150, 200)); // spans the gap
+        CPPUNIT_ASSERT(!r.covers(0, 10));
+        CPPUNIT_ASSERT(!r.covers(400, 1));
+}
+
+/**
+ * More intervals than fit the inline storage.
+ */
+void
+received_ranges_test::testManyIntervals()
+{
+        received_ranges r;
+        const int count = received_ranges::INLINE_INTERVALS * 3;
+        for (int i = count - 1; i >= 0; --i) {
+                r.add(i * 20, 10);
+        }
+        CPPUNIT_ASSERT_EQUAL((size_t) count, r.intervals().size());
+        CPPUNIT_ASSERT_EQUAL(count * 10, r.total());
+        for (int i = 0; i < count; ++i) {
+                CPPUNIT_ASSERT(r.covers(i * 20, 10));
+                CPPUNIT_ASSERT(!r.covers(i * 20 + 10, 1));
+        }
+
+        for (int i = 0; i < count; ++i) {
+                r.add(i * 20 + 10, 10);
+        }
+        vector<pair<int, int>> expected{{0, count * 20}};
+        CPPUNIT_ASSERT(get_intervals(r) == expected);
+
+        // storage is reused after clear()
+        r.clear();
+        r.add(0, 10);
+        expected = {{0, 10}};
+        CPPUNIT_ASSERT(get_intervals(r) == expected);
+}
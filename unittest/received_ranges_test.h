@@ -0,0 +1,31 @@
+#ifndef RECEIVED_RANGES_TEST_H
+#define RECEIVED_RANGES_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class received_ranges_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( received_ranges_test );
+  CPPUNIT_TEST( testInOrder );
+  CPPUNIT_TEST( testOutOfOrder );
+  CPPUNIT_TEST( testOverlapping );
+  CPPUNIT_TEST( testDuplicate );
+  CPPUNIT_TEST( testCovers );
+  CPPUNIT_TEST( testManyIntervals );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  received_ranges_test();
+  ~received_ranges_test();
+  void setUp();
+  void tearDown();
+
+  void testInOrder();
+  void testOutOfOrder();
+  void testOverlapping();
+  void testDuplicate();
+  void testCovers();
+  void testManyIntervals();
+};
+
+#endif //  RECEIVED_RANGES_TEST_H
@@ -0,0 +1,134 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <cppunit/config/SourcePrefix.h>
+#include "rs_test.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "rs/fec.h"
+}
+
+#define MAX_K 255 ///< same as in rtp/rs.cpp
+#define MAX_N 255
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( rs_test );
+
+rs_test::rs_test()
+{
+}
+
+rs_test::~rs_test()
+{
+}
+
+void
+rs_test::setUp()
+{
+}
+
+
+void
+rs_test::tearDown()
+{
+}
+
+typedef vector<vector<gf>> blocks;
+
+static blocks encode(const fec_t *code, blocks const & data, int sz)
+{
+        int m = code->n - code->k;
+        blocks parity(m, vector<gf>(sz));
+        vector<const gf *> src;
+        for (auto const & b : data) {
+                src.push_back(b.data());
+        }
+        vector<gf *> dst;
+        vector<unsigned> idx;
+        for (int i = 0; i < m; ++i) {
+                dst.push_back(parity[i].data());
+                idx.push_back(code->k + i);
+        }
+        fec_encode(code, src.data(), dst.data(), idx.data(), m, sz);
+        return parity;
+}
+
+/// Loses first min(k, n - k) data blocks and recovers them from parity.
+static blocks decode(const fec_t *code, blocks const & data, blocks const & parity, int sz)
+{
+        int lost = min<int>(code->k, parity.size());
+        blocks out(lost, vector<gf>(sz));
+        vector<const gf *> in;
+        vector<unsigned> idx;
+        for (int i = 0; i < code->k; ++i) {
+                if (i < lost) {
+                        in.push_back(parity[i].data());
+                        idx.push_back(code->k + i);
+                } else {
+                        in.push_back(data[i].data());
+                        idx.push_back(i);
+                }
+        }
+        vector<gf *> dst;
+        for (auto & b : out) {
+                dst.push_back(b.data());
+        }
+        fec_decode(code, in.data(), dst.data(), idx.data(), sz);
+        return out;
+}
+
+/**
+ * Checks that every SIMD implementation supported by this CPU produces
+ * byte-exact same parity and recovered data as the scalar code for all k. Rows
+ * of the encoding matrix do not depend on n, so codes with n = MAX_N cover
+ * all n. Block sizes vary to exercise the scalar tails of the kernels.
+ */
+void
+rs_test::testSimdMatchesScalar()
+{
+        enum fec_simd orig = fec_get_simd();
+
+        for (int k = 1; k <= MAX_K; ++k) {
+                int sz = 1 + (k * 53) % 300;
+                fec_set_simd(FEC_SIMD_NONE);
+                fec_t *code = fec_new(k, MAX_N);
+                blocks data(k, vector<gf>(sz));
+                for (auto & b : data) {
+                        for (auto & c : b) {
+                                c = rand();
+                        }
+                }
+                blocks parity = encode(code, data, sz);
+                blocks recovered;
+                if (k < MAX_N) {
+                        recovered = decode(code, data, parity, sz);
+                        for (unsigned i = 0; i < recovered.size(); ++i) {
+                                CPPUNIT_ASSERT_MESSAGE("Scalar decode failed, k=" + to_string(k),
+                                                recovered[i] == data[i]);
+                        }
+                }
+
+                for (int simd = FEC_SIMD_NONE + 1; simd <= fec_simd_best(); ++simd) {
+                        fec_set_simd((enum fec_simd) simd);
+                        string msg = string(fec_simd_name((enum fec_simd) simd)) +
+                                " differs, k=" + to_string(k) + ", sz=" + to_string(sz);
+                        CPPUNIT_ASSERT_MESSAGE("Encoding with " + msg, encode(code, data, sz) == parity);
+                        if (k < MAX_N) {
+                                CPPUNIT_ASSERT_MESSAGE("Decoding with " + msg,
+                                                decode(code, data, parity, sz) == recovered);
+                        }
+                }
+                fec_free(code);
+        }
+
+        fec_set_simd(orig);
+}
@@ -0,0 +1,21 @@
+#ifndef RS_TEST_H
+#define RS_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class rs_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( rs_test );
+  CPPUNIT_TEST( testSimdMatchesScalar );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  rs_test();
+  ~rs_test();
+  void setUp();
+  void tearDown();
+
+  void testSimdMatchesScalar();
+};
+
+#endif //  RS_TEST_H